@@ -0,0 +1,132 @@
+#!/bin/bash
+
+# Compare the throughput of `gd-tools batch` with one process per request,
+# then measure `gd-tools mecab-batch` in MB/s for every number of threads up to the number of cores.
+# If the mandarin dictionary is installed, compare `gd-tools mandarin` with the shell script it replaced.
+# Then, compare the latency of a lookup with and without `gd-tools serve`.
+# With QUICKBENCH_ANKI=1, finally run the gd-ankisearch benchmarks of the tests against an AnkiConnect stand-in.
+# Usage: ./quickbench.sh [N_REQUESTS] [COMMAND]
+
+set -euo pipefail
+
+# Every process does its own work unless a section says otherwise.
+export GD_TOOLS_NO_SERVER=1
+
+readonly n_requests=${1:-200}
+readonly cmd=${2:-marisa}
+readonly sentences=(
+	"ケーキを食べたかったけど、もう売り切れていた。"
+	"お前はもう死んでいる。"
+	"明日は雨が降るらしいから、傘を持っていきなさい。"
+	"この本を読み終わったら貸してあげる。"
+)
+
+xmake config --tests=n -m release >/dev/null
+xmake build -w gd-tools >/dev/null
+bin=$(find build -type f -name gd-tools -path '*release*' | head -n 1)
+readonly bin
+
+# Numbers are only comparable between runs on the same machine and revision, so print both first.
+echo "revision: $(git describe --always --dirty)"
+echo "cpu:      $(grep -m 1 '^model name' /proc/cpuinfo | cut -d ':' -f 2- | sed 's/^ *//') ($(nproc) threads)"
+echo "requests: $n_requests x $cmd"
+
+requests=$(mktemp)
+corpus=$(mktemp)
+mandarin_script=$(mktemp)
+trap 'rm -f -- "$requests" "$corpus" "$mandarin_script"' EXIT
+for ((i = 0; i < n_requests; ++i)); do
+	sentence=${sentences[i % ${#sentences[@]}]}
+	printf '{"id": %d, "cmd": "%s", "word": "%s", "sentence": "%s"}\n' "$i" "$cmd" "${sentence:0:2}" "$sentence"
+done >"$requests"
+
+lines_per_s() {
+	awk -v n="$1" -v start="$2" -v end="$3" 'BEGIN { printf "%.1f", n / ((end - start) / 1e9) }'
+}
+
+start=$(date +%s%N)
+for ((i = 0; i < n_requests; ++i)); do
+	sentence=${sentences[i % ${#sentences[@]}]}
+	"$bin" "$cmd" --word "${sentence:0:2}" --sentence "$sentence" >/dev/null
+done
+end=$(date +%s%N)
+echo "per process: $(lines_per_s "$n_requests" "$start" "$end") lines/s"
+
+start=$(date +%s%N)
+"$bin" batch <"$requests" >/dev/null
+end=$(date +%s%N)
+echo "batch:       $(lines_per_s "$n_requests" "$start" "$end") lines/s"
+
+for ((i = 0; i < 50000; ++i)); do
+	echo "${sentences[i % ${#sentences[@]}]}"
+done >"$corpus"
+
+for ((threads = 1; threads <= $(nproc); threads *= 2)); do
+	echo -n "mecab-batch, $threads threads: "
+	"$bin" mecab-batch --input "$corpus" --threads "$threads" --stats yes 2>&1 >/dev/null | grep -o '[0-9.]* MB/s$'
+done
+
+ms_per_lookup() {
+	awk -v n="$1" -v start="$2" -v end="$3" 'BEGIN { printf "%.2f", (end - start) / 1e6 / n }'
+}
+
+# Usage: time_mandarin LABEL CLEAR_CACHE COMMAND...
+time_mandarin() {
+	local -r label=$1 clear_cache=$2
+	shift 2
+	local start end
+	start=$(date +%s%N)
+	for ((i = 0; i < n_requests; ++i)); do
+		if $clear_cache; then
+			rm -f -- /tmp/gd-mandarin_cache
+		fi
+		"$@" --word 天气 --sentence "今天天气很好，我们去公园散步吧。" >/dev/null
+	done
+	end=$(date +%s%N)
+	echo "$label $(ms_per_lookup "$n_requests" "$start" "$end") ms/lookup"
+}
+
+if [[ -f ~/.local/gd-mandarin/dicrc ]] && [[ -f ~/.local/gd-mandarin/user.dic ]]; then
+	# The script as it was before `gd-tools mandarin` replaced it.
+	git show "$(git log -1 --format=%H --diff-filter=D -- src/gd-mandarin.sh)^:src/gd-mandarin.sh" >"$mandarin_script"
+	chmod +x -- "$mandarin_script"
+	time_mandarin "mandarin, native:              " false "$bin" mandarin
+	time_mandarin "mandarin, script:              " true "$mandarin_script"
+	time_mandarin "mandarin, script, cached input:" false "$mandarin_script"
+else
+	echo "mandarin: skipped, install the dictionary with ./quickinstall.sh --mandarin first"
+fi
+
+# A private runtime directory, so that the clients find this server and not one that's already running.
+runtime_dir=$(mktemp -d)
+XDG_RUNTIME_DIR=$runtime_dir "$bin" serve >/dev/null &
+server_pid=$!
+trap 'kill "$server_pid" 2>/dev/null; rm -rf -- "$requests" "$corpus" "$mandarin_script" "$runtime_dir"' EXIT
+for ((i = 0; i < 100; ++i)); do
+	[[ -S $runtime_dir/gd-tools/serve.sock ]] && break
+	sleep 0.1
+done
+if ! [[ -S $runtime_dir/gd-tools/serve.sock ]]; then
+	echo "gd-tools serve didn't start within 10 seconds" >&2
+	exit 1
+fi
+
+for no_server in 1 ""; do
+	label=$([[ -n $no_server ]] && echo "in-process" || echo "gd-tools serve")
+	start=$(date +%s%N)
+	for ((i = 0; i < n_requests; ++i)); do
+		sentence=${sentences[i % ${#sentences[@]}]}
+		GD_TOOLS_NO_SERVER=$no_server XDG_RUNTIME_DIR=$runtime_dir \
+			"$bin" "$cmd" --word "${sentence:0:2}" --sentence "$sentence" >/dev/null
+	done
+	end=$(date +%s%N)
+	echo "$cmd, $label: $(ms_per_lookup "$n_requests" "$start" "$end") ms/lookup"
+done
+
+if [[ ${QUICKBENCH_ANKI:-} == 1 ]]; then
+	# 10, 100 and 1000 hits, with and without batched requests and the card cache, and the collection reader.
+	xmake config --tests=y -m release >/dev/null
+	xmake build -w tests >/dev/null
+	tests_bin=$(find build -type f -name tests -path '*release*' | head -n 1)
+	"$tests_bin" "[!benchmark][ankisearch]" --benchmark-samples 20
+fi
@@ -0,0 +1,76 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "actions.h"
+#include "anki_search.h"
+#include "echo.h"
+#include "images.h"
+#include "mandarin.h"
+#include "marisa_split.h"
+#include "massif.h"
+#include "mecab_split.h"
+#include "precompiled.h"
+#include "prefetch.h"
+#include "translate.h"
+#include "util.h"
+
+auto run_action(
+  std::string_view const action,
+  std::span<std::string_view const> const args,
+  std::ostream& out,
+  std::ostream& err
+) -> bool
+{
+  // `gd-tools prefetch` may have looked the word up while the reader was on another one.
+  if (is_prefetchable(action)) {
+    if (auto const prefetched = find_prefetched(action, args)) {
+      out << *prefetched;
+      return true;
+    }
+  }
+  switch (djbx33a(action)) {
+  case "ankisearch"_h:
+    search_anki_cards(args, out, err);
+    return true;
+  case "echo"_h:
+    stroke_order(args, out);
+    return true;
+  case "massif"_h:
+    massif(args, out);
+    return true;
+  case "images"_h:
+    images(args, out);
+    return true;
+  case "translate"_h:
+    translate(args, out);
+    return true;
+  case "marisa"_h:
+    marisa_split(args, out);
+    return true;
+  case "marisa-warmup"_h:
+    marisa_warmup(args, out);
+    return true;
+  case "mecab"_h:
+    mecab_split(args, out);
+    return true;
+  case "mandarin"_h:
+    mandarin(args, out);
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "precompiled.h"
+
+// Run an action that prints its result, e.g. "marisa" or "ankisearch".
+// Diagnostics, such as the ones of `--stats yes`, go to `err`.
+// Returns false if there's no action with this name.
+auto run_action(
+  std::string_view action,
+  std::span<std::string_view const> args,
+  std::ostream& out = std::cout,
+  std::ostream& err = std::cerr
+) -> bool;
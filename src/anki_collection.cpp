@@ -0,0 +1,331 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "anki_collection.h"
+#include "precompiled.h"
+#include "util.h"
+
+namespace {
+constexpr int64_t min_schema_version{ 15 }; // Anki 2.1.28 moved decks, notetypes and fields to tables
+constexpr char field_separator{ '\x1f' }; // between the fields of a note and the levels of a deck name
+
+void check(sqlite3* const db, int const rc)
+{
+  if (rc == SQLITE_BUSY or rc == SQLITE_LOCKED) {
+    throw gd::collection_locked("The Anki collection is locked.");
+  }
+  raise_if(
+    rc != SQLITE_OK and rc != SQLITE_ROW and rc != SQLITE_DONE,
+    std::format("Error reading the Anki collection: {}.", sqlite3_errmsg(db))
+  );
+}
+
+class Statement
+{
+public:
+  Statement(sqlite3* const db, std::string_view const sql) : m_db(db)
+  {
+    check(m_db, sqlite3_prepare_v2(m_db, sql.data(), static_cast<int>(sql.size()), &m_stmt, nullptr));
+  }
+  ~Statement() { sqlite3_finalize(m_stmt); }
+
+  Statement(Statement const&) = delete;
+  auto operator=(Statement const&) -> Statement& = delete;
+
+  void bind(int const idx, std::string_view const text)
+  {
+    check(m_db, sqlite3_bind_text(m_stmt, idx, text.data(), static_cast<int>(text.size()), SQLITE_TRANSIENT));
+  }
+
+  // Returns false when there are no more rows.
+  auto step() -> bool
+  {
+    auto const rc = sqlite3_step(m_stmt);
+    check(m_db, rc);
+    return rc == SQLITE_ROW;
+  }
+
+  auto i64(int const col) const -> int64_t { return sqlite3_column_int64(m_stmt, col); }
+  auto u64(int const col) const -> uint64_t { return static_cast<uint64_t>(i64(col)); }
+
+  auto text(int const col) const -> std::string_view
+  {
+    // The pointer first, then the size of what it points to.
+    auto const* const data = sqlite3_column_text(m_stmt, col);
+    if (data == nullptr) {
+      return {};
+    }
+    return { reinterpret_cast<char const*>(data), static_cast<std::size_t>(sqlite3_column_bytes(m_stmt, col)) };
+  }
+
+private:
+  sqlite3* m_db;
+  sqlite3_stmt* m_stmt{ nullptr };
+};
+
+// Every query of a search sees the same state of the collection, even if Anki writes in between.
+class ReadTransaction
+{
+public:
+  explicit ReadTransaction(sqlite3* const db) : m_db(db)
+  {
+    check(m_db, sqlite3_exec(m_db, "BEGIN", nullptr, nullptr, nullptr));
+  }
+  ~ReadTransaction() { sqlite3_exec(m_db, "END", nullptr, nullptr, nullptr); }
+
+  ReadTransaction(ReadTransaction const&) = delete;
+  auto operator=(ReadTransaction const&) -> ReadTransaction& = delete;
+
+private:
+  sqlite3* m_db;
+};
+
+auto ascii_lower(char const ch) noexcept -> char
+{
+  return (ch >= 'A' and ch <= 'Z') ? static_cast<char>(ch - 'A' + 'a') : ch;
+}
+
+auto iequals(std::string_view const lhs, std::string_view const rhs) noexcept -> bool
+{
+  return std::ranges::equal(lhs, rhs, {}, ascii_lower, ascii_lower);
+}
+
+// Case-insensitive for ASCII, like LIKE, which Anki uses for searches without a field name.
+auto icontains(std::string_view const haystack, std::string_view const needle) noexcept -> bool
+{
+  return not std::ranges::search(haystack, needle, {}, ascii_lower, ascii_lower).empty();
+}
+
+// Anki declares the names of decks, notetypes and fields with this collation.
+// Comparisons of those columns fail without it. Anki folds all of Unicode, ASCII is enough here.
+auto compare_unicase(void*, int const lhs_size, void const* const lhs, int const rhs_size, void const* const rhs) -> int
+{
+  std::string_view const lhs_str{ static_cast<char const*>(lhs), static_cast<std::size_t>(lhs_size) };
+  std::string_view const rhs_str{ static_cast<char const*>(rhs), static_cast<std::size_t>(rhs_size) };
+  auto const result = std::lexicographical_compare_three_way(
+    lhs_str.begin(),
+    lhs_str.end(),
+    rhs_str.begin(),
+    rhs_str.end(),
+    [](char const a, char const b) { return ascii_lower(a) <=> ascii_lower(b); }
+  );
+  return (result < 0) ? -1 : (result > 0) ? 1 : 0;
+}
+
+auto escape_like(std::string_view const term) -> std::string
+{
+  std::string escaped{};
+  for (char const ch: term) {
+    if (ch == '%' or ch == '_' or ch == '\\') {
+      escaped.push_back('\\');
+    }
+    escaped.push_back(ch);
+  }
+  return escaped;
+}
+
+auto split_on(std::string_view const str, char const sep) -> std::vector<std::string_view>
+{
+  return str //
+         | std::views::split(sep)
+         | std::views::transform([](auto const part) { return std::string_view{ part.begin(), part.end() }; })
+         | std::ranges::to<std::vector>();
+}
+
+// Decks by id, with the levels of their names joined the way AnkiConnect shows them.
+auto read_deck_names(sqlite3* const db) -> std::unordered_map<uint64_t, std::string>
+{
+  std::unordered_map<uint64_t, std::string> decks{};
+  Statement query{ db, "SELECT id, name FROM decks" };
+  while (query.step()) {
+    decks.emplace(query.u64(0), join_with(split_on(query.text(1), field_separator), "::"));
+  }
+  return decks;
+}
+
+// Field names of every notetype, in the order of the fields of its notes.
+auto read_field_names(sqlite3* const db) -> std::unordered_map<uint64_t, std::vector<std::string>>
+{
+  std::unordered_map<uint64_t, std::vector<std::string>> notetypes{};
+  Statement query{ db, "SELECT ntid, ord, name FROM fields" };
+  while (query.step()) {
+    auto& names = notetypes[query.u64(0)];
+    auto const ord = query.u64(1);
+    if (names.size() <= ord) {
+      names.resize(ord + 1);
+    }
+    names[ord] = query.text(2);
+  }
+  return notetypes;
+}
+
+// Like "deck:NAME": the deck and the decks under it.
+auto matching_decks(std::unordered_map<uint64_t, std::string> const& decks, std::string_view const deck_name)
+  -> std::unordered_set<uint64_t>
+{
+  std::unordered_set<uint64_t> ids{};
+  for (auto const& [id, name]: decks) {
+    std::string_view const name_view{ name };
+    if (iequals(name_view.substr(0, deck_name.size()), deck_name)
+        and (name_view.size() == deck_name.size() or name_view.substr(deck_name.size()).starts_with("::"))) {
+      ids.insert(id);
+    }
+  }
+  return ids;
+}
+
+auto make_note(std::vector<std::string> const& field_names, std::string_view const tags, std::string_view const flds)
+  -> note_info
+{
+  note_info note{};
+  for (auto const tag: split_on(tags, ' ')) {
+    if (not tag.empty()) {
+      note.tags.emplace_back(tag);
+    }
+  }
+  auto const values = split_on(flds, field_separator);
+  for (std::size_t ord = 0; ord < field_names.size(); ++ord) {
+    note.fields.emplace(field_names[ord], (ord < values.size() ? values[ord] : std::string_view{}));
+  }
+  return note;
+}
+
+// Like "FIELD:*word*". Field names are case-insensitive too.
+auto field_contains(note_info const& note, std::string_view const field_name, std::string_view const word) -> bool
+{
+  return std::ranges::any_of(note.fields, [&](auto const& name_value) {
+    return iequals(name_value.first, field_name) and icontains(name_value.second, word);
+  });
+}
+} // namespace
+
+auto is_plain_search(CollectionSearch const& search) -> bool
+{
+  static constexpr std::string_view syntax_chars{ "*_\"():\\" };
+  auto const is_plain = [](std::string_view const text) {
+    return text.find_first_of(syntax_chars) == std::string_view::npos;
+  };
+  if (not is_plain(search.word) or not is_plain(search.field_name) or not is_plain(search.deck_name)) {
+    return false;
+  }
+  if (not search.field_name.empty()) {
+    return true; // gd-ankisearch quotes the word with the field name, so it's one term
+  }
+  // find_cards splits terms on ASCII spaces only, Anki on any whitespace, e.g. the ideographic space.
+  if (search.word.contains('\t') or search.word.contains('\n') or search.word.contains("　")) {
+    return false;
+  }
+  return std::ranges::none_of(split_on(search.word, ' '), [](std::string_view const term) {
+    return term.starts_with('-') or iequals(term, "or") or iequals(term, "and");
+  });
+}
+
+AnkiCollection::AnkiCollection(std::filesystem::path path) : m_path(std::move(path))
+{
+  // Read-only, without immutable=1, so that the write-ahead log of a running Anki is read too.
+  auto const rc = sqlite3_open_v2(m_path.c_str(), &m_db, SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr);
+  if (rc != SQLITE_OK) {
+    sqlite3_close(m_db);
+    throw gd::runtime_error(std::format(R"(Can't open the Anki collection "{}".)", m_path.string()));
+  }
+  // No busy timeout. Anki holds its lock for as long as the profile is open, so waiting only delays the fallback.
+  sqlite3_busy_timeout(m_db, 0);
+  sqlite3_create_collation_v2(m_db, "unicase", SQLITE_UTF8, nullptr, compare_unicase, nullptr);
+  try {
+    Statement query{ m_db, "SELECT ver FROM col" };
+    raise_if(not query.step() or query.i64(0) < min_schema_version, "Open the collection in a newer Anki once.");
+  } catch (gd::runtime_error const&) {
+    sqlite3_close(m_db);
+    throw;
+  }
+}
+
+AnkiCollection::~AnkiCollection()
+{
+  sqlite3_close(m_db);
+}
+
+auto AnkiCollection::find_cards(CollectionSearch const& search) const -> CollectionCards
+{
+  ReadTransaction const transaction{ m_db };
+  auto const decks = read_deck_names(m_db);
+  auto const field_names = read_field_names(m_db);
+  auto const deck_ids = (search.deck_name.empty() ? std::optional<std::unordered_set<uint64_t>>{}
+                                                  : matching_decks(decks, search.deck_name));
+
+  // Anki matches every word of the query in any field, or the whole query in the named field.
+  std::vector<std::string_view> terms{};
+  if (search.field_name.empty()) {
+    std::ranges::copy_if(split_on(search.word, ' '), std::back_inserter(terms), [](std::string_view const term) {
+      return not term.empty();
+    });
+  } else {
+    terms.push_back(search.word);
+  }
+  std::string sql{ "SELECT c.id, c.nid, c.did, c.odid, c.queue, c.type, n.mid, n.tags, n.flds "
+                   "FROM cards AS c JOIN notes AS n ON n.id = c.nid" };
+  for (std::size_t idx = 0; idx < terms.size(); ++idx) {
+    sql += (idx == 0 ? " WHERE " : " AND ");
+    sql += R"(n.flds LIKE ? ESCAPE '\')";
+  }
+  sql += " ORDER BY c.id";
+
+  Statement query{ m_db, sql };
+  for (std::size_t idx = 0; idx < terms.size(); ++idx) {
+    query.bind(static_cast<int>(idx + 1), std::format("%{}%", escape_like(terms[idx])));
+  }
+  CollectionCards found{};
+  std::unordered_set<uint64_t> rejected_nids{};
+  static std::vector<std::string> const no_fields{};
+  while (query.step()) {
+    auto const did = query.u64(2);
+    if (deck_ids.has_value() and not deck_ids->contains(did) and not deck_ids->contains(query.u64(3))) {
+      continue;
+    }
+    auto const nid = query.u64(1);
+    if (rejected_nids.contains(nid)) {
+      continue;
+    }
+    auto note = found.notes.find(nid);
+    if (note == found.notes.end()) {
+      auto const names = field_names.find(query.u64(6));
+      auto new_note = make_note((names != field_names.end() ? names->second : no_fields), query.text(7), query.text(8));
+      // LIKE found the word somewhere in the note, it has to be in the named field.
+      if (not search.field_name.empty() and not field_contains(new_note, search.field_name, search.word)) {
+        rejected_nids.insert(nid);
+        continue;
+      }
+      note = found.notes.emplace(nid, std::move(new_note)).first;
+    }
+    auto const deck = decks.find(did);
+    found.cards.push_back({
+      .id = query.u64(0),
+      .queue = query.i64(4),
+      .type = query.i64(5),
+      .deck_name = (deck != decks.end() ? deck->second : std::string{}),
+      .fields = note->second.fields,
+      .nid = nid,
+    });
+  }
+  return found;
+}
+
+auto AnkiCollection::media_dir_path() const -> std::string
+{
+  return std::filesystem::absolute(m_path).replace_extension(".media").string();
+}
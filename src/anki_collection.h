@@ -0,0 +1,55 @@
+#pragma once
+
+#include "anki_search.h"
+#include "precompiled.h"
+#include "util.h"
+
+namespace gd {
+// Another process keeps the collection to itself. Anki does while a profile is open.
+class collection_locked : public runtime_error
+{
+public:
+  using runtime_error::runtime_error;
+};
+} // namespace gd
+
+struct CollectionSearch
+{
+  std::string_view word;
+  std::string_view field_name; // empty to search every field
+  std::string_view deck_name; // empty to search every deck
+};
+
+// Whether AnkiCollection can answer the search as Anki would. Anki's search syntax, e.g. the wildcards `*` and `_`,
+// quotes, `tag:` and other prefixes, `-` to exclude a term or "or" between terms, is left to AnkiConnect.
+auto is_plain_search(CollectionSearch const& search) -> bool;
+
+struct CollectionCards
+{
+  std::vector<card_info> cards; // by card id, like findCards
+  std::unordered_map<uint64_t, note_info> notes;
+};
+
+// The collection.anki2 file of an Anki profile, opened read-only.
+// Reads never block Anki, and see the changes Anki keeps in the write-ahead log.
+// A locked collection throws gd::collection_locked at once, without waiting for Anki to let go of it.
+// Needs the schema of Anki 2.1.28 or newer, with decks, notetypes and fields in their own tables.
+class AnkiCollection
+{
+public:
+  explicit AnkiCollection(std::filesystem::path path);
+  ~AnkiCollection();
+
+  AnkiCollection(AnkiCollection const&) = delete;
+  auto operator=(AnkiCollection const&) -> AnkiCollection& = delete;
+
+  // The cards that AnkiConnect's findCards and cardsInfo would give for the query gd-ankisearch makes.
+  // The word is matched literally, so only plain searches give the same cards, see is_plain_search().
+  auto find_cards(CollectionSearch const& search) const -> CollectionCards;
+  // The collection.media folder next to the collection, like getMediaDirPath answers.
+  auto media_dir_path() const -> std::string;
+
+private:
+  std::filesystem::path m_path;
+  sqlite3* m_db{ nullptr };
+};
@@ -16,7 +16,10 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "anki_collection.h"
 #include "anki_search.h"
+#include "ankiconnect.h"
+#include "card_cache.h"
 #include "precompiled.h"
 #include "util.h"
 
@@ -27,9 +30,8 @@
 using namespace std::string_view_literals;
 using json = nlohmann::json;
 
-static constexpr auto ankiconnect_addr{ "127.0.0.1:8765"sv };
-static constexpr std::chrono::seconds timeout{ 3U };
 static constexpr std::size_t expected_n_fields{ 10 };
+static constexpr std::size_t default_max_requests{ 4 };
 static constexpr std::string_view help_text = R"EOF(usage: gd-ankisearch [OPTIONS]
 
 Search your Anki collection and output Note Ids that match query.
@@ -39,6 +41,17 @@ OPTIONS
   --deck-name NAME     optional deck to limit search to.
   --show-fields F1,F2  optional comma-separated list of fields to show.
   --word WORD          required search term
+  --collection PATH    optional. Read collection.anki2 of an Anki profile instead of asking AnkiConnect.
+                       Only helps while Anki is closed: if Anki has the collection open, AnkiConnect is asked.
+                       So are words with Anki's search syntax, e.g. wildcards.
+  --ankiconnect ADDR   optional address of AnkiConnect (default 127.0.0.1:8765).
+  --chunk-size N       optional. Ask for the details of N cards per request (default all in one request).
+  --max-requests N     optional. Number of chunks to ask for at once (default 4).
+  --connect-timeout MS optional. Give up if AnkiConnect doesn't accept the connection in time (default 1000).
+  --timeout MS         optional. Give up on a request after this time (default 3000).
+  --cache yes          optional. Keep the details of found cards between lookups, and download only modified ones.
+  --stats yes          optional. Print the latency of every request to stderr, whether it reused a connection,
+                       and how many cards came from the cache.
 
 EXAMPLES
 gd-ankisearch --field-name VocabKanji --word %GDWORD%
@@ -107,18 +120,6 @@ static constexpr std::string_view css_style = R"EOF(<style>
 </style>
 )EOF";
 
-using NameToValMap = std::unordered_map<std::string, std::string>;
-
-struct card_info
-{
-  uint64_t id;
-  int64_t queue;
-  int64_t type;
-  std::string deck_name;
-  NameToValMap fields;
-  uint64_t nid;
-};
-
 auto split_anki_field_names(std::string_view const show_fields) -> std::vector<std::string>
 {
   // Expects a list of Anki fields separated by commas.
@@ -133,12 +134,28 @@ auto split_anki_field_names(std::string_view const show_fields) -> std::vector<s
   return parsed;
 }
 
+// A timeout of zero means no timeout to curl, and a negative one is an error, so both keep the default.
+auto parse_milliseconds(std::string_view const value) -> std::optional<std::chrono::milliseconds>
+{
+  auto const ms = parse_number<int64_t>(value);
+  if (not ms.has_value() or *ms <= 0) {
+    return std::nullopt;
+  }
+  return std::chrono::milliseconds{ *ms };
+}
+
 struct search_params
 {
   std::string_view gd_word{};
   std::string_view field_name{};
   std::string_view deck_name{};
   std::vector<std::string> show_fields{};
+  std::string_view collection{};
+  AnkiConnectOptions ankiconnect{};
+  std::size_t chunk_size{ 0 }; // all cards in one cardsInfo request
+  std::size_t max_requests{ default_max_requests };
+  bool cache{ false };
+  bool stats{ false };
 
   void assign(std::string_view const key, std::string_view const value)
   {
@@ -150,6 +167,22 @@ struct search_params
       show_fields = split_anki_field_names(value);
     } else if (key == "--word") {
       gd_word = value;
+    } else if (key == "--collection") {
+      collection = value;
+    } else if (key == "--ankiconnect") {
+      ankiconnect.address = value;
+    } else if (key == "--connect-timeout") {
+      ankiconnect.connect_timeout = parse_milliseconds(value).value_or(ankiconnect.connect_timeout);
+    } else if (key == "--timeout") {
+      ankiconnect.timeout = parse_milliseconds(value).value_or(ankiconnect.timeout);
+    } else if (key == "--cache") {
+      cache = (value == "yes");
+    } else if (key == "--stats") {
+      stats = (value == "yes");
+    } else if (key == "--chunk-size") {
+      chunk_size = parse_count(value, chunk_size);
+    } else if (key == "--max-requests") {
+      max_requests = parse_count(value, max_requests);
     }
   }
 };
@@ -186,17 +219,7 @@ auto make_get_media_dir_path_request_str() -> std::string
   })EOF";
 }
 
-auto make_ankiconnect_request(std::string_view const request_str) -> cpr::Response
-{
-  return cpr::Post(
-    cpr::Url{ ankiconnect_addr },
-    cpr::Body{ request_str },
-    cpr::Header{ { "Content-Type", "application/json" } },
-    cpr::Timeout{ timeout }
-  );
-}
-
-auto make_info_request_str(std::vector<uint64_t> const& cids) -> std::string
+auto make_info_request_str(std::span<uint64_t const> const cids) -> std::string
 {
   auto request = json::parse(R"EOF({
     "action": "cardsInfo",
@@ -205,76 +228,130 @@ auto make_info_request_str(std::vector<uint64_t> const& cids) -> std::string
         "cards": []
     }
   })EOF");
-  request["params"]["cards"] = cids;
+  request["params"]["cards"] = std::vector<uint64_t>(cids.begin(), cids.end());
   return request.dump();
 }
 
-auto get_cids_info(std::vector<uint64_t> const& cids) -> nlohmann::json
+auto get_cids_info(AnkiConnectOptions const& anki, std::span<uint64_t const> const cids) -> nlohmann::json
+{
+  return ankiconnect_call(anki, "cardsInfo", make_info_request_str(cids));
+}
+
+auto find_cids(AnkiConnectOptions const& anki, search_params const& params) -> std::vector<uint64_t>
 {
-  auto const request_str = make_info_request_str(cids);
-  cpr::Response const r = make_ankiconnect_request(request_str);
-  raise_if(r.status_code != cpr::status::HTTP_OK, "Couldn't connect to Anki.");
-  auto const obj = json::parse(r.text);
-  raise_if(not obj["error"].is_null(), "Error getting data from AnkiConnect.");
-  return obj["result"];
+  return ankiconnect_call(anki, "findCards", make_find_cards_request_str(params));
 }
 
-auto find_cids(search_params const& params) -> std::vector<uint64_t>
+auto fetch_media_dir_path(AnkiConnectOptions const& anki) -> std::string
 {
-  auto const request_str = make_find_cards_request_str(params);
-  cpr::Response const r = make_ankiconnect_request(request_str);
-  raise_if(r.status_code != cpr::status::HTTP_OK, "Couldn't connect to Anki.");
-  auto const obj = json::parse(r.text);
-  raise_if(not obj["error"].is_null(), "Error getting data from AnkiConnect.");
-  return obj["result"];
+  return ankiconnect_call(anki, "getMediaDirPath", make_get_media_dir_path_request_str());
 }
 
-auto fetch_media_dir_path() -> std::string
+// An action that takes a list of ids, e.g. {"action": "cardsModTime", "params": {"cards": [...]}}.
+auto make_ids_action(std::string_view const action, std::string_view const ids_key, std::span<uint64_t const> const ids)
+  -> json
 {
-  auto const request_str = make_get_media_dir_path_request_str();
-  cpr::Response const r = make_ankiconnect_request(request_str);
-  raise_if(r.status_code != cpr::status::HTTP_OK, "Couldn't connect to Anki.");
-  auto const obj = json::parse(r.text);
-  raise_if(not obj["error"].is_null(), "Error getting data from AnkiConnect.");
-  return obj["result"];
+  json request{ { "action", action }, { "version", 6 } };
+  request["params"][ids_key] = std::vector<uint64_t>(ids.begin(), ids.end());
+  return request;
+}
+
+// Several actions in one request, answered in order. Each answer has a "result" and an "error" of its own.
+auto ankiconnect_multi(AnkiConnectOptions const& anki, std::vector<json> actions) -> std::vector<json>
+{
+  auto const n_actions = actions.size();
+  json request{ { "action", "multi" }, { "version", 6 } };
+  request["params"]["actions"] = std::move(actions);
+  std::vector<json> results{};
+  for (auto& answer: ankiconnect_call(anki, "multi", request.dump())) {
+    raise_if(
+      not answer.is_object() or not answer.value("error", json{}).is_null(),
+      "Error getting data from AnkiConnect."
+    );
+    results.push_back(std::move(answer["result"]));
+  }
+  raise_if(results.size() != n_actions, "Error getting data from AnkiConnect.");
+  return results;
+}
+
+// cardsModTime and notesModTime answer {"cardId": ..., "mod": ...} for each id.
+auto mod_times_of(json const& result, std::string_view const id_key) -> std::unordered_map<uint64_t, int64_t>
+{
+  std::unordered_map<uint64_t, int64_t> mods{};
+  for (auto const& element: result) { mods.emplace(element[id_key].get<uint64_t>(), element["mod"].get<int64_t>()); }
+  return mods;
+}
+
+// getDecks answers {"deckName": [cardId, ...], ...} for the given cards.
+auto deck_names_of(json const& result) -> std::unordered_map<uint64_t, std::string>
+{
+  std::unordered_map<uint64_t, std::string> decks{};
+  for (auto const& [deck_name, deck_cids]: result.items()) {
+    for (auto const& cid: deck_cids) { decks.emplace(cid.get<uint64_t>(), deck_name); }
+  }
+  return decks;
 }
 
-auto make_get_note_tags_request_str(uint64_t const nid) -> std::string
+auto make_notes_info_request_str(std::vector<uint64_t> const& nids) -> std::string
 {
   auto request = json::parse(R"EOF({
-    "action": "getNoteTags",
+    "action": "notesInfo",
     "version": 6,
     "params": {
-        "note": 1483959289817
+        "notes": []
     }
   })EOF");
-  request["params"]["note"] = nid;
+  request["params"]["notes"] = nids;
   return request.dump();
 }
 
-auto get_note_tags(uint64_t const nid) -> std::string
+auto fields_json_to_map(nlohmann::json const& fields_json) -> NameToValMap
+{
+  NameToValMap result{};
+  for (auto const& element: fields_json.items()) { result.emplace(element.key(), element.value()["value"]); }
+  return result;
+}
+
+// One request for all notes, instead of a getNoteTags request per card.
+// Notes go to the cache if there's one and AnkiConnect says when they were modified.
+auto fetch_notes_info(AnkiConnectOptions const& anki, std::vector<uint64_t> const& nids, CardCache* const cache)
+  -> std::unordered_map<uint64_t, note_info>
+{
+  std::unordered_map<uint64_t, note_info> notes{};
+  for (auto const& note_json: ankiconnect_call(anki, "notesInfo", make_notes_info_request_str(nids))) {
+    // A note deleted since findCards comes back as an empty object.
+    if (not note_json.contains("noteId")) {
+      continue;
+    }
+    auto const nid = note_json["noteId"].get<uint64_t>();
+    auto& note = notes[nid];
+    note.tags = note_json["tags"].get<std::vector<std::string>>();
+    note.fields = fields_json_to_map(note_json.value("fields", json::object()));
+    if (cache != nullptr and note_json.contains("mod") and note_json.contains("fields")) {
+      cache->store_note(nid, note, note_json["mod"].get<int64_t>(), note_json.dump().size());
+    }
+  }
+  return notes;
+}
+
+auto format_tags(std::span<std::string const> const tags) -> std::string
 {
-  auto const request_str = make_get_note_tags_request_str(nid);
-  cpr::Response const r = make_ankiconnect_request(request_str);
-  raise_if(r.status_code != cpr::status::HTTP_OK, "Couldn't connect to Anki.");
-  auto const obj = json::parse(r.text);
-  raise_if(not obj["error"].is_null(), "Error getting data from AnkiConnect.");
   std::string html;
-  for (std::string const tag_name: obj["result"]) {
+  for (auto const& tag_name: tags) {
     html += std::format(R"EOF(<a class="gd-tag-link" href="ankisearch:tag:{}">{}</a>)EOF", tag_name, tag_name);
   }
   return html;
 }
 
-void print_table_header(search_params const& params)
+void print_table_header(search_params const& params, std::ostream& out)
 {
   // Print the first row (header) that contains <th></th> tags, starting with Card ID.
-  std::print("<tr>");
-  std::print("<th>Card ID</th>");
-  std::print("<th>Deck name</th>");
-  for (auto const& field: params.show_fields) { std::print("<th>{}</th>", field); }
-  std::print("<th>Tags</th>");
-  std::println("</tr>");
+  std::print(out, "<tr>");
+  std::print(out, "<th>Card ID</th>");
+  std::print(out, "<th>Deck name</th>");
+  for (auto const& field: params.show_fields) { std::print(out, "<th>{}</th>", field); }
+  std::print(out, "<th>Tags</th>");
+  std::println(out, "</tr>");
 }
 
 auto card_json_to_obj(nlohmann::json const& card_json) -> card_info
@@ -284,19 +361,86 @@ auto card_json_to_obj(nlohmann::json const& card_json) -> card_info
     .id = card_json["cardId"],
     .queue = card_json["queue"],
     .type = card_json["type"],
-    .deck_name = card_json["deckName"], //
-    .fields =
-      [&card_json]() {
-        NameToValMap result{};
-        for (auto const& element: card_json["fields"].items()) {
-          result.emplace(element.key(), element.value()["value"]);
-        }
-        return result;
-      }(),
+    .deck_name = card_json["deckName"],
+    .fields = fields_json_to_map(card_json["fields"]),
     .nid = card_json["note"] //
   };
 }
 
+struct FetchedCards
+{
+  std::vector<card_info> cards; // in the order of the cids
+  std::unordered_map<uint64_t, note_info> notes;
+};
+
+// Details of the cards, then of their notes in one request.
+// With `params.chunk_size` set, cardsInfo asks for that many cards at a time, up to `params.max_requests` at once.
+// Notes in `claimed_nids` are not asked for. Cards and notes go to the cache if there's one.
+auto fetch_cards(
+  AnkiConnectOptions const& anki,
+  search_params const& params,
+  std::span<uint64_t const> const cids,
+  CardCache* const cache,
+  std::unordered_set<uint64_t> claimed_nids // cards of the same note share it
+) -> FetchedCards
+{
+  auto const chunk_size = (params.chunk_size > 0 ? params.chunk_size : std::max<std::size_t>(1, cids.size()));
+  auto const n_chunks = (cids.size() + chunk_size - 1) / chunk_size;
+  std::vector<std::vector<card_info>> chunks(n_chunks);
+  std::mutex mutex{};
+  std::exception_ptr error{};
+  std::atomic_size_t next_chunk{ 0 };
+
+  auto const fetch_chunks = [&] {
+    for (auto idx = next_chunk++; idx < n_chunks; idx = next_chunk++) {
+      try {
+        auto const begin = idx * chunk_size;
+        auto const chunk_cids = cids.subspan(begin, std::min(chunk_size, cids.size() - begin));
+        for (auto const& card_json: get_cids_info(anki, chunk_cids)) {
+          // A card deleted since findCards comes back as an empty object.
+          if (not card_json.contains("cardId")) {
+            continue;
+          }
+          auto const& card = chunks[idx].emplace_back(card_json_to_obj(card_json));
+          if (cache != nullptr and card_json.contains("mod")) {
+            cache->store_card(card, card_json["mod"].get<int64_t>(), card_json.dump().size());
+          }
+        }
+      } catch (...) {
+        std::scoped_lock const lock{ mutex };
+        if (not error) {
+          error = std::current_exception();
+        }
+      }
+    }
+  };
+  {
+    std::vector<std::jthread> workers{};
+    for (std::size_t idx = 1; idx < std::min(params.max_requests, n_chunks); ++idx) {
+      workers.emplace_back(fetch_chunks);
+    }
+    fetch_chunks(); // this thread is one of them
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  FetchedCards fetched{};
+  fetched.cards.reserve(cids.size());
+  std::vector<uint64_t> nids{};
+  for (auto& chunk: chunks) {
+    for (auto& card: chunk) {
+      if (claimed_nids.insert(card.nid).second) {
+        nids.push_back(card.nid);
+      }
+      fetched.cards.push_back(std::move(card));
+    }
+  }
+  if (not nids.empty()) {
+    fetched.notes = fetch_notes_info(anki, nids, cache);
+  }
+  return fetched;
+}
+
 auto gd_format(std::string const& field_content, std::string const& media_dir_path) -> std::string
 {
   // Make sure GoldenDict displays images correctly by specifying the full path.
@@ -307,43 +451,219 @@ auto gd_format(std::string const& field_content, std::string const& media_dir_pa
   return link_content.empty() ? link_text : std::format("<a href=\"ankisearch:{}\">{}</a>", link_content, link_text);
 }
 
-void print_cards_info(search_params const& params)
+struct CachedCards
 {
-  auto const cids = find_cids(params);
-  if (cids.empty()) {
-    return std::println("No cards found.");
+  std::unordered_map<uint64_t, card_info> cards{};
+  std::unordered_map<uint64_t, note_info> notes{};
+};
+
+// Cards and notes of the cache that haven't been modified since they were stored.
+// One multi request tells that: the modification times of the cached cards and of their notes, and their decks.
+auto find_cached_cards(AnkiConnectOptions const& anki, CardCache& cache, std::span<uint64_t const> const cids)
+  -> CachedCards
+{
+  std::vector<uint64_t> cached_cids{};
+  std::unordered_set<uint64_t> nids{};
+  for (auto const cid: cids) {
+    if (auto const nid = cache.note_of(cid)) {
+      cached_cids.push_back(cid);
+      nids.insert(*nid);
+    }
+  }
+  std::unordered_map<uint64_t, int64_t> card_mods{};
+  std::unordered_map<uint64_t, int64_t> note_mods{};
+  std::unordered_map<uint64_t, std::string> decks{};
+  if (not cached_cids.empty()) {
+    try {
+      auto const results = ankiconnect_multi(
+        anki,
+        {
+          make_ids_action("cardsModTime", "cards", cached_cids),
+          make_ids_action("notesModTime", "notes", nids | std::ranges::to<std::vector>()),
+          // Renaming a deck doesn't change the modification time of its cards, so deck names are asked every time.
+          make_ids_action("getDecks", "cards", cached_cids),
+        }
+      );
+      card_mods = mod_times_of(results[0], "cardId");
+      note_mods = mod_times_of(results[1], "noteId");
+      decks = deck_names_of(results[2]);
+    } catch (gd::runtime_error const&) {
+      // AnkiConnect older than these actions. Everything is fetched as if there was no cache.
+    }
+  }
+  CachedCards found{};
+  for (auto const& [nid, mod]: note_mods) {
+    if (auto note = cache.find_note(nid, mod)) {
+      found.notes.emplace(nid, std::move(*note));
+    }
+  }
+  auto const mod_of = [](std::unordered_map<uint64_t, int64_t> const& mods, std::optional<uint64_t> const id) {
+    static constexpr int64_t unknown_mod{ -1 }; // never stored, so it's a miss
+    auto const it = (id.has_value() ? mods.find(*id) : mods.end());
+    return (it != mods.end() ? it->second : unknown_mod);
+  };
+  for (auto const cid: cids) {
+    auto card = cache.find(cid, mod_of(card_mods, cid), mod_of(note_mods, cache.note_of(cid)));
+    // A card deleted since findCards has no deck. cardsInfo will tell.
+    if (auto const deck = decks.find(cid); card.has_value() and deck != decks.end()) {
+      card->deck_name = deck->second;
+      found.cards.emplace(cid, std::move(*card));
+    }
   }
-  auto const media_dir_path = fetch_media_dir_path();
-  std::print("<div class=\"gd-table-wrap\">");
-  std::println("<table class=\"gd-ankisearch-table\">");
-  print_table_header(params);
-  for (auto const& card: get_cids_info(cids) | std::views::transform(card_json_to_obj)) {
-    std::print("<tr class=\"{}\">", determine_card_class(card.queue, card.type));
-    std::print("<td><a href=\"ankisearch:cid:{}\">{}</a></td>", card.id, card.id);
-    std::print("<td>{}</td>", card.deck_name);
+  return found;
+}
+
+// The same table whether the cards came from AnkiConnect or from the collection file.
+void print_table(
+  search_params const& params,
+  std::span<card_info const> const cards,
+  std::unordered_map<uint64_t, note_info> const& notes,
+  std::string const& media_dir_path,
+  std::ostream& out
+)
+{
+  std::print(out, "<div class=\"gd-table-wrap\">");
+  std::println(out, "<table class=\"gd-ankisearch-table\">");
+  print_table_header(params, out);
+  for (auto const& card: cards) {
+    std::print(out, "<tr class=\"{}\">", determine_card_class(card.queue, card.type));
+    std::print(out, "<td><a href=\"ankisearch:cid:{}\">{}</a></td>", card.id, card.id);
+    std::print(out, "<td>{}</td>", card.deck_name);
     for (auto const& field_name: params.show_fields) {
       std::print(
+        out,
         "<td>{}</td>",
         (card.fields.contains(field_name) and not card.fields.at(field_name).empty()
            ? gd_format(card.fields.at(field_name), media_dir_path)
            : "Not present")
       );
     }
-    std::println("<td>{}</td>", get_note_tags(card.nid));
-    std::println("</tr>");
+    auto const note = notes.find(card.nid);
+    std::println(out, "<td>{}</td>", (note != notes.end() ? format_tags(note->second.tags) : ""));
+    std::println(out, "</tr>");
+  }
+  std::print(out, "</table>");
+  std::println(out, "</div>"); // gd-table-wrap
+  std::println(out, "{}", css_style);
+}
+
+void print_cards_table(
+  AnkiConnectOptions const& anki,
+  search_params const& params,
+  CardCache* const cache,
+  std::ostream& out
+)
+{
+  // The media directory doesn't depend on the search, so it's asked for at the same time.
+  auto media_dir_path_future = std::async(std::launch::async, [&anki] { return fetch_media_dir_path(anki); });
+  auto const cids = find_cids(anki, params);
+  if (cids.empty()) {
+    return std::println(out, "No cards found.");
+  }
+  auto cached = (cache != nullptr ? find_cached_cards(anki, *cache, cids) : CachedCards{});
+  auto const missing_cids = cids //
+                            | std::views::filter([&cached](uint64_t const cid) {
+                                return not cached.cards.contains(cid);
+                              })
+                            | std::ranges::to<std::vector>();
+  auto fetched = fetch_cards(
+    anki,
+    params,
+    missing_cids,
+    cache,
+    cached.notes | std::views::keys | std::ranges::to<std::unordered_set>()
+  );
+  auto const media_dir_path = media_dir_path_future.get();
+  auto& notes = cached.notes;
+  auto& cards = cached.cards;
+  notes.merge(fetched.notes);
+  for (auto& card: fetched.cards) { cards.emplace(card.id, std::move(card)); }
+  // In the order of findCards, whether the card came from the cache or not.
+  std::vector<card_info> rows{};
+  rows.reserve(cids.size());
+  for (auto const cid: cids) {
+    // A card deleted since findCards has no details.
+    if (auto const found = cards.find(cid); found != cards.end()) {
+      rows.push_back(std::move(found->second));
+    }
+  }
+  print_table(params, rows, notes, media_dir_path, out);
+}
+
+auto collection_search(search_params const& params) -> CollectionSearch
+{
+  return { .word = params.gd_word, .field_name = params.field_name, .deck_name = params.deck_name };
+}
+
+// Without Anki's event loop in between, and without Anki running at all.
+void print_collection_table(search_params const& params, std::ostream& out)
+{
+  AnkiCollection const collection{ std::filesystem::path{ params.collection } };
+  auto const found = collection.find_cards(collection_search(params));
+  if (found.cards.empty()) {
+    return std::println(out, "No cards found.");
+  }
+  print_table(params, found.cards, found.notes, collection.media_dir_path(), out);
+}
+
+void print_cache_stats(CardCacheStats const& stats, std::ostream& out)
+{
+  auto const cards = stats.card_hits + stats.card_misses;
+  std::println(
+    out,
+    "Card cache: {} of {} cards ({:.0f}%) and {} notes from the cache, {:.1f} KiB not downloaded.",
+    stats.card_hits,
+    cards,
+    (cards > 0 ? 100.0 * static_cast<double>(stats.card_hits) / static_cast<double>(cards) : 0.0),
+    stats.note_hits,
+    static_cast<double>(stats.bytes_saved) / 1024.0
+  );
+}
+
+void print_cards_info(search_params const& params, std::ostream& out, std::ostream& err)
+{
+  // Searches with Anki's syntax, e.g. wildcards, are only answered the way Anki would by AnkiConnect.
+  if (not params.collection.empty() and is_plain_search(collection_search(params))) {
+    try {
+      return print_collection_table(params, out);
+    } catch (gd::collection_locked const&) {
+      // Anki keeps the collection of the open profile to itself, but then AnkiConnect can answer.
+    }
+  }
+  AnkiConnectLog log{};
+  auto anki = params.ankiconnect;
+  anki.log = (params.stats ? &log : nullptr);
+  std::optional<CardCache> cache{};
+  if (params.cache) {
+    cache.emplace(card_cache_path());
+  }
+  auto* const cache_ptr = (cache.has_value() ? &*cache : nullptr);
+  try {
+    print_cards_table(anki, params, cache_ptr, out);
+  } catch (gd::runtime_error const&) {
+    if (params.stats) {
+      log.print(err); // the failed request is there too
+    }
+    throw;
+  }
+  if (cache.has_value()) {
+    cache->save();
+  }
+  if (params.stats) {
+    log.print(err);
+    if (cache.has_value()) {
+      print_cache_stats(cache->stats(), err);
+    }
   }
-  std::print("</table>");
-  std::println("</div>"); // gd-table-wrap
-  std::println("{}", css_style);
 }
 
-void search_anki_cards(std::span<std::string_view const> const args)
+void search_anki_cards(std::span<std::string_view const> const args, std::ostream& out, std::ostream& err)
 {
   try {
-    print_cards_info(fill_args<search_params>(args));
+    print_cards_info(fill_args<search_params>(args), out, err);
   } catch (gd::help_requested const& ex) {
-    std::print(help_text);
+    std::print(out, help_text);
   } catch (gd::runtime_error const& ex) {
-    std::println("{}", ex.what());
+    std::println(out, "{}", ex.what());
   }
 }
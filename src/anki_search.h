@@ -2,4 +2,27 @@
 
 #include "precompiled.h"
 
-auto search_anki_cards(std::span<std::string_view const> const args) -> void;
+using NameToValMap = std::unordered_map<std::string, std::string>;
+
+struct card_info
+{
+  uint64_t id;
+  int64_t queue;
+  int64_t type;
+  std::string deck_name;
+  NameToValMap fields; // of its note
+  uint64_t nid;
+};
+
+struct note_info
+{
+  std::vector<std::string> tags;
+  NameToValMap fields;
+};
+
+// `--stats yes` prints to `err`.
+auto search_anki_cards(
+  std::span<std::string_view const> const args,
+  std::ostream& out = std::cout,
+  std::ostream& err = std::cerr
+) -> void;
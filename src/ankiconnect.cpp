@@ -0,0 +1,147 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "ankiconnect.h"
+#include "precompiled.h"
+#include "util.h"
+
+namespace {
+// More than the requests one lookup has in flight, fewer than would matter if a burst of lookups leaves them idle.
+constexpr std::size_t max_idle_sessions{ 16 };
+
+class SessionPool
+{
+public:
+  auto acquire() -> std::unique_ptr<cpr::Session>
+  {
+    std::scoped_lock const lock{ m_mutex };
+    if (m_idle.empty()) {
+      auto session = std::make_unique<cpr::Session>();
+      session->SetHeader(cpr::Header{ { "Content-Type", "application/json" } });
+      return session;
+    }
+    auto session = std::move(m_idle.back());
+    m_idle.pop_back();
+    return session;
+  }
+
+  void release(std::unique_ptr<cpr::Session> session)
+  {
+    std::scoped_lock const lock{ m_mutex };
+    if (m_idle.size() < max_idle_sessions) {
+      m_idle.push_back(std::move(session));
+    }
+  }
+
+private:
+  std::mutex m_mutex{};
+  std::vector<std::unique_ptr<cpr::Session>> m_idle{};
+};
+
+auto session_pool() -> SessionPool&
+{
+  static SessionPool pool{};
+  return pool;
+}
+
+// Returns the session to the pool when the request is done, also if it failed.
+class SessionLease
+{
+public:
+  SessionLease() : m_session(session_pool().acquire()) {}
+  ~SessionLease() { session_pool().release(std::move(m_session)); }
+
+  SessionLease(SessionLease const&) = delete;
+  auto operator=(SessionLease const&) -> SessionLease& = delete;
+
+  auto operator->() const -> cpr::Session* { return m_session.get(); }
+
+private:
+  std::unique_ptr<cpr::Session> m_session;
+};
+} // namespace
+
+void AnkiConnectLog::add(AnkiConnectRequest entry)
+{
+  std::scoped_lock const lock{ m_mutex };
+  m_entries.push_back(std::move(entry));
+}
+
+auto AnkiConnectLog::entries() const -> std::vector<AnkiConnectRequest>
+{
+  std::scoped_lock const lock{ m_mutex };
+  return m_entries;
+}
+
+void AnkiConnectLog::print(std::ostream& out) const
+{
+  using ms = std::chrono::duration<double, std::milli>;
+  std::size_t n_new = 0;
+  std::chrono::microseconds slowest{};
+  auto const requests = entries();
+  for (auto const& [action, latency, new_connection]: requests) {
+    std::println(
+      out,
+      "AnkiConnect {}: {:.2f} ms, {} connection.",
+      action,
+      ms{ latency }.count(),
+      (new_connection ? "new" : "reused")
+    );
+    if (new_connection) {
+      ++n_new;
+    }
+    slowest = std::max(slowest, latency);
+  }
+  std::println(
+    out,
+    "AnkiConnect: {} requests, {} new connections, {} reused, slowest {:.2f} ms.",
+    requests.size(),
+    n_new,
+    requests.size() - n_new,
+    ms{ slowest }.count()
+  );
+}
+
+auto ankiconnect_call(
+  AnkiConnectOptions const& options,
+  std::string_view const action,
+  std::string request_str
+) -> nlohmann::json
+{
+  SessionLease const session{};
+  session->SetUrl(cpr::Url{ options.address });
+  session->SetBody(cpr::Body{ std::move(request_str) });
+  session->SetConnectTimeout(cpr::ConnectTimeout{ options.connect_timeout });
+  session->SetTimeout(cpr::Timeout{ options.timeout });
+  auto const start = std::chrono::steady_clock::now();
+  cpr::Response const r = session->Post();
+  if (options.log != nullptr) {
+    // Connections curl had to open for this request. Zero means it reused one that was open.
+    long n_connects = 0;
+    curl_easy_getinfo(session->GetCurlHolder()->handle, CURLINFO_NUM_CONNECTS, &n_connects);
+    options.log->add({
+      .action = std::string{ action },
+      .latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start),
+      .new_connection = (n_connects > 0),
+    });
+  }
+  raise_if(r.status_code != cpr::status::HTTP_OK, "Couldn't connect to Anki.");
+  auto obj = nlohmann::json::parse(r.text);
+  raise_if(not obj["error"].is_null(), "Error getting data from AnkiConnect.");
+  return std::move(obj["result"]);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "precompiled.h"
+
+struct AnkiConnectRequest
+{
+  std::string action;
+  std::chrono::microseconds latency;
+  bool new_connection; // false if the connection of an earlier request was reused
+};
+
+// The requests of one lookup, for --stats. Safe to add to from several threads.
+class AnkiConnectLog
+{
+public:
+  void add(AnkiConnectRequest entry);
+  auto entries() const -> std::vector<AnkiConnectRequest>;
+  // A line per request and a summary.
+  void print(std::ostream& out) const;
+
+private:
+  mutable std::mutex m_mutex{};
+  std::vector<AnkiConnectRequest> m_entries{};
+};
+
+struct AnkiConnectOptions
+{
+  std::string_view address{ "127.0.0.1:8765" };
+  std::chrono::milliseconds connect_timeout{ 1000 };
+  std::chrono::milliseconds timeout{ 3000 }; // for the whole request
+  AnkiConnectLog* log{ nullptr };
+};
+
+// POST a request to AnkiConnect and return the "result" of its answer.
+// Sessions come from a pool shared by the threads of the process, so connections stay open between requests,
+// and between lookups in `gd-tools serve`. The request is moved into the session instead of copied.
+auto ankiconnect_call(AnkiConnectOptions const& options, std::string_view action, std::string request_str)
+  -> nlohmann::json;
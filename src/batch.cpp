@@ -0,0 +1,148 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "batch.h"
+#include "actions.h"
+#include "precompiled.h"
+#include "util.h"
+
+using json = nlohmann::json;
+
+static constexpr std::string_view help_text = R"EOF(usage: gd-tools batch [OPTIONS]
+
+Read requests from stdin, one JSON object per line, and print one JSON object per line with the result.
+Dictionaries, MeCab taggers and HTTP connections are loaded once and reused by all requests.
+
+Each request names an action in "cmd", and the rest of its keys are passed to the action as options.
+Strings and numbers are passed as is, true and false become yes and no, arrays repeat the option.
+"id" is optional and copied to the response.
+
+  {"id": 1, "cmd": "marisa", "word": "食べる", "sentence": "ケーキを食べた"}
+  {"id": 1, "output": "<div class=\"gd-marisa\">..."}
+
+OPTIONS
+  --stats yes|no  optional. Print throughput to stderr when the input ends.
+
+EXAMPLES
+gd-tools batch < requests.jsonl > responses.jsonl
+)EOF";
+
+struct batch_params
+{
+  bool stats{ false };
+
+  auto assign(std::string_view const key, std::string_view const value) -> void
+  {
+    if (key == "--stats") {
+      stats = (value == "yes");
+    } else {
+      throw gd::runtime_error(std::format("Unknown argument name: {}", key));
+    }
+  }
+};
+
+auto json_to_args(json const& request) -> std::vector<std::string>
+{
+  std::vector<std::string> args{};
+  auto const append = [&args](std::string const& key, json const& value) {
+    args.push_back("--" + key);
+    if (value.is_string()) {
+      args.push_back(value.get<std::string>());
+    } else if (value.is_boolean()) {
+      args.emplace_back(value.get<bool>() ? "yes" : "no");
+    } else {
+      args.push_back(value.dump());
+    }
+  };
+  for (auto const& [key, value]: request.items()) {
+    if (key == "cmd" or key == "id") {
+      continue;
+    }
+    std::string option{ key };
+    std::ranges::replace(option, '_', '-');
+    if (value.is_array()) {
+      for (auto const& item: value) { append(option, item); }
+    } else {
+      append(option, value);
+    }
+  }
+  return args;
+}
+
+auto answer_request(std::string_view const line) -> json
+{
+  json response = json::object();
+  try {
+    auto const request = json::parse(line);
+    raise_if(not request.is_object() or not request.contains("cmd"), "Error. The request has no \"cmd\".");
+    if (request.contains("id")) {
+      response["id"] = request["id"];
+    }
+    auto const cmd = request["cmd"].get<std::string>();
+    auto const args = json_to_args(request);
+    std::vector<std::string_view> const arg_views(args.begin(), args.end());
+    std::ostringstream output{};
+    raise_if(not run_action(cmd, arg_views, output), std::format("Error. Unknown command: {}", cmd));
+    response["output"] = std::move(output).str();
+  } catch (std::exception const& ex) {
+    // A bad request shouldn't stop the rest of the batch.
+    response["error"] = ex.what();
+  }
+  return response;
+}
+
+auto run_batch(std::istream& in, std::ostream& out) -> std::size_t
+{
+  std::size_t n_requests = 0;
+  for (std::string line; std::getline(in, line);) {
+    if (strtrim(line).empty()) {
+      continue;
+    }
+    // Responses are flushed one by one, so that the reader can stream them.
+    out << answer_request(line).dump(-1, ' ', false, json::error_handler_t::replace) << std::endl;
+    ++n_requests;
+  }
+  return n_requests;
+}
+
+void process_batch(batch_params const& params)
+{
+  auto const start = std::chrono::steady_clock::now();
+  auto const n_requests = run_batch(std::cin, std::cout);
+  auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+  if (params.stats) {
+    std::println(
+      std::cerr,
+      "Processed {} requests in {:.3f}s ({:.1f} lines/s).",
+      n_requests,
+      elapsed.count(),
+      static_cast<double>(n_requests) / std::max(elapsed.count(), 1e-9)
+    );
+  }
+}
+
+void batch(std::span<std::string_view const> const args)
+{
+  try {
+    process_batch(fill_args<batch_params>(args));
+  } catch (gd::help_requested const& ex) {
+    std::print("{}", help_text);
+  } catch (gd::runtime_error const& ex) {
+    std::println("{}", ex.what());
+  }
+}
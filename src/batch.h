@@ -0,0 +1,8 @@
+#pragma once
+
+#include "precompiled.h"
+
+auto batch(std::span<std::string_view const> const args) -> void;
+
+// Answer JSON-lines requests from `in` with JSON lines on `out`. Returns the number of requests.
+auto run_batch(std::istream& in, std::ostream& out) -> std::size_t;
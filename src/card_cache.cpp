@@ -0,0 +1,241 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "card_cache.h"
+#include "precompiled.h"
+#include "segment_cache.h"
+#include "util.h"
+
+namespace {
+constexpr uint64_t cache_magic{ "gd-tools card cache"_h };
+constexpr uint32_t cache_version{ 3 };
+
+enum class EntryKind : uint32_t
+{
+  card = 0,
+  note = 1,
+};
+
+auto now_seconds() -> uint64_t
+{
+  auto const since_epoch = std::chrono::system_clock::now().time_since_epoch();
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(since_epoch).count());
+}
+
+auto encode_card(card_info const& card) -> std::string
+{
+  std::string payload{};
+  append_u64(payload, card.nid);
+  append_u64(payload, static_cast<uint64_t>(card.queue));
+  append_u64(payload, static_cast<uint64_t>(card.type));
+  return payload;
+}
+
+// Without the id and the fields, which come from the note, and without the deck name.
+auto decode_card(std::string_view const payload) -> card_info
+{
+  ByteReader reader{ payload };
+  card_info card{};
+  card.nid = reader.u64();
+  card.queue = static_cast<int64_t>(reader.u64());
+  card.type = static_cast<int64_t>(reader.u64());
+  return card;
+}
+
+auto encode_note(note_info const& note) -> std::string
+{
+  std::string payload{};
+  append_u32(payload, note.tags.size());
+  for (auto const& tag: note.tags) { append_str(payload, tag); }
+  append_u32(payload, note.fields.size());
+  for (auto const& [name, value]: note.fields) {
+    append_str(payload, name);
+    append_str(payload, value);
+  }
+  return payload;
+}
+
+auto decode_note(std::string_view const payload) -> note_info
+{
+  ByteReader reader{ payload };
+  note_info note{};
+  note.tags.resize(reader.count(sizeof(uint32_t)));
+  for (auto& tag: note.tags) { tag = reader.str(); }
+  for (auto n_fields = reader.count(2 * sizeof(uint32_t)); n_fields > 0; --n_fields) {
+    auto const name = reader.str();
+    note.fields.emplace(name, reader.str());
+  }
+  return note;
+}
+
+void append_entry(std::string& out, EntryKind const kind, uint64_t const id, auto const& entry)
+{
+  append_u32(out, static_cast<uint32_t>(kind));
+  append_u64(out, id);
+  append_u64(out, static_cast<uint64_t>(entry.mod));
+  append_u64(out, entry.fetched);
+  append_u64(out, entry.json_size);
+  append_str(out, entry.payload);
+}
+} // namespace
+
+CardCache::CardCache(std::filesystem::path path) : m_path(std::move(path))
+{
+  auto const bytes = read_file(m_path);
+  ByteReader reader{ bytes };
+  try {
+    if (bytes.empty() or reader.u64() != cache_magic or reader.u32() != cache_version) {
+      return;
+    }
+    while (not reader.empty()) {
+      auto const kind = static_cast<EntryKind>(reader.u32());
+      auto const id = reader.u64();
+      Entry entry{};
+      entry.mod = static_cast<int64_t>(reader.u64());
+      entry.fetched = reader.u64();
+      entry.json_size = reader.u64();
+      entry.payload = reader.str();
+      switch (kind) {
+        case EntryKind::card:
+          decode_card(entry.payload); // throws if it's damaged
+          m_cards.insert_or_assign(id, std::move(entry));
+          break;
+        case EntryKind::note:
+          decode_note(entry.payload);
+          m_notes.insert_or_assign(id, std::move(entry));
+          break;
+        default:
+          throw gd::corrupted_cache_entry("Corrupted cache entry.");
+      }
+    }
+  } catch (gd::runtime_error const&) {
+    // Cut short by a crash or written by something else. Everything will be fetched again.
+    m_cards.clear();
+    m_notes.clear();
+  }
+}
+
+auto CardCache::note_of(uint64_t const cid) const -> std::optional<uint64_t>
+{
+  std::scoped_lock const lock{ m_mutex };
+  auto const it = m_cards.find(cid);
+  if (it == m_cards.end()) {
+    return std::nullopt;
+  }
+  return ByteReader{ it->second.payload }.u64();
+}
+
+auto CardCache::find(uint64_t const cid, int64_t const card_mod, int64_t const note_mod) -> std::optional<card_info>
+{
+  std::scoped_lock const lock{ m_mutex };
+  auto const card = m_cards.find(cid);
+  if (card == m_cards.end() or card->second.mod != card_mod) {
+    ++m_stats.card_misses;
+    return std::nullopt;
+  }
+  auto result = decode_card(card->second.payload);
+  result.id = cid;
+  auto const note = m_notes.find(result.nid);
+  if (note == m_notes.end() or note->second.mod != note_mod) {
+    ++m_stats.card_misses;
+    return std::nullopt;
+  }
+  result.fields = decode_note(note->second.payload).fields;
+  ++m_stats.card_hits;
+  m_stats.bytes_saved += card->second.json_size;
+  return result;
+}
+
+auto CardCache::find_note(uint64_t const nid, int64_t const mod) -> std::optional<note_info>
+{
+  std::scoped_lock const lock{ m_mutex };
+  auto const it = m_notes.find(nid);
+  if (it == m_notes.end() or it->second.mod != mod) {
+    ++m_stats.note_misses;
+    return std::nullopt;
+  }
+  ++m_stats.note_hits;
+  m_stats.bytes_saved += it->second.json_size;
+  return decode_note(it->second.payload);
+}
+
+void CardCache::store_card(card_info const& card, int64_t const mod, std::size_t const json_size)
+{
+  std::scoped_lock const lock{ m_mutex };
+  m_cards.insert_or_assign(
+    card.id,
+    Entry{ .mod = mod, .fetched = now_seconds(), .json_size = json_size, .payload = encode_card(card) }
+  );
+  m_changed = true;
+}
+
+void CardCache::store_note(uint64_t const nid, note_info const& note, int64_t const mod, std::size_t const json_size)
+{
+  std::scoped_lock const lock{ m_mutex };
+  m_notes.insert_or_assign(
+    nid,
+    Entry{ .mod = mod, .fetched = now_seconds(), .json_size = json_size, .payload = encode_note(note) }
+  );
+  m_changed = true;
+}
+
+auto CardCache::stats() const -> CardCacheStats
+{
+  std::scoped_lock const lock{ m_mutex };
+  return m_stats;
+}
+
+void CardCache::save() const
+{
+  std::scoped_lock const lock{ m_mutex };
+  if (not m_changed) {
+    return;
+  }
+  // The oldest fetch time that is still kept, so that the file stays at about max_entries.
+  std::vector<uint64_t> fetched{};
+  fetched.reserve(m_cards.size() + m_notes.size());
+  for (auto const& [id, entry]: m_cards) { fetched.push_back(entry.fetched); }
+  for (auto const& [id, entry]: m_notes) { fetched.push_back(entry.fetched); }
+  uint64_t oldest_kept = 0;
+  if (fetched.size() > max_entries) {
+    auto const nth = fetched.begin() + static_cast<std::ptrdiff_t>(fetched.size() - max_entries);
+    std::ranges::nth_element(fetched, nth);
+    oldest_kept = *nth;
+  }
+  std::string bytes{};
+  append_u64(bytes, cache_magic);
+  append_u32(bytes, cache_version);
+  for (auto const& [cid, entry]: m_cards) {
+    if (entry.fetched >= oldest_kept) {
+      append_entry(bytes, EntryKind::card, cid, entry);
+    }
+  }
+  for (auto const& [nid, entry]: m_notes) {
+    if (entry.fetched >= oldest_kept) {
+      append_entry(bytes, EntryKind::note, nid, entry);
+    }
+  }
+  std::error_code ec{};
+  std::filesystem::create_directories(m_path.parent_path(), ec);
+  write_file_atomic(m_path, bytes);
+}
+
+auto card_cache_path() -> std::filesystem::path
+{
+  return user_cache_dir() / "cards.cache";
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "anki_search.h"
+#include "precompiled.h"
+
+struct CardCacheStats
+{
+  std::size_t card_hits;
+  std::size_t card_misses;
+  std::size_t note_hits;
+  std::size_t note_misses;
+  std::size_t bytes_saved; // of cardsInfo and notesInfo answers that weren't downloaded
+};
+
+// Cards and notes of earlier lookups, kept in a file between gd-ankisearch processes.
+// An entry is valid while AnkiConnect reports the same modification time for its card or note.
+// Fields are kept once per note, and a card is only found while its note is valid too.
+// Deck names aren't kept: renaming or moving to another deck doesn't change a card's modification time.
+// Safe to use from several threads. Processes that save at once don't corrupt the file, the last one wins.
+class CardCache
+{
+public:
+  static constexpr std::size_t max_entries{ 5000 }; // cards and notes together
+
+  // Reads the file. A missing, old or damaged file gives an empty cache.
+  explicit CardCache(std::filesystem::path path);
+
+  // The note of a cached card, whether the card was modified since or not.
+  auto note_of(uint64_t cid) const -> std::optional<uint64_t>;
+  // The card with the fields of its note and an empty deck name.
+  // Both must be cached with these modification times.
+  auto find(uint64_t cid, int64_t card_mod, int64_t note_mod) -> std::optional<card_info>;
+  auto find_note(uint64_t nid, int64_t mod) -> std::optional<note_info>;
+  // `json_size` is the size of the card or note in AnkiConnect's answer, to count bytes saved by a hit.
+  void store_card(card_info const& card, int64_t mod, std::size_t json_size);
+  void store_note(uint64_t nid, note_info const& note, int64_t mod, std::size_t json_size);
+
+  auto stats() const -> CardCacheStats;
+  // Write the file if something was stored, dropping the entries that were fetched longest ago.
+  void save() const;
+
+private:
+  struct Entry
+  {
+    int64_t mod;
+    uint64_t fetched; // seconds since the epoch
+    std::size_t json_size;
+    std::string payload;
+  };
+
+  std::filesystem::path m_path;
+  mutable std::mutex m_mutex{};
+  std::unordered_map<uint64_t, Entry> m_cards{};
+  std::unordered_map<uint64_t, Entry> m_notes{};
+  CardCacheStats m_stats{};
+  bool m_changed{ false };
+};
+
+// cards.cache in $XDG_CACHE_HOME/gd-tools.
+auto card_cache_path() -> std::filesystem::path;
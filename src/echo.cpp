@@ -59,7 +59,7 @@ struct stroke_order_params
   }
 };
 
-void print_css(stroke_order_params const& params)
+void print_css(stroke_order_params const& params, std::ostream& out)
 {
   static constexpr std::string_view css = R"EOF(
   <style>
@@ -69,24 +69,24 @@ void print_css(stroke_order_params const& params)
   }}
   </style>
   )EOF";
-  std::print(css, this_pid, params.font_size, params.font_family);
+  std::print(out, css, this_pid, params.font_size, params.font_family);
 }
 
-void print_with_stroke_order(stroke_order_params const& params)
+void print_with_stroke_order(stroke_order_params const& params, std::ostream& out)
 {
   if (params.gd_word.length() <= params.max_len) {
-    std::println("<div class=\"gd_echo_{}\">{}</div>", this_pid, params.gd_word);
-    print_css(params);
+    std::println(out, "<div class=\"gd_echo_{}\">{}</div>", this_pid, params.gd_word);
+    print_css(params, out);
   }
 }
 
-void stroke_order(std::span<std::string_view const> const args)
+void stroke_order(std::span<std::string_view const> const args, std::ostream& out)
 {
   try {
-    print_with_stroke_order(fill_args<stroke_order_params>(args));
+    print_with_stroke_order(fill_args<stroke_order_params>(args), out);
   } catch (gd::help_requested const& ex) {
-    std::print(help_text);
+    std::print(out, help_text);
   } catch (gd::runtime_error const& ex) {
-    std::println("{}", ex.what());
+    std::println(out, "{}", ex.what());
   }
 }
@@ -2,4 +2,4 @@
 
 #include "precompiled.h"
 
-void stroke_order(std::span<std::string_view const> const args);
+void stroke_order(std::span<std::string_view const> const args, std::ostream& out = std::cout);
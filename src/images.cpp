@@ -71,34 +71,35 @@ struct images_params
   }
 };
 
-void fetch_images(images_params const& params)
+void fetch_images(images_params const& params, std::ostream& out)
 {
-  cpr::Response const r = cpr::Get(
-    cpr::Url{ "https://www.bing.com/images/search"sv },
-    cpr::Parameters{ { "q", params.gd_word }, { "mkt", "ja-JP" } },
-    cpr::Header{ { "User-Agent", "Mozilla/5.0" } },
-    cpr::VerifySsl{ false },
-    cpr::Timeout{ params.max_time }
-  );
+  // Reused by the next request of `gd-tools batch`, so the TLS handshake is done once.
+  thread_local cpr::Session session{};
+  session.SetUrl(cpr::Url{ "https://www.bing.com/images/search"sv });
+  session.SetParameters(cpr::Parameters{ { "q", params.gd_word }, { "mkt", "ja-JP" } });
+  session.SetHeader(cpr::Header{ { "User-Agent", "Mozilla/5.0" } });
+  session.SetVerifySsl(cpr::VerifySsl{ false });
+  session.SetTimeout(cpr::Timeout{ params.max_time });
+  cpr::Response const r = session.Get();
   raise_if(r.status_code != cpr::status::HTTP_OK, "Couldn't connect to Bing.");
   static std::regex const img_re("<img[^<>]*class=\"mimg[^<>]*>");
   auto images_begin = std::sregex_iterator(std::begin(r.text), std::end(r.text), img_re);
   auto images_end = std::sregex_iterator();
-  std::println("<div class=\"gallery\">");
+  std::println(out, "<div class=\"gallery\">");
   for (auto const& match: std::ranges::subrange(images_begin, images_end) | std::views::take(5)) {
-    std::println("{}", match.str());
+    std::println(out, "{}", match.str());
   }
-  std::println("</div>");
-  std::println("{}", css_style);
+  std::println(out, "</div>");
+  std::println(out, "{}", css_style);
 }
 
-void images(std::span<std::string_view const> const args)
+void images(std::span<std::string_view const> const args, std::ostream& out)
 {
   try {
-    fetch_images(fill_args<images_params>(args));
+    fetch_images(fill_args<images_params>(args), out);
   } catch (gd::help_requested const& ex) {
-    std::print(help_text);
+    std::print(out, help_text);
   } catch (gd::runtime_error const& ex) {
-    std::println("{}", ex.what());
+    std::println(out, "{}", ex.what());
   }
 }
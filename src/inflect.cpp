@@ -0,0 +1,209 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "inflect.h"
+#include "kana_conv.h"
+#include "precompiled.h"
+
+using namespace std::string_view_literals;
+
+struct Ending
+{
+  std::string_view kana;
+  std::string_view rules;
+};
+
+struct GodanRow
+{
+  std::string_view u, a, i, e, o; // kana of each row, e.g. く, か, き, け, こ
+  std::string_view te, ta; // te- and ta-forms replace the last kana
+};
+
+static constexpr std::array godan_rows = {
+  GodanRow{ "う", "わ", "い", "え", "お", "って", "った" }, //
+  GodanRow{ "く", "か", "き", "け", "こ", "いて", "いた" }, //
+  GodanRow{ "ぐ", "が", "ぎ", "げ", "ご", "いで", "いだ" }, //
+  GodanRow{ "す", "さ", "し", "せ", "そ", "して", "した" }, //
+  GodanRow{ "つ", "た", "ち", "て", "と", "って", "った" }, //
+  GodanRow{ "ぬ", "な", "に", "ね", "の", "んで", "んだ" }, //
+  GodanRow{ "ぶ", "ば", "び", "べ", "ぼ", "んで", "んだ" }, //
+  GodanRow{ "む", "ま", "み", "め", "も", "んで", "んだ" }, //
+  GodanRow{ "る", "ら", "り", "れ", "ろ", "って", "った" }, //
+};
+
+// Endings attached to the a-, i-, e- and o-rows of godan verbs, or to the stem of ichidan verbs.
+static constexpr std::array a_row_endings = {
+  Ending{ "ない", "negative" },
+  Ending{ "なかった", "negative, past" },
+  Ending{ "れる", "passive" },
+  Ending{ "せる", "causative" },
+  Ending{ "ず", "-zu" },
+};
+static constexpr std::array i_row_endings = {
+  Ending{ "", "continuative" },
+  Ending{ "ます", "polite" },
+  Ending{ "ました", "polite past" },
+  Ending{ "ません", "polite negative" },
+  Ending{ "ませんでした", "polite past negative" },
+  Ending{ "たい", "-tai" },
+  Ending{ "たくない", "-tai, negative" },
+  Ending{ "たかった", "-tai, past" },
+  Ending{ "ながら", "-nagara" },
+};
+static constexpr std::array e_row_endings = {
+  Ending{ "", "imperative" },
+  Ending{ "ば", "-ba" },
+  Ending{ "る", "potential" },
+  Ending{ "ない", "potential, negative" },
+};
+static constexpr std::array o_row_endings = {
+  Ending{ "う", "volitional" },
+};
+static constexpr std::array te_endings = {
+  Ending{ "", "-te" },
+  Ending{ "いる", "-te, -iru" },
+  Ending{ "いた", "-te, -iru, past" },
+  Ending{ "いない", "-te, -iru, negative" },
+  Ending{ "る", "-te, -iru" },
+  Ending{ "た", "-te, -iru, past" },
+};
+static constexpr std::array ta_endings = {
+  Ending{ "", "past" },
+  Ending{ "ら", "-tara" },
+};
+static constexpr std::array ichidan_endings = {
+  Ending{ "", "continuative" },
+  Ending{ "ない", "negative" },
+  Ending{ "なかった", "negative, past" },
+  Ending{ "ます", "polite" },
+  Ending{ "ました", "polite past" },
+  Ending{ "ません", "polite negative" },
+  Ending{ "ませんでした", "polite past negative" },
+  Ending{ "た", "past" },
+  Ending{ "たら", "-tara" },
+  Ending{ "て", "-te" },
+  Ending{ "ている", "-te, -iru" },
+  Ending{ "ていた", "-te, -iru, past" },
+  Ending{ "ていない", "-te, -iru, negative" },
+  Ending{ "てる", "-te, -iru" },
+  Ending{ "てた", "-te, -iru, past" },
+  Ending{ "れば", "-ba" },
+  Ending{ "よう", "volitional" },
+  Ending{ "ろ", "imperative" },
+  Ending{ "られる", "passive" },
+  Ending{ "させる", "causative" },
+  Ending{ "たい", "-tai" },
+  Ending{ "たくない", "-tai, negative" },
+  Ending{ "たかった", "-tai, past" },
+  Ending{ "ながら", "-nagara" },
+  Ending{ "ず", "-zu" },
+};
+static constexpr std::array suru_endings = {
+  Ending{ "しない", "negative" },
+  Ending{ "しなかった", "negative, past" },
+  Ending{ "します", "polite" },
+  Ending{ "しました", "polite past" },
+  Ending{ "しません", "polite negative" },
+  Ending{ "しませんでした", "polite past negative" },
+  Ending{ "した", "past" },
+  Ending{ "したら", "-tara" },
+  Ending{ "して", "-te" },
+  Ending{ "している", "-te, -iru" },
+  Ending{ "していた", "-te, -iru, past" },
+  Ending{ "してる", "-te, -iru" },
+  Ending{ "すれば", "-ba" },
+  Ending{ "しよう", "volitional" },
+  Ending{ "しろ", "imperative" },
+  Ending{ "される", "passive" },
+  Ending{ "させる", "causative" },
+  Ending{ "したい", "-tai" },
+  Ending{ "せず", "-zu" },
+};
+static constexpr std::array kuru_endings = {
+  Ending{ "こない", "negative" },
+  Ending{ "こなかった", "negative, past" },
+  Ending{ "きます", "polite" },
+  Ending{ "きました", "polite past" },
+  Ending{ "きた", "past" },
+  Ending{ "きたら", "-tara" },
+  Ending{ "きて", "-te" },
+  Ending{ "きている", "-te, -iru" },
+  Ending{ "きていた", "-te, -iru, past" },
+  Ending{ "くれば", "-ba" },
+  Ending{ "こよう", "volitional" },
+  Ending{ "こい", "imperative" },
+  Ending{ "こられる", "passive" },
+  Ending{ "きたい", "-tai" },
+};
+static constexpr std::array adjective_endings = {
+  Ending{ "くない", "negative" },
+  Ending{ "くなかった", "negative, past" },
+  Ending{ "かった", "past" },
+  Ending{ "かったら", "-tara" },
+  Ending{ "くて", "-te" },
+  Ending{ "ければ", "-ba" },
+  Ending{ "く", "adv" },
+  Ending{ "さ", "noun" },
+  Ending{ "そう", "-sou" },
+  Ending{ "すぎる", "-sugiru" },
+};
+
+auto conjugate(std::string_view const word) -> std::vector<Conjugation>
+{
+  std::vector<Conjugation> forms{};
+  auto const add = [&forms](std::string_view const stem, std::string_view const row, auto const& endings) {
+    for (auto const& [kana, rules]: endings) {
+      forms.emplace_back(std::string{ stem }.append(row).append(kana), rules);
+    }
+  };
+  auto const stem_of = [word](std::string_view const suffix) { return word.substr(0, word.size() - suffix.size()); };
+
+  if (word.ends_with("する") and word.size() > "する"sv.size()) {
+    add(stem_of("する"), "", suru_endings);
+  }
+  if (word.ends_with("来る")) {
+    // 来 is read differently in each form, but it's written the same, so the first kana of the ending is dropped.
+    for (auto const& [kana, rules]: kuru_endings) {
+      forms.emplace_back(std::string{ stem_of("る") }.append(kana.substr(CharByteLen::THREE)), rules);
+    }
+  } else if (word.ends_with("くる")) {
+    add(stem_of("くる"), "", kuru_endings);
+  }
+  if (word.size() <= CharByteLen::THREE) {
+    // The rest need a stem.
+    return forms;
+  }
+  if (word.ends_with("る")) {
+    add(stem_of("る"), "", ichidan_endings);
+  }
+  if (word.ends_with("い")) {
+    add(stem_of("い"), "", adjective_endings);
+  }
+  for (auto const& row: godan_rows | std::views::filter([word](GodanRow const& r) { return word.ends_with(r.u); })) {
+    auto const stem = stem_of(row.u);
+    // 行く is the only godan verb with an irregular te-form.
+    bool const is_iku = word.ends_with("行く") or word == "いく";
+    add(stem, row.a, a_row_endings);
+    add(stem, row.i, i_row_endings);
+    add(stem, row.e, e_row_endings);
+    add(stem, row.o, o_row_endings);
+    add(stem, is_iku ? "って"sv : row.te, te_endings);
+    add(stem, is_iku ? "った"sv : row.ta, ta_endings);
+  }
+  return forms;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "precompiled.h"
+
+struct Conjugation
+{
+  std::string form;
+  std::string_view rules; // e.g. "polite, past"
+};
+
+// Generate common conjugated forms of a word, guessing its class by the ending.
+// Some forms are bogus (e.g. a noun ending in る conjugated as a verb),
+// so callers are expected to check that rdricpp deinflects them back to the word.
+auto conjugate(std::string_view word) -> std::vector<Conjugation>;
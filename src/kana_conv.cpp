@@ -17,6 +17,7 @@
  */
 
 #include "kana_conv.h"
+#include "normalize.h"
 #include "precompiled.h"
 #include "util.h"
 
@@ -42,32 +43,34 @@ auto unicode_char_byte_len(char const& ch) -> CharByteLen
   throw gd::runtime_error{ std::format("Can't recognize byte: '{:x}'.", ch) };
 }
 
-auto create_map(std::string_view from, std::string_view to) -> KanaConvMap
+auto half_to_full(std::string& str) -> std::string&
 {
-  KanaConvMap result{};
-  for (auto const [idx, uni_char]: enum_unicode_chars(from)) {
-    result.emplace(uni_char, to.substr(idx, uni_char.length()));
-  }
-  return result;
+  return normalize(str, { .fold_width = true, .remove_spaces = false });
 }
 
-auto half_to_full(std::string& str) -> std::string&
+JpSet::JpSet(std::pmr::memory_resource* const resource) : m_keys{ resource }, m_words{ resource } {}
+
+JpSet::JpSet(std::initializer_list<std::string_view> const words)
+{
+  for (auto const word: words) { emplace(word); }
+}
+
+auto JpSet::emplace(std::string_view const word) -> bool
 {
-  static KanaConvMap const conv_map = {
-    { "ｱ", "ア" }, { "ｲ", "イ" }, { "ｳ", "ウ" }, { "ｴ", "エ" }, { "ｵ", "オ" }, { "ｶ", "カ" }, { "ｷ", "キ" },
-    { "ｸ", "ク" }, { "ｹ", "ケ" }, { "ｺ", "コ" }, { "ｻ", "サ" }, { "ｼ", "シ" }, { "ｽ", "ス" }, { "ｾ", "セ" },
-    { "ｿ", "ソ" }, { "ﾀ", "タ" }, { "ﾁ", "チ" }, { "ﾂ", "ツ" }, { "ﾃ", "テ" }, { "ﾄ", "ト" }, { "ﾅ", "ナ" },
-    { "ﾆ", "ニ" }, { "ﾇ", "ヌ" }, { "ﾈ", "ネ" }, { "ﾉ", "ノ" }, { "ﾊ", "ハ" }, { "ﾋ", "ヒ" }, { "ﾌ", "フ" },
-    { "ﾍ", "ヘ" }, { "ﾎ", "ホ" }, { "ﾏ", "マ" }, { "ﾐ", "ミ" }, { "ﾑ", "ム" }, { "ﾒ", "メ" }, { "ﾓ", "モ" },
-    { "ﾔ", "ヤ" }, { "ﾕ", "ユ" }, { "ﾖ", "ヨ" }, { "ﾗ", "ラ" }, { "ﾘ", "リ" }, { "ﾙ", "ル" }, { "ﾚ", "レ" },
-    { "ﾛ", "ロ" }, { "ﾜ", "ワ" }, { "ｦ", "ヲ" }, { "ﾝ", "ン" }, { "ｧ", "ァ" }, { "ｨ", "ィ" }, { "ｩ", "ゥ" },
-    { "ｪ", "ェ" }, { "ｫ", "ォ" }, { "ｯ", "ッ" }, { "ｬ", "ャ" }, { "ｭ", "ュ" }, { "ｮ", "ョ" }, { "｡", "。" },
-    { "､", "、" }, { "･", "・" }, { "゛", "ﾞ" }, { "゜", "ﾟ" }, { "｢", "「" }, { "｣", "」" }, { "ｰ", "ー" }
-  };
-  for (auto const [idx, uni_char]: enum_unicode_chars(str)) {
-    if (conv_map.contains(uni_char)) {
-      str.replace(idx, uni_char.length(), conv_map.at(uni_char));
-    }
+  KanaInsensitiveKey key{ word, m_keys.get_allocator().resource() };
+  auto const it = std::ranges::lower_bound(m_keys, key, KanaInsensitiveMore{});
+  if (it != m_keys.end() and not KanaInsensitiveMore{}(key, *it)) {
+    // An equivalent word is already present.
+    return false;
   }
-  return str;
+  m_words.insert(std::next(m_words.begin(), std::distance(m_keys.begin(), it)), word);
+  m_keys.insert(it, std::move(key));
+  return true;
+}
+
+auto JpSet::contains(std::string_view const word) const -> bool
+{
+  KanaInsensitiveKey const key{ word };
+  auto const it = std::ranges::lower_bound(m_keys, key, KanaInsensitiveMore{});
+  return it != m_keys.end() and not KanaInsensitiveMore{}(key, *it);
 }
@@ -2,12 +2,9 @@
 
 #include "precompiled.h"
 
-using KanaConvMap = std::unordered_map<std::string_view, std::string_view>;
-
 enum CharByteLen : std::size_t { SKIP = 0, ONE = 1, TWO = 2, THREE = 3, FOUR = 4 };
 enum class Direction { kata_to_hira, hira_to_kata };
 
-auto create_map(std::string_view from, std::string_view to) -> KanaConvMap;
 auto unicode_char_byte_len(char const& ch) -> CharByteLen;
 
 inline constexpr std::string_view hiragana_chars =
@@ -37,6 +34,8 @@ struct Utf8IdxLen
   }
 };
 
+// Decodes again on every iteration and throws on bytes that can't start a character.
+// The tools use Utf8Index instead, this view is kept as the baseline of its tests and benchmarks.
 constexpr auto enum_unicode_chars(std::string_view str)
 {
   // return a sequence of Utf8CharView.
@@ -55,22 +54,80 @@ constexpr auto iter_unicode_chars(std::string_view str)
   return enum_unicode_chars(str) | std::views::transform([](Utf8CharView const v) { return v.ch; });
 }
 
+// Hiragana U+3041-U+3096 and the iteration marks U+309D-U+309E are 0x60 code points away from their katakana.
+// All of them are 3 bytes long in UTF-8 and start with 0xE3, so only the last two bytes change.
+inline constexpr unsigned char kana_lead_byte{ 0xE3 };
+inline constexpr char32_t hira_kata_offset{ 0x60 };
+inline constexpr char32_t kana_table_first{ 0x3040 }; // code point of E3 81 80
+inline constexpr std::size_t kana_table_size{ 3 * 64 }; // second byte 0x81-0x83, third byte 0x80-0xBF
+
+constexpr auto is_convertible_hiragana(char32_t const cp) noexcept -> bool
+{
+  return (cp >= U'\u3041' and cp <= U'\u3096') or cp == U'\u309D' or cp == U'\u309E';
+}
+
+// Position of a character in the kana table, given its last two bytes, or kana_table_size if it's not there.
+constexpr auto kana_table_index(unsigned char const second, unsigned char const third) noexcept -> std::size_t
+{
+  if (second < 0x81 or second > 0x83 or (third & 0xC0U) != 0x80) {
+    return kana_table_size;
+  }
+  return (second - 0x81U) * 64U + (third - 0x80U);
+}
+
+// For every code point of the table, the last two bytes of the converted character, or 0 if it stays as is.
 template<Direction D>
-auto convert_kana(std::string_view str) -> std::string
+consteval auto make_kana_table() -> std::array<uint16_t, kana_table_size>
 {
-  static auto const conv_map{ [] {
-    if constexpr (D == Direction::kata_to_hira) {
-      return create_map(katakana_chars, hiragana_chars);
+  std::array<uint16_t, kana_table_size> table{};
+  for (std::size_t idx = 0; idx < table.size(); ++idx) {
+    auto const cp = static_cast<char32_t>(kana_table_first + idx);
+    char32_t converted = 0;
+    if constexpr (D == Direction::hira_to_kata) {
+      converted = is_convertible_hiragana(cp) ? cp + hira_kata_offset : 0;
     } else {
-      return create_map(hiragana_chars, katakana_chars);
+      converted = is_convertible_hiragana(cp - hira_kata_offset) ? cp - hira_kata_offset : 0;
     }
-  }() };
+    if (converted != 0) {
+      table[idx] = static_cast<uint16_t>(((0x80U | ((converted >> 6U) & 0x3FU)) << 8U) | 0x80U | (converted & 0x3FU));
+    }
+  }
+  return table;
+}
 
-  std::string result{};
-  result.reserve(str.length());
-  for (auto const [idx, uni_char]: enum_unicode_chars(str)) {
-    result.append(conv_map.contains(uni_char) ? conv_map.at(uni_char) : uni_char);
+// Convert kana in place. Conversion never changes the byte length of a character.
+template<Direction D>
+void convert_kana_in_place(std::span<char> const text) noexcept
+{
+  static constexpr auto table = make_kana_table<D>();
+  auto* const data = text.data();
+  std::size_t pos = 0;
+  while (pos + 2 < text.size()) {
+    if (static_cast<unsigned char>(data[pos]) != kana_lead_byte) {
+      // Runs of ASCII, kanji and other text are skipped by memchr, which is vectorized by the C library.
+      auto const* const next = static_cast<char const*>(std::memchr(data + pos, kana_lead_byte, text.size() - pos - 2));
+      if (next == nullptr) {
+        break;
+      }
+      pos = static_cast<std::size_t>(next - data);
+    }
+    auto const idx = kana_table_index(
+      static_cast<unsigned char>(data[pos + 1]), //
+      static_cast<unsigned char>(data[pos + 2])
+    );
+    if (idx < table.size() and table[idx] != 0) {
+      data[pos + 1] = static_cast<char>(table[idx] >> 8U);
+      data[pos + 2] = static_cast<char>(table[idx] & 0xFFU);
+    }
+    pos += CharByteLen::THREE;
   }
+}
+
+template<Direction D>
+auto convert_kana(std::string_view str) -> std::string
+{
+  std::string result{ str };
+  convert_kana_in_place<D>(result);
   return result;
 }
 
@@ -86,16 +143,64 @@ inline auto hiragana_to_katakana(std::string_view str) -> std::string
 
 auto half_to_full(std::string& str) -> std::string&;
 
+// Kana-insensitive form of a string.
+// It's computed once per string, so comparing and hashing keys doesn't allocate.
+struct KanaInsensitiveKey
+{
+  std::pmr::string folded;
+
+  explicit KanaInsensitiveKey(
+    std::string_view const str, std::pmr::memory_resource* const resource = std::pmr::get_default_resource()
+  )
+    : folded{ str, resource }
+  {
+    convert_kana_in_place<Direction::hira_to_kata>(folded);
+  }
+  auto operator==(KanaInsensitiveKey const& other) const -> bool = default;
+};
+
 struct KanaInsensitiveMore
 {
-  bool operator()(std::string const& lhs, std::string const& rhs) const
+  bool operator()(KanaInsensitiveKey const& lhs, KanaInsensitiveKey const& rhs) const noexcept
   {
-    if (lhs.length() != rhs.length()) {
-      return lhs.length() > rhs.length();
+    // Kana conversion keeps byte lengths, so longer keys belong to longer words.
+    if (lhs.folded.length() != rhs.folded.length()) {
+      return lhs.folded.length() > rhs.folded.length();
     } else {
-      return hiragana_to_katakana(lhs) > hiragana_to_katakana(rhs);
+      return lhs.folded > rhs.folded;
     }
   }
 };
 
-using JpSet = std::set<std::string, KanaInsensitiveMore>;
+struct KanaInsensitiveHash
+{
+  auto operator()(KanaInsensitiveKey const& key) const noexcept -> std::size_t
+  {
+    return std::hash<std::string_view>{}(key.folded);
+  }
+};
+
+// Set of words where hiragana and katakana spellings of the same word are equal.
+// Longer words go first. Like with std::set, the first inserted spelling is kept.
+// Stored as a sorted vector, because it holds a few dozen words at most and is rebuilt on every lookup.
+// The set stores views, so inserted words must outlive it.
+class JpSet
+{
+public:
+  explicit JpSet(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+  JpSet(std::initializer_list<std::string_view> words);
+
+  auto emplace(std::string_view word) -> bool;
+  auto contains(std::string_view word) const -> bool;
+
+  auto size() const noexcept -> std::size_t { return m_words.size(); }
+  auto empty() const noexcept -> bool { return m_words.empty(); }
+  auto begin() const noexcept { return m_words.begin(); }
+  auto end() const noexcept { return m_words.end(); }
+
+  auto operator==(JpSet const& other) const -> bool = default;
+
+private:
+  std::pmr::vector<KanaInsensitiveKey> m_keys; // sorted by KanaInsensitiveMore
+  std::pmr::vector<std::string_view> m_words; // in the same order as m_keys
+};
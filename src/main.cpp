@@ -16,14 +16,14 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#include "anki_search.h"
-#include "echo.h"
-#include "images.h"
-#include "marisa_split.h"
-#include "massif.h"
-#include "mecab_split.h"
+#include "batch.h"
+#include "marisa_annotate.h"
+#include "marisa_build.h"
+#include "mecab_batch.h"
 #include "precompiled.h"
-#include "translate.h"
+#include "prefetch.h"
+#include "segment_cache.h"
+#include "serve.h"
 #include "util.h"
 
 static constexpr std::string_view help_text = R"EOF(usage: {} ACTION [OPTIONS]
@@ -35,7 +35,20 @@ ACTIONS
   images      Search images on Bing.
   translate   Translate text using argostranslate.
   marisa      Split search string using MARISA.
+  marisa-warmup
+              Load the MARISA word list into the page cache.
+  marisa-build
+              Build a kana-folded word list for marisa.
+  marisa-annotate
+              Find words in every line of a subtitle file using all cores.
   mecab       Split search string using Mecab.
+  mecab-batch Split every line of large text files using Mecab and all cores.
+  mandarin    Split Chinese search string using Mecab.
+  batch       Read JSON requests from stdin and answer each on its own line.
+  segment-cache
+              Show the hit rate of the sentence cache of marisa and mecab.
+  prefetch    Look up the words of a sentence ahead for ankisearch, massif and images.
+  serve       Keep dictionaries loaded and answer the other actions from one process.
   strokeorder Show stroke order of a word.
   handwritten Display the handwritten form of a word.
 
@@ -63,22 +76,6 @@ auto base_name(auto file_path) -> std::string
   return std::filesystem::path(file_path).filename();
 }
 
-template<std::integral Ret = uint64_t>
-constexpr auto djbx33a(std::string_view const s) -> Ret
-{
-  static constexpr Ret init = 5381;
-  static constexpr Ret mul = 33;
-
-  Ret acc = init;
-  for (auto const ch: s) { acc = (acc * mul) + static_cast<Ret>(ch); }
-  return acc;
-}
-
-constexpr auto operator""_h(char const* s, [[maybe_unused]] size_t const size)
-{
-  return djbx33a(std::string_view(s, size));
-}
-
 auto take_action(std::span<std::string_view const> const args) -> void
 {
   auto const program_name = base_name(args.front());
@@ -87,19 +84,16 @@ auto take_action(std::span<std::string_view const> const args) -> void
   std::span rest = args.subspan(1);
   switch (djbx33a(program_name)) {
   case "gd-ankisearch"_h:
-    return search_anki_cards(rest);
   case "gd-echo"_h:
-    return stroke_order(rest);
   case "gd-massif"_h:
-    return massif(rest);
   case "gd-images"_h:
-    return images(rest);
   case "gd-translate"_h:
-    return translate(rest);
   case "gd-marisa"_h:
-    return marisa_split(rest);
   case "gd-mecab"_h:
-    return mecab_split(rest);
+  case "gd-mandarin"_h:
+    // The action is the program name without "gd-", e.g. gd-marisa runs marisa.
+    serve_or_run(std::string_view{ program_name }.substr(3), rest);
+    return;
   }
 
   // Help requested explicitly.
@@ -110,20 +104,23 @@ auto take_action(std::span<std::string_view const> const args) -> void
   // Command passed as second arg (first is "gd-tools").
   rest = rest.subspan(1);
   switch (djbx33a(args[1])) {
-  case "ankisearch"_h:
-    return search_anki_cards(rest);
-  case "echo"_h:
-    return stroke_order(rest);
-  case "massif"_h:
-    return massif(rest);
-  case "images"_h:
-    return images(rest);
-  case "translate"_h:
-    return translate(rest);
-  case "marisa"_h:
-    return marisa_split(rest);
-  case "mecab"_h:
-    return mecab_split(rest);
+  case "marisa-build"_h:
+    return marisa_build(rest);
+  case "marisa-annotate"_h:
+    return marisa_annotate(rest);
+  case "mecab-batch"_h:
+    return mecab_batch(rest);
+  case "batch"_h:
+    return batch(rest);
+  case "segment-cache"_h:
+    return segment_cache_tool(rest);
+  case "serve"_h:
+    return serve(rest);
+  case "prefetch"_h:
+    return prefetch(rest);
+  }
+  if (serve_or_run(args[1], rest)) {
+    return;
   }
 
   // Couldn't determine command.
@@ -0,0 +1,192 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "mandarin.h"
+#include "mecab_split.h"
+#include "precompiled.h"
+#include "resources.h"
+#include "util.h"
+
+static constexpr std::string_view help_text = R"EOF(usage: gd-mandarin [OPTIONS]
+
+Echo input back to GoldenDict as HTML with sentence split into parts.
+Every word is converted to traditional characters.
+
+OPTIONS
+  --word %GDWORD%        required word
+  --sentence %GDSEARCH%  required sentence
+  --user-dict PATH       path to the user dictionary. The default is ~/.local/gd-mandarin/user.dic
+  --font-size SIZE       font size. The default value is 2rem
+)EOF";
+
+static constexpr std::string_view css_style = R"EOF(<style>
+  .gd-mandarin {{
+    font-size: {};
+    color: #1268c3;
+    font-weight: normal;
+  }}
+  .gd-mandarin a {{
+    display: inline-block;
+    font-weight: normal;
+    color: royalblue;
+    text-decoration: none;
+  }}
+  .gd-mandarin a:not(:last-of-type)::after {{
+    content: "";
+    display: inline-block;
+    background-color: #333;
+    margin: 4px;
+    width: 3px;
+    height: 3px;
+    border-radius: 100vmax;
+    vertical-align: middle;
+    cursor: text;
+    user-select: text;
+  }}
+  .gd-mandarin a b {{
+    background-color: #ddeeff;
+    border-radius: 0.2rem;
+    font-weight: 500;
+  }}
+</style>
+)EOF";
+
+// Fields of a node's feature string in res/mandarin_dict, see its dicrc.
+static constexpr std::size_t feature_traditional_idx{ 5 };
+
+struct mandarin_params
+{
+  std::string gd_word{};
+  std::string gd_sentence{};
+  std::filesystem::path user_dict{ user_home() / ".local/gd-mandarin/user.dic" };
+  std::string font_size{ "2rem" };
+
+  auto assign(std::string_view const key, std::string_view const value) -> void
+  {
+    if (key == "--word") {
+      gd_word = value;
+    } else if (key == "--sentence") {
+      gd_sentence = value;
+    } else if (key == "--user-dict") {
+      user_dict = value;
+    } else if (key == "--font-size") {
+      font_size = value;
+    } else {
+      throw gd::runtime_error(std::format("Unknown argument name: {}", key));
+    }
+  }
+};
+
+auto sanitize_mandarin(std::string_view const text) -> std::string
+{
+  std::string result{};
+  result.reserve(text.size());
+  bool in_letters = false; // spaces between letters don't end the run
+  for (char const ch: text) {
+    if (ch == ' ') {
+      continue;
+    }
+    if ((ch >= 'a' and ch <= 'z') or (ch >= 'A' and ch <= 'Z')) {
+      if (not in_letters) {
+        result.push_back(' ');
+      }
+      in_letters = true;
+      continue;
+    }
+    in_letters = false;
+    result.push_back(ch == '\n' or ch == '\r' ? ' ' : ch);
+  }
+  return result;
+}
+
+auto find_mandarin_dic_dir() -> std::filesystem::path
+{
+  // Japanese dictionaries in /usr/lib/mecab/dic have a dicrc too, so only the places of res/mandarin_dict are searched.
+  auto const dicrc = resolve_resource({
+    .file_name = "dicrc",
+    .dirs = {
+      user_home() / ".local/gd-mandarin", // mandarin_installer.sh
+      user_home() / ".local/share/gd-tools/mandarin_dict",
+      "/usr/share/gd-tools/mandarin_dict",
+    },
+    .recursive = false,
+  });
+  return dicrc.parent_path();
+}
+
+void split_mandarin(mandarin_params params, std::ostream& out)
+{
+  raise_if(params.gd_word.empty(), "Not enough parameters.");
+  raise_if(
+    not std::filesystem::is_regular_file(params.user_dict),
+    "Provided user dictionary doesn't exist or isn't a file."
+  );
+  if (params.gd_sentence.empty()) {
+    params.gd_sentence = params.gd_word;
+  }
+  auto const dic_dir = find_mandarin_dic_dir();
+  raise_if(dic_dir.empty(), "Couldn't find the mandarin dictionary. Run mandarin_installer.sh.");
+
+  auto const dicdir = "--dicdir=" + dic_dir.string();
+  auto const userdic = "--userdic=" + params.user_dict.string();
+  std::vector<char const*> const args = {
+    "arg0", // unused
+    dicdir.c_str(),
+    userdic.c_str(),
+  };
+  auto& tagger = cached_tagger(args);
+  auto const sentence = sanitize_mandarin(params.gd_sentence);
+  // A lattice per request, like gd-mecab, so that concurrent requests can share the tagger.
+  std::unique_ptr<MeCab::Lattice> const lattice{ MeCab::createLattice() };
+  lattice->set_sentence(sentence.c_str());
+  raise_if(not tagger.parse(lattice.get()), std::format("MeCab failed to parse the sentence: {}", lattice->what()));
+
+  // Same as `mecab -Ogdmandarin`, with the word in bold.
+  std::string html{};
+  for (auto const* node = lattice->bos_node(); node != nullptr; node = node->next) {
+    if (node->stat == MECAB_BOS_NODE or node->stat == MECAB_EOS_NODE) {
+      continue;
+    }
+    auto traditional = feature_field(node->feature, feature_traditional_idx);
+    if (traditional.empty()) {
+      traditional = std::string_view{ node->surface, node->length };
+    }
+    html.append(R"(<a href="bword:)").append(traditional).append(R"(">)");
+    if (traditional == params.gd_word) {
+      html.append("<b>").append(traditional).append("</b>");
+    } else {
+      html.append(traditional);
+    }
+    html.append("</a>");
+  }
+  std::println(out, R"EOF(<div class="gd-mandarin">)EOF");
+  std::println(out, "{}", html);
+  std::println(out, R"EOF(</div>)EOF");
+  std::print(out, css_style, params.font_size);
+}
+
+void mandarin(std::span<std::string_view const> const args, std::ostream& out)
+{
+  try {
+    split_mandarin(fill_args<mandarin_params>(args), out);
+  } catch (gd::help_requested const& ex) {
+    std::print(out, "{}", help_text);
+  } catch (gd::runtime_error const& ex) {
+    std::println(out, "{}", ex.what());
+  }
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "precompiled.h"
+
+// Drop spaces and turn every run of Latin letters (e.g. pinyin) into a single space.
+auto sanitize_mandarin(std::string_view text) -> std::string;
+
+auto find_mandarin_dic_dir() -> std::filesystem::path;
+
+auto mandarin(std::span<std::string_view const> const args, std::ostream& out = std::cout) -> void;
@@ -0,0 +1,90 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "mapped_file.h"
+#include "precompiled.h"
+#include "util.h"
+
+MappedFile::MappedFile(std::filesystem::path const& path)
+{
+  int const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  raise_if(fd < 0, std::format(R"(Error. Can't open file "{}".)", path.string()));
+
+  struct stat st{};
+  if (::fstat(fd, &st) != 0) {
+    ::close(fd);
+    throw gd::runtime_error(std::format(R"(Error. Can't stat file "{}".)", path.string()));
+  }
+  m_size = static_cast<std::size_t>(st.st_size);
+  if (m_size > 0) {
+    m_addr = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  ::close(fd); // the mapping keeps its own reference to the file.
+  if (m_addr == MAP_FAILED) {
+    m_addr = nullptr;
+    m_size = 0;
+    throw gd::runtime_error(std::format(R"(Error. Can't map file "{}".)", path.string()));
+  }
+}
+
+MappedFile::~MappedFile()
+{
+  if (m_addr != nullptr) {
+    ::munmap(m_addr, m_size);
+  }
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+  : m_addr{ std::exchange(other.m_addr, nullptr) }
+  , m_size{ std::exchange(other.m_size, 0) }
+{
+}
+
+auto MappedFile::operator=(MappedFile&& other) noexcept -> MappedFile&
+{
+  if (this != &other) {
+    if (m_addr != nullptr) {
+      ::munmap(m_addr, m_size);
+    }
+    m_addr = std::exchange(other.m_addr, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+  }
+  return *this;
+}
+
+auto MappedFile::bytes() const noexcept -> std::span<char const>
+{
+  return { static_cast<char const*>(m_addr), m_size };
+}
+
+auto MappedFile::prefault() const noexcept -> std::size_t
+{
+  if (m_addr == nullptr) {
+    return 0;
+  }
+  // Ask the kernel to start readahead, then touch each page so that it's resident before we return.
+  ::madvise(m_addr, m_size, MADV_WILLNEED);
+  auto const page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  auto const* const data = static_cast<unsigned char const*>(m_addr);
+  std::size_t n_pages = 0;
+  for (std::size_t offset = 0; offset < m_size; offset += page_size) {
+    static_cast<void>(*static_cast<unsigned char const volatile*>(data + offset));
+    ++n_pages;
+  }
+  return n_pages;
+}
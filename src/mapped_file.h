@@ -0,0 +1,27 @@
+#pragma once
+
+#include "precompiled.h"
+
+// Read-only shared mapping of a file.
+// Pages are backed by the page cache, so all processes mapping the same file share them.
+class MappedFile
+{
+public:
+  explicit MappedFile(std::filesystem::path const& path);
+  ~MappedFile();
+
+  MappedFile(MappedFile&& other) noexcept;
+  auto operator=(MappedFile&& other) noexcept -> MappedFile&;
+  MappedFile(MappedFile const&) = delete;
+  auto operator=(MappedFile const&) -> MappedFile& = delete;
+
+  auto bytes() const noexcept -> std::span<char const>;
+  auto size() const noexcept -> std::size_t { return m_size; }
+
+  // Fault in every page of the mapping. Returns the number of pages touched.
+  auto prefault() const noexcept -> std::size_t;
+
+private:
+  void* m_addr{ nullptr };
+  std::size_t m_size{ 0 };
+};
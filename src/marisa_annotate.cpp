@@ -0,0 +1,298 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "marisa_annotate.h"
+#include "kana_conv.h"
+#include "marisa_dict.h"
+#include "marisa_split.h"
+#include "normalize.h"
+#include "precompiled.h"
+#include "util.h"
+
+using json = nlohmann::json;
+
+static constexpr std::size_t worker_arena_size{ 64UL * 1024UL };
+static constexpr std::size_t ass_text_field_idx{ 9 };
+static constexpr std::string_view help_text = R"EOF(usage: gd-tools marisa-annotate [OPTIONS]
+
+Find words in every line of a subtitle file with gd-marisa.
+Prints one JSON object per line of dialogue, in the original order:
+{"line": 1, "start": "00:00:01,000", "end": "00:00:02,500", "text": "...", "words": ["...", ...]}
+
+OPTIONS
+  --input FILE       required .srt or .ass file.
+  --output FILE      optional. Print to stdout by default.
+  --threads N        optional number of worker threads. Defaults to the number of cores.
+  --path-to-dic      optional path to words.dic. Can be repeated.
+  --extra-dics yes   optional. Without --path-to-dic, also use the word lists in ~/.local/share/gd-tools/marisa_dicts/.
+  --load-mode MODE   optional. "mmap" (default) or "read".
+  --deinflect MODE   optional. "index" (default) or "runtime".
+  --top-k N          optional. Keep N most frequent words per position.
+
+EXAMPLES
+gd-tools marisa-annotate --input episode01.srt --output episode01.jsonl
+gd-tools marisa-annotate --threads 4 --input episode01.ass
+)EOF";
+
+struct marisa_annotate_params
+{
+  std::string input{};
+  std::string output{};
+  std::size_t n_threads{ std::max(1U, std::thread::hardware_concurrency()) };
+  std::vector<std::string> paths_to_dic{};
+  bool extra_dics{ false };
+  TrieLoadMode load_mode{ TrieLoadMode::mmap };
+  LatticeOptions lattice{};
+
+  auto assign(std::string_view const key, std::string_view const value) -> void
+  {
+    if (key == "--input") {
+      input = value;
+    } else if (key == "--output") {
+      output = value;
+    } else if (key == "--threads") {
+      n_threads = parse_count(value, n_threads);
+    } else if (key == "--path-to-dic") {
+      paths_to_dic.emplace_back(value);
+    } else if (key == "--extra-dics") {
+      extra_dics = (value == "yes");
+    } else if (key == "--load-mode") {
+      raise_if(value != "mmap" and value != "read", std::format("Unknown load mode: {}", value));
+      load_mode = (value == "read" ? TrieLoadMode::read : TrieLoadMode::mmap);
+    } else if (key == "--deinflect") {
+      raise_if(value != "index" and value != "runtime", std::format("Unknown deinflect mode: {}", value));
+      lattice.deinflect = (value == "runtime" ? DeinflectMode::runtime : DeinflectMode::index);
+    } else if (key == "--top-k") {
+      auto const top_k = parse_number<std::size_t>(value);
+      raise_if(not top_k.has_value(), std::format("Unknown value of --top-k: {}", value));
+      lattice.top_k = *top_k;
+    } else {
+      throw gd::runtime_error(std::format("Unknown argument name: {}", key));
+    }
+  }
+};
+
+auto strip_tags(std::string_view const text, char const open, char const close) -> std::string
+{
+  std::string result{};
+  result.reserve(text.size());
+  bool in_tag = false;
+  for (char const ch: text) {
+    if (ch == open) {
+      in_tag = true;
+    } else if (ch == close and in_tag) {
+      in_tag = false;
+    } else if (not in_tag) {
+      result.push_back(ch);
+    }
+  }
+  return result;
+}
+
+auto strip_ass_text(std::string_view const text) -> std::string
+{
+  // Drop override tags like {\an8} and line breaks. Japanese text doesn't need spaces in their place.
+  auto result = strip_tags(text, '{', '}');
+  for (std::string_view const escape: { "\\N", "\\n", "\\h" }) {
+    for (auto pos = result.find(escape); pos != std::string::npos; pos = result.find(escape, pos)) {
+      result.erase(pos, escape.size());
+    }
+  }
+  return strtrim(result);
+}
+
+auto parse_srt(std::istream& stream) -> std::vector<SubtitleLine>
+{
+  // Cues are separated by blank lines: a number, "start --> end", then one or more lines of text.
+  static constexpr std::string_view utf8_bom{ "\xEF\xBB\xBF" };
+  std::vector<SubtitleLine> lines{};
+  std::optional<SubtitleLine> cue{};
+  std::optional<std::size_t> number{};
+  std::size_t last_number{ 0 };
+  auto const flush = [&] {
+    if (cue and not cue->text.empty()) {
+      lines.push_back(std::move(*cue));
+    }
+    cue.reset();
+    number.reset();
+  };
+  for (std::string line; std::getline(stream, line);) {
+    auto trimmed = strtrim(line);
+    if (trimmed.starts_with(utf8_bom)) {
+      trimmed.erase(0, utf8_bom.size());
+    }
+    if (trimmed.empty()) {
+      flush();
+    } else if (auto const arrow = trimmed.find("-->"); arrow != std::string::npos and not cue) {
+      // A cue without its number line gets the one after the previous cue.
+      last_number = number.value_or(last_number + 1);
+      cue.emplace(last_number, strtrim(trimmed.substr(0, arrow)), strtrim(trimmed.substr(arrow + 3)), "");
+    } else if (not cue) {
+      number = parse_number<std::size_t>(trimmed);
+    } else {
+      cue->text += strip_tags(trimmed, '<', '>');
+    }
+  }
+  flush();
+  return lines;
+}
+
+auto parse_ass(std::istream& stream) -> std::vector<SubtitleLine>
+{
+  // Dialogue: Layer,Start,End,Style,Name,MarginL,MarginR,MarginV,Effect,Text
+  static constexpr std::string_view prefix{ "Dialogue:" };
+  std::vector<SubtitleLine> lines{};
+  std::size_t n_dialogues{ 0 };
+  for (std::string line; std::getline(stream, line);) {
+    if (not line.starts_with(prefix)) {
+      continue;
+    }
+    ++n_dialogues;
+    std::vector<std::string_view> fields{};
+    std::string_view rest{ std::string_view{ line }.substr(prefix.size()) };
+    while (fields.size() < ass_text_field_idx) {
+      auto const comma = rest.find(',');
+      if (comma == std::string_view::npos) {
+        break;
+      }
+      fields.push_back(rest.substr(0, comma));
+      rest.remove_prefix(comma + 1);
+    }
+    if (fields.size() < ass_text_field_idx) {
+      continue;
+    }
+    lines.emplace_back(n_dialogues, strtrim(fields[1]), strtrim(fields[2]), strip_ass_text(rest));
+  }
+  return lines;
+}
+
+auto annotate_line(
+  marisa::Agent& agent,
+  std::span<MarisaDict const* const> const dicts,
+  LatticeOptions const& options,
+  SubtitleLine const& line,
+  std::pmr::memory_resource* const resource
+) -> std::string
+{
+  // Normalization never makes the text longer, so the arena buffer is allocated once.
+  auto* const buffer = static_cast<char*>(resource->allocate(line.text.size(), alignof(char)));
+  std::string_view const sentence{ buffer, normalize_into(line.text, { buffer, line.text.size() }) };
+
+  auto const lattice = build_lattice(agent, dicts, sentence, options, resource);
+  json words = json::array();
+  std::pmr::vector<std::string_view> seen{ resource };
+  for (auto const headword: lattice.nodes | std::views::transform(&LatticeNode::headword)) {
+    if (not headword.empty() and std::ranges::find(seen, headword) == seen.end()) {
+      seen.push_back(headword);
+      words.emplace_back(headword);
+    }
+  }
+  json const result{
+    { "line", line.number }, { "start", line.start }, { "end", line.end }, { "text", line.text }, { "words", words },
+  };
+  return result.dump(-1, ' ', false, json::error_handler_t::replace);
+}
+
+auto annotate_lines(
+  std::span<SubtitleLine const> const lines,
+  std::span<MarisaDict const* const> const dicts,
+  LatticeOptions const& options,
+  std::size_t const n_threads
+) -> std::vector<std::string>
+{
+  // Lines take different time, so workers take the next line from a shared counter instead of fixed ranges.
+  // The dictionaries are read-only and shared, everything else belongs to a worker.
+  std::vector<std::string> results(lines.size());
+  std::atomic_size_t next_line{ 0 };
+  std::mutex error_mutex{};
+  std::exception_ptr error{};
+
+  auto const work = [&] {
+    marisa::Agent agent;
+    std::vector<std::byte> arena_buffer(worker_arena_size);
+    std::pmr::monotonic_buffer_resource arena{ arena_buffer.data(), arena_buffer.size() };
+    try {
+      for (auto idx = next_line++; idx < lines.size(); idx = next_line++) {
+        results[idx] = annotate_line(agent, dicts, options, lines[idx], &arena);
+        arena.release();
+      }
+    } catch (...) {
+      std::scoped_lock const lock{ error_mutex };
+      error = std::current_exception();
+      next_line = lines.size();
+    }
+  };
+
+  {
+    std::vector<std::jthread> workers{};
+    for (std::size_t idx = 1; idx < std::min(n_threads, lines.size()); ++idx) { workers.emplace_back(work); }
+    work();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+  return results;
+}
+
+auto read_subtitles(std::filesystem::path const& path) -> std::vector<SubtitleLine>
+{
+  std::ifstream file{ path };
+  raise_if(not file.good(), std::format(R"(Error. Can't read "{}".)", path.string()));
+  auto const ext = path.extension();
+  if (ext == ".srt") {
+    return parse_srt(file);
+  }
+  if (ext == ".ass" or ext == ".ssa") {
+    return parse_ass(file);
+  }
+  throw gd::runtime_error(std::format("Error. Unsupported subtitle format: {}", ext.string()));
+}
+
+void annotate_subtitles(marisa_annotate_params params)
+{
+  if (params.input.empty()) {
+    throw gd::help_requested();
+  }
+  if (params.paths_to_dic.empty()) {
+    for (auto const& path: find_dic_files(params.extra_dics)) { params.paths_to_dic.push_back(path.string()); }
+  }
+  std::vector<MarisaDict const*> dicts{};
+  for (auto const& path: params.paths_to_dic) { dicts.push_back(&cached_dict(path, params.load_mode)); }
+
+  auto const lines = read_subtitles(params.input);
+  auto const results = annotate_lines(lines, dicts, params.lattice, params.n_threads);
+
+  std::ofstream file{};
+  if (not params.output.empty()) {
+    file.open(params.output);
+    raise_if(not file.good(), std::format(R"(Error. Can't write "{}".)", params.output));
+  }
+  std::ostream& out = params.output.empty() ? std::cout : file;
+  for (auto const& result: results) { out << result << '\n'; }
+}
+
+void marisa_annotate(std::span<std::string_view const> const args)
+{
+  try {
+    annotate_subtitles(fill_args<marisa_annotate_params>(args));
+  } catch (gd::help_requested const& ex) {
+    std::print("{}", help_text);
+  } catch (gd::runtime_error const& ex) {
+    std::println("{}", ex.what());
+  }
+}
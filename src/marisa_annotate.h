@@ -0,0 +1,28 @@
+#pragma once
+
+#include "marisa_dict.h"
+#include "marisa_split.h"
+#include "precompiled.h"
+
+// A line of dialogue from a subtitle file.
+struct SubtitleLine
+{
+  std::size_t number; // number of the cue in .srt, or of the Dialogue line in .ass, starting with 1
+  std::string start;
+  std::string end;
+  std::string text; // without formatting tags
+};
+
+auto parse_srt(std::istream& stream) -> std::vector<SubtitleLine>;
+auto parse_ass(std::istream& stream) -> std::vector<SubtitleLine>;
+
+// Annotate every line with the headwords found by gd-marisa, using `n_threads` workers.
+// Returns one JSON object per line, in the order of `lines`.
+auto annotate_lines(
+  std::span<SubtitleLine const> lines,
+  std::span<MarisaDict const* const> dicts,
+  LatticeOptions const& options,
+  std::size_t n_threads
+) -> std::vector<std::string>;
+
+auto marisa_annotate(std::span<std::string_view const> const args) -> void;
@@ -0,0 +1,264 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "marisa_build.h"
+#include "inflect.h"
+#include "marisa_dict.h"
+#include "precompiled.h"
+#include "util.h"
+
+// Enough for chains like 食べさせられなかった (causative, passive, negative past).
+static constexpr std::size_t max_conjugation_steps{ 3 };
+
+static constexpr std::string_view help_text = R"EOF(usage: gd-tools marisa-build [OPTIONS]
+
+Build a kana-folded word list for gd-marisa from a newline-separated list of words.
+Words are stored in katakana, and their original spellings are saved to PATH.surfaces,
+so that gd-marisa can search hiragana and katakana spellings of a word with one query.
+
+With --forms, conjugated forms of the words are saved to PATH.forms,
+so that gd-marisa can find inflected words without running the deinflector.
+
+With --freq, frequency ranks of the words are saved to PATH.ranks,
+so that gd-marisa can show the most frequent words first.
+The frequency list has one word per line, the most frequent word first.
+Anything after a tab on the line is ignored.
+
+OPTIONS
+  --input FILE     optional list of words. Read from stdin by default.
+  --output PATH    required path to the resulting .dic file.
+  --forms yes|no   optional. Also build the index of conjugated forms.
+  --freq FILE      optional frequency list.
+  --from-dic PATH  optional. Add conjugated forms or frequency ranks to an existing .dic file.
+
+EXAMPLES
+gd-tools marisa-build --output marisa_words.dic < keyset.txt
+gd-tools marisa-build --input keyset.txt --output ~/.local/share/gd-tools/marisa_words.dic --forms yes
+gd-tools marisa-build --from-dic /usr/share/gd-tools/marisa_words.dic --forms yes
+gd-tools marisa-build --from-dic marisa_words.dic --freq jpdb_freq.txt
+)EOF";
+
+struct marisa_build_params
+{
+  std::string input{};
+  std::string output{};
+  std::string from_dic{};
+  std::string freq{};
+  bool forms{ false };
+
+  auto assign(std::string_view const key, std::string_view const value) -> void
+  {
+    if (key == "--input") {
+      input = value;
+    } else if (key == "--output") {
+      output = value;
+    } else if (key == "--from-dic") {
+      from_dic = value;
+    } else if (key == "--freq") {
+      freq = value;
+    } else if (key == "--forms") {
+      raise_if(value != "yes" and value != "no", std::format("Unknown value of --forms: {}", value));
+      forms = (value == "yes");
+    } else {
+      throw gd::runtime_error(std::format("Unknown argument name: {}", key));
+    }
+  }
+};
+
+using FoldedWords = std::map<std::string, std::set<std::string>>;
+
+auto read_word_list(std::istream& stream) -> FoldedWords
+{
+  FoldedWords result{};
+  for (std::string line; std::getline(stream, line);) {
+    if (auto word = strtrim(line); not word.empty()) {
+      result[kana_fold(word)].insert(std::move(word));
+    }
+  }
+  return result;
+}
+
+auto write_folded_dic(FoldedWords const& words, std::filesystem::path const& output) -> std::size_t
+{
+  raise_if(words.empty(), "Error. The word list is empty.");
+
+  marisa::Keyset keyset;
+  for (auto const& folded: words | std::views::keys) { keyset.push_back(folded.c_str(), folded.length()); }
+  marisa::Trie trie;
+  trie.build(keyset);
+
+  // Keys are pushed in map order, and the trie assigns them new IDs.
+  std::vector<std::vector<std::string>> surfaces(trie.num_keys());
+  std::size_t n_surfaces = 0;
+  for (auto const [idx, spellings]: std::views::enumerate(words | std::views::values)) {
+    surfaces.at(keyset[static_cast<std::size_t>(idx)].id()).assign(spellings.begin(), spellings.end());
+    n_surfaces += spellings.size();
+  }
+
+  trie.save(output.c_str());
+  KeyTable::write(std::filesystem::path{ output } += surfaces_file_ext, surfaces);
+  return n_surfaces;
+}
+
+auto write_folded_dic(std::istream& word_list, std::filesystem::path const& output) -> std::size_t
+{
+  return write_folded_dic(read_word_list(word_list), output);
+}
+
+// The rule chain that takes the form back to the word, as the deinflector reports it, e.g. "causative, passive".
+// Forms that the deinflector can't take back to the word would never be found at runtime either.
+auto deinflection_chain(std::string_view const form, std::string_view const word) -> std::optional<std::string>
+{
+  for (auto const& deinflection: ajt::rdricpp::deinflect(form)) {
+    if (deinflection.term == word) {
+      return join_with(deinflection.reasons, ", ");
+    }
+  }
+  return std::nullopt;
+}
+
+auto write_forms_index(std::span<std::string const> const words, std::filesystem::path const& output) -> std::size_t
+{
+  std::map<std::string, std::vector<std::string>> forms{};
+  std::size_t n_forms = 0;
+  for (auto const& word: words) {
+    // Forms that end like a verb or an adjective are conjugated again,
+    // e.g. 食べる → 食べさせる → 食べさせられる → 食べさせられなかった.
+    std::vector<std::string> stems{ word };
+    std::unordered_set<std::string> seen{ word };
+    for (std::size_t step = 0; step < max_conjugation_steps and not stems.empty(); ++step) {
+      std::vector<std::string> next_stems{};
+      for (auto const& stem: stems) {
+        for (auto& conjugation: conjugate(stem)) {
+          if (not seen.insert(conjugation.form).second) {
+            continue;
+          }
+          auto const chain = deinflection_chain(conjugation.form, word);
+          if (not chain) {
+            continue;
+          }
+          auto& entries = forms[conjugation.form];
+          if (auto entry = std::format("{}{}{}", word, form_rules_sep, *chain);
+              std::ranges::find(entries, entry) == entries.end()) {
+            entries.push_back(std::move(entry));
+            ++n_forms;
+          }
+          if (conjugation.form.ends_with("る") or conjugation.form.ends_with("い")) {
+            next_stems.push_back(std::move(conjugation.form));
+          }
+        }
+      }
+      stems = std::move(next_stems);
+    }
+  }
+  FormsIndex::write(output, forms);
+  return n_forms;
+}
+
+auto read_freq_list(std::istream& stream) -> std::unordered_map<std::string, uint32_t>
+{
+  std::unordered_map<std::string, uint32_t> ranks{};
+  uint32_t rank = 0;
+  for (std::string line; std::getline(stream, line); ++rank) {
+    // The first occurrence of a word is the most frequent one.
+    ranks.try_emplace(strtrim(line.substr(0, line.find('\t'))), rank);
+  }
+  return ranks;
+}
+
+auto write_rank_table(std::filesystem::path const& dic_path, std::istream& freq_list) -> std::size_t
+{
+  auto const freq_ranks = read_freq_list(freq_list);
+  raise_if(freq_ranks.empty(), "Error. The frequency list is empty.");
+
+  // Key IDs change when the trie is rebuilt, so an old table can't be reused.
+  std::filesystem::remove(ranks_path(dic_path));
+  MarisaDict const dict{ dic_path, TrieLoadMode::read };
+  marisa::Agent agent;
+  std::vector<uint32_t> ranks(dict.size(), unranked);
+  std::size_t n_ranked = 0;
+  for (auto const& word: dict.words()) {
+    auto const found = freq_ranks.find(word);
+    auto const id = dict.key_id(agent, word);
+    if (found == freq_ranks.end() or not id) {
+      continue;
+    }
+    // Spellings of a kana-folded key share its rank.
+    if (ranks.at(*id) == unranked) {
+      ++n_ranked;
+    }
+    ranks.at(*id) = std::min(ranks.at(*id), found->second);
+  }
+  RankTable::write(ranks_path(dic_path), ranks);
+  return n_ranked;
+}
+
+auto write_rank_table(std::filesystem::path const& dic_path, std::string const& freq_file) -> std::size_t
+{
+  std::ifstream file{ freq_file };
+  raise_if(not file.good(), std::format(R"(Error. Can't read "{}".)", freq_file));
+  return write_rank_table(dic_path, file);
+}
+
+void extend_dic(marisa_build_params const& params, std::filesystem::path const& dic_path)
+{
+  if (params.forms) {
+    auto const words = MarisaDict{ dic_path, TrieLoadMode::read }.words();
+    auto const n_forms = write_forms_index(words, forms_path(dic_path));
+    std::println("Built {}: {} forms of {} words.", forms_path(dic_path).string(), n_forms, words.size());
+  }
+  if (not params.freq.empty()) {
+    auto const n_ranked = write_rank_table(dic_path, params.freq);
+    std::println("Built {}: {} ranked keys.", ranks_path(dic_path).string(), n_ranked);
+  }
+}
+
+void build_folded_dic(marisa_build_params const& params)
+{
+  if (not params.from_dic.empty()) {
+    raise_if(not params.forms and params.freq.empty(), "Error. Nothing to add: pass --forms yes or --freq FILE.");
+    return extend_dic(params, params.from_dic);
+  }
+  if (params.output.empty()) {
+    throw gd::help_requested();
+  }
+
+  FoldedWords words{};
+  if (params.input.empty()) {
+    words = read_word_list(std::cin);
+  } else {
+    std::ifstream file{ params.input };
+    raise_if(not file.good(), std::format(R"(Error. Can't read "{}".)", params.input));
+    words = read_word_list(file);
+  }
+  auto const n_words = write_folded_dic(words, params.output);
+  std::filesystem::remove(ranks_path(params.output));
+  std::println("Built {}: {} words.", params.output, n_words);
+  extend_dic(params, params.output);
+}
+
+void marisa_build(std::span<std::string_view const> const args)
+{
+  try {
+    build_folded_dic(fill_args<marisa_build_params>(args));
+  } catch (gd::help_requested const& ex) {
+    std::print(help_text);
+  } catch (gd::runtime_error const& ex) {
+    std::println("{}", ex.what());
+  }
+}
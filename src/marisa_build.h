@@ -0,0 +1,14 @@
+#pragma once
+
+#include "precompiled.h"
+
+auto marisa_build(std::span<std::string_view const> const args) -> void;
+
+// Build a kana-folded trie from a newline-separated list of words. Returns the number of words.
+auto write_folded_dic(std::istream& word_list, std::filesystem::path const& output) -> std::size_t;
+
+// Build the index of conjugated forms of the words. Returns the number of forms.
+auto write_forms_index(std::span<std::string const> words, std::filesystem::path const& output) -> std::size_t;
+
+// Store frequency ranks of the words of a dictionary next to it. Returns the number of ranked keys.
+auto write_rank_table(std::filesystem::path const& dic_path, std::istream& freq_list) -> std::size_t;
@@ -0,0 +1,336 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "marisa_dict.h"
+#include "kana_conv.h"
+#include "precompiled.h"
+#include "util.h"
+
+static constexpr std::string_view key_table_magic{ "GDKEYTB1" };
+static constexpr std::size_t key_table_header_size{ key_table_magic.size() + sizeof(uint32_t) };
+static constexpr std::string_view rank_table_magic{ "GDRANKS1" };
+static constexpr std::size_t rank_table_header_size{ rank_table_magic.size() + sizeof(uint32_t) };
+
+auto load_trie(marisa::Trie& trie, std::filesystem::path const& path, TrieLoadMode const mode) -> void
+{
+  raise_if(
+    not std::filesystem::is_regular_file(path),
+    std::format(R"(Error. The dictionary file "{}" does not exist.)", path.string())
+  );
+  switch (mode) {
+  case TrieLoadMode::mmap:
+    // Pages are shared with every other process that has the same file mapped.
+    return trie.mmap(path.c_str());
+  case TrieLoadMode::read:
+    return trie.load(path.c_str());
+  }
+}
+
+auto kana_fold(std::string_view const str) -> std::string
+{
+  // Same normalization as KanaInsensitiveMore uses.
+  return hiragana_to_katakana(str);
+}
+
+KeyTable::KeyTable(std::filesystem::path const& path) : m_file{ path }
+{
+  auto const bytes = m_file.bytes();
+  raise_if(
+    bytes.size() < key_table_header_size or std::string_view{ bytes.data(), key_table_magic.size() } != key_table_magic,
+    std::format(R"(Error. "{}" is not a key table.)", path.string())
+  );
+  m_n_keys = read_u32(key_table_magic.size());
+  auto const blob_begin = key_table_header_size + (m_n_keys + 1) * sizeof(uint32_t);
+  raise_if(
+    bytes.size() < blob_begin or bytes.size() - blob_begin < read_u32(blob_begin - sizeof(uint32_t)),
+    std::format(R"(Error. The key table "{}" is truncated.)", path.string())
+  );
+}
+
+auto KeyTable::read_u32(std::size_t const pos) const noexcept -> uint32_t
+{
+  uint32_t value{};
+  std::memcpy(&value, m_file.bytes().data() + pos, sizeof(value));
+  return value;
+}
+
+auto KeyTable::at(std::size_t const key_id) const -> std::string_view
+{
+  raise_if(key_id >= m_n_keys, "Key table doesn't match the trie.");
+  auto const offsets_begin = key_table_header_size;
+  auto const blob_begin = offsets_begin + (m_n_keys + 1) * sizeof(uint32_t);
+  auto const begin = read_u32(offsets_begin + key_id * sizeof(uint32_t));
+  auto const end = read_u32(offsets_begin + (key_id + 1) * sizeof(uint32_t));
+  return std::string_view{ m_file.bytes().data() + blob_begin + begin, end - begin };
+}
+
+void KeyTable::write(std::filesystem::path const& path, std::span<std::vector<std::string> const> const entries)
+{
+  std::string blob{};
+  std::vector<uint32_t> offsets{};
+  offsets.reserve(entries.size() + 1);
+  for (auto const& strings: entries) {
+    offsets.push_back(static_cast<uint32_t>(blob.size()));
+    blob.append(join_with(strings, std::string_view{ "\0", 1 }));
+  }
+  offsets.push_back(static_cast<uint32_t>(blob.size()));
+  raise_if(blob.size() > std::numeric_limits<uint32_t>::max(), "Key table is too large.");
+
+  auto const n_keys = static_cast<uint32_t>(entries.size());
+  std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+  raise_if(not file.good(), std::format(R"(Error. Can't write "{}".)", path.string()));
+  file.write(key_table_magic.data(), static_cast<std::streamsize>(key_table_magic.size()));
+  file.write(reinterpret_cast<char const*>(&n_keys), sizeof(n_keys));
+  file.write(
+    reinterpret_cast<char const*>(offsets.data()), static_cast<std::streamsize>(offsets.size() * sizeof(uint32_t))
+  );
+  file.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+  raise_if(not file.good(), std::format(R"(Error. Can't write "{}".)", path.string()));
+}
+
+RankTable::RankTable(std::filesystem::path const& path) : m_file{ path }
+{
+  auto const bytes = m_file.bytes();
+  raise_if(
+    bytes.size() < rank_table_header_size
+      or std::string_view{ bytes.data(), rank_table_magic.size() } != rank_table_magic,
+    std::format(R"(Error. "{}" is not a rank table.)", path.string())
+  );
+  uint32_t n_keys{};
+  std::memcpy(&n_keys, bytes.data() + rank_table_magic.size(), sizeof(n_keys));
+  m_n_keys = n_keys;
+  raise_if(
+    bytes.size() < rank_table_header_size + m_n_keys * sizeof(uint32_t),
+    std::format(R"(Error. The rank table "{}" is truncated.)", path.string())
+  );
+}
+
+auto RankTable::at(std::size_t const key_id) const -> uint32_t
+{
+  raise_if(key_id >= m_n_keys, "Rank table doesn't match the trie.");
+  uint32_t rank{};
+  std::memcpy(&rank, m_file.bytes().data() + rank_table_header_size + key_id * sizeof(uint32_t), sizeof(rank));
+  return rank;
+}
+
+void RankTable::write(std::filesystem::path const& path, std::span<uint32_t const> const ranks)
+{
+  raise_if(ranks.size() > std::numeric_limits<uint32_t>::max(), "Rank table is too large.");
+  auto const n_keys = static_cast<uint32_t>(ranks.size());
+  std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+  raise_if(not file.good(), std::format(R"(Error. Can't write "{}".)", path.string()));
+  file.write(rank_table_magic.data(), static_cast<std::streamsize>(rank_table_magic.size()));
+  file.write(reinterpret_cast<char const*>(&n_keys), sizeof(n_keys));
+  file.write(reinterpret_cast<char const*>(ranks.data()), static_cast<std::streamsize>(ranks.size_bytes()));
+  raise_if(not file.good(), std::format(R"(Error. Can't write "{}".)", path.string()));
+}
+
+auto forms_path(std::filesystem::path const& dic_path) -> std::filesystem::path
+{
+  return std::filesystem::path{ dic_path } += forms_file_ext;
+}
+
+auto ranks_path(std::filesystem::path const& dic_path) -> std::filesystem::path
+{
+  return std::filesystem::path{ dic_path } += ranks_file_ext;
+}
+
+FormsIndex::FormsIndex(std::filesystem::path const& path, TrieLoadMode const mode)
+  : m_entries{ std::filesystem::path{ path } += entries_file_ext }
+{
+  load_trie(m_trie, path, mode);
+  raise_if(
+    m_entries.size() != m_trie.num_keys(),
+    std::format(R"(Error. The entries of "{}" don't match the index.)", path.string())
+  );
+}
+
+auto FormsIndex::common_prefix_search(
+  marisa::Agent& agent,
+  std::string_view const text,
+  std::pmr::memory_resource* const resource
+) const -> std::pmr::vector<InflectedForm>
+{
+  std::pmr::vector<InflectedForm> hits{ resource };
+  agent.set_query(text.data(), text.length());
+  while (m_trie.common_prefix_search(agent)) {
+    std::string_view const surface{ agent.key().ptr(), agent.key().length() };
+    for (std::string_view const entry: split_key_entries(m_entries.at(agent.key().id()))) {
+      auto const sep = entry.find(form_rules_sep);
+      hits.emplace_back(surface, entry.substr(0, sep), sep == std::string_view::npos ? "" : entry.substr(sep + 1));
+    }
+  }
+  return hits;
+}
+
+void FormsIndex::write(
+  std::filesystem::path const& path,
+  std::map<std::string, std::vector<std::string>> const& forms
+)
+{
+  raise_if(forms.empty(), "Error. No conjugated forms to write.");
+  marisa::Keyset keyset;
+  for (auto const& surface: forms | std::views::keys) { keyset.push_back(surface.c_str(), surface.length()); }
+  marisa::Trie trie;
+  trie.build(keyset);
+
+  std::vector<std::vector<std::string>> entries(trie.num_keys());
+  for (auto const [idx, form_entries]: std::views::enumerate(forms | std::views::values)) {
+    entries.at(keyset[static_cast<std::size_t>(idx)].id()) = form_entries;
+  }
+  trie.save(path.c_str());
+  KeyTable::write(std::filesystem::path{ path } += entries_file_ext, entries);
+}
+
+MarisaDict::MarisaDict(std::filesystem::path const& path, TrieLoadMode const mode) : m_name{ path.stem().string() }
+{
+  load_trie(m_trie, path, mode);
+  if (auto const table_path = std::filesystem::path{ path } += surfaces_file_ext;
+      std::filesystem::is_regular_file(table_path)) {
+    m_surfaces.emplace(table_path);
+    raise_if(
+      m_surfaces->size() != m_trie.num_keys(),
+      std::format(R"(Error. "{}" doesn't belong to "{}".)", table_path.string(), path.string())
+    );
+  }
+  if (auto const index_path = forms_path(path); std::filesystem::is_regular_file(index_path)) {
+    m_forms.emplace(index_path, mode);
+  }
+  if (auto const table_path = ranks_path(path); std::filesystem::is_regular_file(table_path)) {
+    m_ranks.emplace(table_path);
+    raise_if(
+      m_ranks->size() != m_trie.num_keys(),
+      std::format(R"(Error. "{}" doesn't belong to "{}".)", table_path.string(), path.string())
+    );
+  }
+}
+
+auto MarisaDict::key_id(marisa::Agent& agent, std::string_view const word) const -> std::optional<std::size_t>
+{
+  std::string const folded{ is_folded() ? kana_fold(word) : std::string{} };
+  auto const query = is_folded() ? std::string_view{ folded } : word;
+  agent.set_query(query.data(), query.length());
+  if (m_trie.lookup(agent)) {
+    return agent.key().id();
+  }
+  return std::nullopt;
+}
+
+auto MarisaDict::rank(marisa::Agent& agent, std::string_view const word) const -> uint32_t
+{
+  if (not has_ranks()) {
+    return unranked;
+  }
+  auto const id = key_id(agent, word);
+  return id ? m_ranks->at(*id) : unranked;
+}
+
+auto MarisaDict::words() const -> std::vector<std::string>
+{
+  std::vector<std::string> result{};
+  result.reserve(m_trie.num_keys());
+  marisa::Agent agent;
+  agent.set_query("");
+  while (m_trie.predictive_search(agent)) {
+    if (is_folded()) {
+      for (std::string_view const word: split_key_entries(m_surfaces->at(agent.key().id()))) {
+        result.emplace_back(word);
+      }
+    } else {
+      result.emplace_back(agent.key().ptr(), agent.key().length());
+    }
+  }
+  return result;
+}
+
+auto MarisaDict::common_prefix_search(
+  marisa::Agent& agent,
+  std::span<std::string_view const> const terms,
+  std::pmr::memory_resource* const resource
+) const -> std::pmr::vector<std::string_view>
+{
+  if (is_folded()) {
+    return folded_prefix_search(agent, terms, resource);
+  }
+  std::pmr::vector<std::string_view> hits{ resource };
+  for (auto const term: terms) {
+    agent.set_query(term.data(), term.length());
+    while (m_trie.common_prefix_search(agent)) { //
+      hits.emplace_back(agent.key().ptr(), agent.key().length());
+    }
+  }
+  return hits;
+}
+
+struct FoldedTerm
+{
+  std::pmr::string folded;
+  std::size_t term_idx;
+};
+
+struct FoldedHit
+{
+  std::size_t term_idx; // first term that starts with the word
+  std::string_view word;
+};
+
+auto MarisaDict::folded_prefix_search(
+  marisa::Agent& agent,
+  std::span<std::string_view const> const terms,
+  std::pmr::memory_resource* const resource
+) const -> std::pmr::vector<std::string_view>
+{
+  // Kana variants of a term usually fold to the same string, so the trie is queried once per group.
+  std::pmr::vector<FoldedTerm> folded{ resource };
+  folded.reserve(terms.size());
+  for (auto const [idx, term]: std::views::enumerate(terms)) {
+    std::pmr::string key{ term, resource };
+    convert_kana_in_place<Direction::hira_to_kata>(key);
+    folded.emplace_back(std::move(key), static_cast<std::size_t>(idx));
+  }
+  std::ranges::sort(folded, {}, [](FoldedTerm const& t) { return std::tie(t.folded, t.term_idx); });
+
+  std::pmr::vector<FoldedHit> hits{ resource };
+  for (auto const group: folded | std::views::chunk_by([](FoldedTerm const& a, FoldedTerm const& b) {
+                           return a.folded == b.folded;
+                         })) {
+    auto const& query = group.front().folded;
+    agent.set_query(query.c_str(), query.length());
+    while (m_trie.common_prefix_search(agent)) {
+      for (std::string_view const word: split_key_entries(m_surfaces->at(agent.key().id()))) {
+        // Keep only spellings that the unfolded lookup would have found.
+        // The group is sorted by term index, so the first match is the earliest term.
+        if (auto const match = std::ranges::find_if(
+              group, [&](FoldedTerm const& t) { return terms[t.term_idx].starts_with(word); }
+            );
+            match != std::ranges::end(group)) {
+          hits.emplace_back(match->term_idx, word);
+        }
+      }
+    }
+  }
+
+  // Restore the order of the plain search: by term, then from shorter to longer words.
+  std::ranges::sort(hits, [](FoldedHit const& a, FoldedHit const& b) {
+    return std::pair{ a.term_idx, a.word.length() } < std::pair{ b.term_idx, b.word.length() };
+  });
+  std::pmr::vector<std::string_view> result{ resource };
+  result.reserve(hits.size());
+  std::ranges::copy(hits | std::views::transform(&FoldedHit::word), std::back_inserter(result));
+  return result;
+}
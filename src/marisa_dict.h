@@ -0,0 +1,140 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "precompiled.h"
+
+enum class TrieLoadMode { mmap, read };
+
+inline constexpr std::string_view surfaces_file_ext = ".surfaces";
+inline constexpr std::string_view forms_file_ext = ".forms";
+inline constexpr std::string_view ranks_file_ext = ".ranks";
+inline constexpr uint32_t unranked = std::numeric_limits<uint32_t>::max();
+inline constexpr std::string_view entries_file_ext = ".entries";
+inline constexpr char form_rules_sep = '\t';
+
+auto load_trie(marisa::Trie& trie, std::filesystem::path const& path, TrieLoadMode mode) -> void;
+auto kana_fold(std::string_view str) -> std::string;
+auto forms_path(std::filesystem::path const& dic_path) -> std::filesystem::path;
+auto ranks_path(std::filesystem::path const& dic_path) -> std::filesystem::path;
+
+// Maps key IDs of a trie to lists of strings.
+// File layout (native byte order):
+//   magic (8 bytes), n_keys (uint32), offsets (uint32 * (n_keys + 1)), blob.
+// Strings of key N are stored in blob[offsets[N], offsets[N + 1]) and separated by '\0'.
+class KeyTable
+{
+public:
+  explicit KeyTable(std::filesystem::path const& path);
+
+  auto size() const noexcept -> std::size_t { return m_n_keys; }
+  auto at(std::size_t key_id) const -> std::string_view;
+
+  static void write(std::filesystem::path const& path, std::span<std::vector<std::string> const> entries);
+
+private:
+  auto read_u32(std::size_t pos) const noexcept -> uint32_t;
+
+  MappedFile m_file;
+  std::size_t m_n_keys{ 0 };
+};
+
+// Frequency ranks of trie keys, 0 is the most frequent. Keys missing from the frequency list are `unranked`.
+// File layout (native byte order): magic (8 bytes), n_keys (uint32), ranks (uint32 * n_keys).
+class RankTable
+{
+public:
+  explicit RankTable(std::filesystem::path const& path);
+
+  auto size() const noexcept -> std::size_t { return m_n_keys; }
+  auto at(std::size_t key_id) const -> uint32_t;
+
+  static void write(std::filesystem::path const& path, std::span<uint32_t const> ranks);
+
+private:
+  MappedFile m_file;
+  std::size_t m_n_keys{ 0 };
+};
+
+constexpr auto split_key_entries(std::string_view const entries)
+{
+  return entries //
+         | std::views::split('\0') //
+         | std::views::transform([](auto const& sub_view) { return std::string_view{ sub_view }; });
+}
+
+// A conjugated form of a dictionary word.
+struct InflectedForm
+{
+  std::string_view surface; // as it appears in the text
+  std::string_view dictionary_form;
+  std::string_view rules; // e.g. "polite, past"
+};
+
+// Conjugated forms of the words of a dictionary, made with `gd-tools marisa-build --forms yes`.
+// Surface forms are stored in a trie (PATH.forms),
+// and each of them maps to "dictionary form\trules" entries in a key table (PATH.forms.entries).
+class FormsIndex
+{
+public:
+  FormsIndex(std::filesystem::path const& path, TrieLoadMode mode);
+
+  // Find conjugated forms that the text starts with, shorter first.
+  // Returned views point into `text` or into the mapped index.
+  auto common_prefix_search(
+    marisa::Agent& agent,
+    std::string_view text,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+  ) const -> std::pmr::vector<InflectedForm>;
+
+  static void write(std::filesystem::path const& path, std::map<std::string, std::vector<std::string>> const& forms);
+
+private:
+  marisa::Trie m_trie{};
+  KeyTable m_entries;
+};
+
+// A word list.
+// It's either a plain trie made with marisa-build,
+// or a kana-folded trie made with `gd-tools marisa-build` with a table of original spellings stored next to it.
+class MarisaDict
+{
+public:
+  MarisaDict(std::filesystem::path const& path, TrieLoadMode mode);
+
+  // Shown next to words found in this dictionary when several are searched together.
+  auto name() const noexcept -> std::string_view { return m_name; }
+  auto is_folded() const noexcept -> bool { return m_surfaces.has_value(); }
+  auto forms() const noexcept -> FormsIndex const* { return m_forms ? &*m_forms : nullptr; }
+  auto has_ranks() const noexcept -> bool { return m_ranks.has_value(); }
+  auto size() const noexcept -> std::size_t { return m_trie.num_keys(); }
+
+  // ID of the trie key that holds the word.
+  auto key_id(marisa::Agent& agent, std::string_view word) const -> std::optional<std::size_t>;
+  // Frequency rank of the word, `unranked` if the dictionary has no ranks.
+  auto rank(marisa::Agent& agent, std::string_view word) const -> uint32_t;
+
+  // Every word of the dictionary, with original spellings if the trie is kana-folded.
+  auto words() const -> std::vector<std::string>;
+
+  // Find dictionary words that any of the terms start with.
+  // Words are returned in the order that plain `common_prefix_search` calls on each term would return them.
+  // Returned views point into `terms` or into the mapped dictionary.
+  auto common_prefix_search(
+    marisa::Agent& agent,
+    std::span<std::string_view const> terms,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+  ) const -> std::pmr::vector<std::string_view>;
+
+private:
+  auto folded_prefix_search(
+    marisa::Agent& agent,
+    std::span<std::string_view const> terms,
+    std::pmr::memory_resource* resource
+  ) const -> std::pmr::vector<std::string_view>;
+
+  std::string m_name;
+  marisa::Trie m_trie{};
+  std::optional<KeyTable> m_surfaces{};
+  std::optional<FormsIndex> m_forms{};
+  std::optional<RankTable> m_ranks{};
+};
@@ -16,8 +16,15 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "marisa_split.h"
 #include "kana_conv.h"
+#include "mapped_file.h"
+#include "marisa_dict.h"
+#include "normalize.h"
 #include "precompiled.h"
+#include "prefetch.h"
+#include "resources.h"
+#include "segment_cache.h"
 #include "util.h"
 
 using namespace std::string_literals;
@@ -29,10 +36,42 @@ Split sentence using MARISA and print links to each word.
 OPTIONS
   --word WORD          required word
   --sentence SENTENCE  required sentence
-  --path-to-dic        optional path to words.dic
+  --path-to-dic        optional path to words.dic. Can be repeated to search several word lists,
+                       the first one has the highest priority.
+  --extra-dics yes     optional. Without --path-to-dic, also search the word lists
+                       in ~/.local/share/gd-tools/marisa_dicts/ after the main one.
+  --load-mode MODE     optional. "mmap" (default) shares the dictionary between processes,
+                       "read" copies it into memory.
+  --deinflect MODE     optional. "index" (default) uses conjugated forms built by
+                       `gd-tools marisa-build --forms yes`, or deinflects every part of the sentence
+                       if a word list has no forms. "runtime" always deinflects.
+  --top-k N            optional. Show only N most frequent alternatives per position (default 10, 0 shows all).
+                       Applies to word lists built with `gd-tools marisa-build --freq`.
+  --resolve-only yes   optional. Print where the word lists were found and how long it took, then exit.
+  --cache yes|no       optional. Reuse the segmentation of a sentence that was looked up before (default yes).
+                       `gd-tools segment-cache` shows how often it helps.
+  --prefetch SPEC      optional. Look up the other words of the sentence in the background, so that
+                       the action answers at once when they're clicked. SPEC is the action with the options
+                       of its GoldenDict entry, without --word, e.g. "images --max-time 5".
+                       Can be repeated. See `gd-tools prefetch --help`.
 
 EXAMPLES
 gd-marisa --word %GDWORD% --sentence %GDSEARCH%
+gd-marisa --word %GDWORD% --sentence %GDSEARCH% --path-to-dic words.dic --path-to-dic names.dic
+gd-marisa --word %GDWORD% --sentence %GDSEARCH% --prefetch massif --prefetch images
+)EOF";
+static constexpr std::string_view warmup_help_text = R"EOF(usage: gd-tools marisa-warmup [OPTIONS]
+
+Pre-fault the pages of the word list into the page cache,
+so that the first lookup after login doesn't have to wait for disk I/O.
+
+OPTIONS
+  --path-to-dic        optional path to words.dic. Can be repeated.
+  --extra-dics yes     optional. Also warm up the word lists in ~/.local/share/gd-tools/marisa_dicts/.
+
+EXAMPLES
+gd-tools marisa-warmup
+gd-tools marisa-warmup --path-to-dic ~/.local/share/gd-tools/marisa_words.dic
 )EOF";
 static constexpr std::string_view css_style = R"EOF(
 <style>
@@ -82,28 +121,66 @@ static constexpr std::string_view css_style = R"EOF(
   }
 </style>
 )EOF";
-static constexpr std::size_t max_forward_search_len_bytes{ CharByteLen::THREE * 20UL };
+
+static constexpr std::size_t lookup_arena_size{ 32UL * 1024UL };
 
 auto find_dic_file() -> std::filesystem::path
 {
-  static auto const locations = {
-    // possible .dic locations
-    std::filesystem::path("/usr/share/gd-tools/marisa_words.dic"),
-    user_home() / ".local/share/gd-tools/marisa_words.dic",
-  };
-  for (auto const& location: locations) {
-    if (std::filesystem::exists(location) and std::filesystem::is_regular_file(location)) {
-      return location;
+  auto const path = resolve_resource({
+    .file_name = "marisa_words.dic",
+    .dirs = { "/usr/share/gd-tools", user_home() / ".local/share/gd-tools" },
+    .recursive = false,
+  });
+  raise_if(path.empty(), "Couldn't find the word list.");
+  return path;
+}
+
+auto find_dic_files(bool const with_extra_dics) -> std::vector<std::filesystem::path>
+{
+  std::vector<std::filesystem::path> result{ find_dic_file() };
+  if (not with_extra_dics) {
+    return result;
+  }
+  // A missing or unreadable directory, or one removed while it's read, just has no extra word lists.
+  std::vector<std::filesystem::path> extra{};
+  std::error_code ec{};
+  auto const extra_dir = user_home() / ".local/share/gd-tools/marisa_dicts";
+  for (auto it = std::filesystem::directory_iterator{ extra_dir, ec };
+       not ec and it != std::filesystem::directory_iterator{};
+       it.increment(ec)) {
+    if (it->is_regular_file(ec) and it->path().extension() == ".dic") {
+      extra.push_back(it->path());
     }
   }
-  throw gd::runtime_error("Couldn't find the word list.");
+  std::ranges::sort(extra);
+  result.insert(result.end(), extra.begin(), extra.end());
+  return result;
+}
+
+auto cached_dict(std::filesystem::path const& path, TrieLoadMode const mode) -> MarisaDict const&
+{
+  // marisa::Trie can't be moved, so the dictionaries are kept behind pointers.
+  static std::mutex mutex{};
+  static std::map<std::pair<std::filesystem::path, TrieLoadMode>, std::unique_ptr<MarisaDict const>> loaded{};
+  std::scoped_lock const lock{ mutex };
+  auto& dict = loaded[{ path, mode }];
+  if (dict == nullptr) {
+    dict = std::make_unique<MarisaDict const>(path, mode);
+  }
+  return *dict;
 }
 
 struct marisa_params
 {
   std::string gd_word{};
   std::string gd_sentence{};
-  std::string path_to_dic{ find_dic_file() };
+  std::vector<std::string> paths_to_dic{};
+  TrieLoadMode load_mode{ TrieLoadMode::mmap };
+  LatticeOptions lattice{};
+  bool extra_dics{ false };
+  bool resolve_only{ false };
+  bool cache{ true };
+  std::vector<std::string> prefetch{};
 
   auto assign(std::string_view const key, std::string_view const value) -> void
   {
@@ -111,94 +188,346 @@ struct marisa_params
       gd_word = value;
     } else if (key == "--sentence") {
       gd_sentence = value;
+    } else if (key == "--prefetch") {
+      prefetch.emplace_back(value);
     } else if (key == "--path-to-dic") {
-      path_to_dic = value;
+      paths_to_dic.emplace_back(value);
+    } else if (key == "--extra-dics") {
+      extra_dics = (value == "yes");
+    } else if (key == "--load-mode") {
+      raise_if(value != "mmap" and value != "read", std::format("Unknown load mode: {}", value));
+      load_mode = (value == "read" ? TrieLoadMode::read : TrieLoadMode::mmap);
+    } else if (key == "--deinflect") {
+      raise_if(value != "index" and value != "runtime", std::format("Unknown deinflect mode: {}", value));
+      lattice.deinflect = (value == "runtime" ? DeinflectMode::runtime : DeinflectMode::index);
+    } else if (key == "--top-k") {
+      auto const top_k = parse_number<std::size_t>(value);
+      raise_if(not top_k.has_value(), std::format("Unknown value of --top-k: {}", value));
+      lattice.top_k = *top_k;
+    } else if (key == "--resolve-only") {
+      resolve_only = (value == "yes");
+    } else if (key == "--cache") {
+      cache = (value != "no");
+    }
+  }
+};
+
+struct marisa_warmup_params
+{
+  std::vector<std::string> paths_to_dic{};
+  bool extra_dics{ false };
+
+  auto assign(std::string_view const key, std::string_view const value) -> void
+  {
+    if (key == "--path-to-dic") {
+      paths_to_dic.emplace_back(value);
+    } else if (key == "--extra-dics") {
+      extra_dics = (value == "yes");
     }
   }
 };
 
-auto cmp_len(std::string_view a, std::string_view b) -> bool
+auto headword_score(RankedWord const& word) -> double
 {
-  return a.length() < b.length();
+  double const weight = (word.rank == unranked ? 1.0 : 1.0 + 1.0 / (1.0 + std::log10(1.0 + word.rank)));
+  return static_cast<double>(word.word.length()) * weight;
 }
 
-struct Deinflected
+auto keep_top_k(std::span<RankedWord const> const words, std::size_t const k, std::pmr::memory_resource* const resource)
+  -> std::pmr::vector<RankedWord>
 {
-  std::string_view from;
-  std::vector<Deinflection> to;
+  // More frequent first, longer first among equally frequent words.
+  auto const is_better = [](RankedWord const& a, RankedWord const& b) {
+    return std::pair{ a.rank, b.word.length() } < std::pair{ b.rank, a.word.length() };
+  };
+  // The worst of the kept words is on top of the heap.
+  std::pmr::vector<RankedWord> heap{ resource };
+  heap.reserve(k);
+  for (auto const& word: words) {
+    if (heap.size() < k) {
+      heap.push_back(word);
+      std::ranges::push_heap(heap, is_better);
+    } else if (k > 0 and is_better(word, heap.front())) {
+      std::ranges::pop_heap(heap, is_better);
+      heap.back() = word;
+      std::ranges::push_heap(heap, is_better);
+    }
+  }
+  return heap;
+}
+
+template<Direction D>
+auto arena_kana_variant(std::string_view const str, std::pmr::memory_resource* const resource) -> std::string_view
+{
+  auto* const buffer = static_cast<char*>(resource->allocate(str.size(), alignof(char)));
+  std::ranges::copy(str, buffer);
+  convert_kana_in_place<D>({ buffer, str.size() });
+  return { buffer, str.size() };
+}
+
+struct WordSource
+{
+  std::string_view word;
+  std::size_t dict_idx;
 };
 
-auto find_deinflections_starting_with(std::string_view const search_str) -> std::vector<Deinflected>
+auto build_lattice(
+  marisa::Agent& agent,
+  std::span<MarisaDict const* const> const dicts,
+  Utf8Index const& chars,
+  LatticeOptions const& options,
+  std::pmr::memory_resource* const resource
+) -> Lattice
 {
-  std::vector<Deinflected> hits;
-  // loop from larger towards shorter substrings
-  for (std::string_view substr: enum_unicode_chars(search_str) //
-                                  | std::views::reverse
-                                  | std::views::transform( //
-                                    [&search_str](Utf8CharView const ch) { //
-                                      return search_str.substr(0UL, ch.idx + ch.ch.size());
-                                    }
-                                  )) {
-    hits.emplace_back(substr, deinflect(substr));
+  // Kana conversion keeps byte lengths, so a span has the same offsets in every variant of the sentence.
+  auto const variants = std::array{
+    chars.text(),
+    arena_kana_variant<Direction::hira_to_kata>(chars.text(), resource),
+    arena_kana_variant<Direction::kata_to_hira>(chars.text(), resource),
+  };
+
+  Lattice lattice{
+    .nodes = std::pmr::vector<LatticeNode>{ resource },
+    .deinflections = std::pmr::unordered_map<std::string_view, std::vector<Deinflection>>{ resource },
+    .forms = std::pmr::vector<InflectedForm>{ resource },
+  };
+  lattice.nodes.reserve(chars.size());
+
+  // The same span often appears in several variants (kanji, or kana that's already in the right script).
+  auto const deinflect_once = [&lattice](std::string_view const span) -> std::vector<Deinflection> const& {
+    auto it = lattice.deinflections.find(span);
+    if (it == lattice.deinflections.end()) {
+      it = lattice.deinflections.emplace(span, deinflect(span)).first;
+    }
+    return it->second;
+  };
+
+  // Runtime deinflection stays as the fallback for dictionaries without conjugated forms.
+  bool const use_forms = options.deinflect == DeinflectMode::index
+                         and std::ranges::all_of(dicts, [](MarisaDict const* dict) { return dict->forms() != nullptr; });
+  bool const has_ranks = std::ranges::any_of(dicts, &MarisaDict::has_ranks);
+
+  std::pmr::vector<std::string_view> terms{ resource };
+  std::pmr::vector<WordSource> found{ resource };
+  std::pmr::vector<RankedWord> ranked{ resource };
+  for (std::size_t start = 0; start < chars.size(); ++start) {
+    auto const start_idx = chars.byte_offset(start);
+    auto const span_end = [&chars](std::size_t const end) { return chars.byte_offset(end + 1); };
+    std::size_t last = start;
+    while (last + 1 < chars.size() and span_end(last + 1) - start_idx <= max_forward_search_len_bytes) { ++last; }
+
+    // Words that are prefixes of an already collected term will be found by its query anyway.
+    terms.clear();
+    auto const add_term = [&terms](std::string_view const term) {
+      if (std::ranges::none_of(terms, [term](std::string_view const t) { return t.starts_with(term); })) {
+        terms.emplace_back(term);
+      }
+    };
+    for (std::string_view const variant: variants) {
+      if (use_forms) {
+        // One query per dictionary finds the conjugated forms of every span.
+        auto const window = variant.substr(start_idx, span_end(last) - start_idx);
+        add_term(window);
+        for (auto const* const dict: dicts) {
+          for (auto const& form: dict->forms()->common_prefix_search(agent, window, resource) | std::views::reverse) {
+            add_term(form.dictionary_form);
+            lattice.forms.push_back(form);
+          }
+        }
+        continue;
+      }
+      // loop from larger towards shorter spans
+      for (std::size_t end = last + 1; end-- > start;) {
+        for (auto const& deinflection: deinflect_once(variant.substr(start_idx, span_end(end) - start_idx))) {
+          add_term(deinflection.term);
+        }
+      }
+    }
+
+    // Every dictionary is searched with the same terms.
+    // A word found in several dictionaries keeps the spelling and the source of the first one.
+    JpSet words{ resource };
+    found.clear();
+    for (auto const [dict_idx, dict]: std::views::enumerate(dicts)) {
+      for (std::string_view const word: dict->common_prefix_search(agent, terms, resource)) {
+        if (words.emplace(word)) {
+          found.emplace_back(word, static_cast<std::size_t>(dict_idx));
+        }
+      }
+    }
+    auto const source_of = [&found](std::string_view const word) {
+      return std::ranges::find(found, word, &WordSource::word)->dict_idx;
+    };
+
+    ranked.clear();
+    for (std::string_view const word: words) { ranked.emplace_back(word, dicts[source_of(word)]->rank(agent, word)); }
+    auto const headword = (ranked.empty() ? std::string_view{} : std::ranges::max(ranked, {}, headword_score).word);
+    if (has_ranks and options.top_k > 0 and words.size() > options.top_k) {
+      JpSet top{ resource };
+      for (auto const& kept: keep_top_k(ranked, options.top_k, resource)) { top.emplace(kept.word); }
+      words = std::move(top);
+    }
+    std::pmr::vector<std::size_t> sources{ resource };
+    sources.reserve(words.size());
+    for (std::string_view const word: words) { sources.push_back(source_of(word)); }
+    lattice.nodes.emplace_back(chars[start].ch, std::move(words), headword, std::move(sources));
   }
-  return hits;
+  return lattice;
+}
+
+auto build_lattice(
+  marisa::Agent& agent,
+  std::span<MarisaDict const* const> const dicts,
+  std::string_view const sentence,
+  LatticeOptions const& options,
+  std::pmr::memory_resource* const resource
+) -> Lattice
+{
+  return build_lattice(agent, dicts, Utf8Index{ sentence, resource }, options, resource);
+}
+
+auto build_lattice(
+  marisa::Agent& agent,
+  MarisaDict const& dict,
+  std::string_view const sentence,
+  LatticeOptions const& options,
+  std::pmr::memory_resource* const resource
+) -> Lattice
+{
+  auto const dicts = std::array{ &dict };
+  return build_lattice(agent, dicts, sentence, options, resource);
 }
 
-auto find_keywords_starting_with(marisa::Agent& agent, marisa::Trie const& trie, std::string const& search_str) -> JpSet
+// Everything gd-marisa prints apart from the highlight. This is what the segment cache stores.
+struct SegmentedWord
+{
+  std::string_view word;
+  std::size_t source; // index in `dict_names`
+};
+
+struct SegmentedNode
+{
+  std::string_view uni_char;
+  std::string_view headword;
+  std::vector<SegmentedWord> words;
+};
+
+struct Segmentation
 {
-  JpSet results{};
-  auto const variants = { search_str, hiragana_to_katakana(search_str), katakana_to_hiragana(search_str) };
+  std::vector<std::string_view> dict_names; // in the order of priority
+  std::vector<SegmentedNode> nodes;
+};
 
-  auto deinflections = std::views::all(variants) //
-                       | std::views::transform(find_deinflections_starting_with) //
-                       | std::views::join //
-                       | std::views::transform([](Deinflected const& group) { return group.to; }) //
-                       | std::views::join;
+auto encode_lattice(Lattice const& lattice, std::span<MarisaDict const* const> const dicts) -> std::string
+{
+  std::string bytes{};
+  append_u32(bytes, dicts.size());
+  for (auto const* const dict: dicts) { append_str(bytes, dict->name()); }
+  append_u32(bytes, lattice.nodes.size());
+  for (auto const& node: lattice.nodes) {
+    append_str(bytes, node.uni_char);
+    append_str(bytes, node.headword);
+    append_u32(bytes, node.words.size());
+    for (auto const& [word, source]: std::views::zip(node.words, node.sources)) {
+      append_str(bytes, word);
+      append_u32(bytes, source);
+    }
+  }
+  return bytes;
+}
 
-  for (auto const& deinflection: deinflections) {
-    agent.set_query(deinflection.term.c_str());
-    while (trie.common_prefix_search(agent)) { //
-      results.emplace(agent.key().ptr(), agent.key().length());
+auto decode_segmentation(std::string_view const bytes) -> Segmentation
+{
+  ByteReader reader{ bytes };
+  Segmentation result{};
+  result.dict_names.resize(reader.count(sizeof(uint32_t)));
+  for (auto& name: result.dict_names) { name = reader.str(); }
+  result.nodes.resize(reader.count(3 * sizeof(uint32_t)));
+  for (auto& node: result.nodes) {
+    node.uni_char = reader.str();
+    node.headword = reader.str();
+    node.words.resize(reader.count(2 * sizeof(uint32_t)));
+    for (auto& word: node.words) {
+      word.word = reader.str();
+      word.source = reader.u32();
     }
   }
+  return result;
+}
 
-  return results;
+auto segment_cache_key(marisa_params const& params) -> std::string
+{
+  // Rebuilt word lists and different options must not match old entries.
+  std::string key{ std::format(
+    "marisa\n{} {}",
+    (params.lattice.deinflect == DeinflectMode::index ? "index" : "runtime"),
+    params.lattice.top_k
+  ) };
+  for (auto const& path: params.paths_to_dic) {
+    for (auto const& file: { std::filesystem::path{ path }, forms_path(path), ranks_path(path) }) {
+      key.append("\n").append(file_identity(file));
+    }
+  }
+  key.append("\n").append(params.gd_sentence);
+  return key;
 }
 
-void lookup_words(marisa_params params)
+auto segment_sentence(marisa_params const& params) -> std::string
 {
-  half_to_full(params.gd_word);
-  std::erase_if(params.gd_word, is_space);
-  std::erase_if(params.gd_sentence, is_space);
+  std::vector<MarisaDict const*> by_priority{};
+  for (auto const& path: params.paths_to_dic) { by_priority.push_back(&cached_dict(path, params.load_mode)); }
+  marisa::Agent agent;
+
+  // Everything the lookup allocates dies together, so it's taken from one arena.
+  std::array<std::byte, lookup_arena_size> arena_buffer;
+  std::pmr::monotonic_buffer_resource arena{ arena_buffer.data(), arena_buffer.size() };
+  Utf8Index const sentence{ params.gd_sentence, &arena };
+  return encode_lattice(build_lattice(agent, by_priority, sentence, params.lattice, &arena), by_priority);
+}
 
+void lookup_words(marisa_params params, std::ostream& out)
+{
+  normalize(params.gd_word);
+  normalize(params.gd_sentence);
   if (params.gd_sentence.empty()) {
     params.gd_sentence = params.gd_word;
-  } else {
-    half_to_full(params.gd_sentence);
   }
 
-  marisa::Trie trie;
-  marisa::Agent agent;
+  auto const resolve_start = std::chrono::steady_clock::now();
+  if (params.paths_to_dic.empty()) {
+    for (auto const& path: find_dic_files(params.extra_dics)) { params.paths_to_dic.push_back(path.string()); }
+  }
+  if (params.resolve_only) {
+    std::vector<std::pair<std::string, std::filesystem::path>> resolved{};
+    for (auto const& path: params.paths_to_dic) { resolved.emplace_back("dic", path); }
+    return print_resolved(out, resolved, std::chrono::steady_clock::now() - resolve_start);
+  }
 
-  std::ifstream file{ params.path_to_dic };
-  raise_if(not file.good(), std::format(R"(Error. The dictionary file "{}" does not exist.)", params.path_to_dic));
-  trie.load(params.path_to_dic.c_str());
+  // Clicking through a sentence only changes the word, so the dictionaries aren't even loaded on a hit.
+  auto* const cache = (params.cache ? segment_cache() : nullptr);
+  auto const cache_key = (cache != nullptr ? segment_cache_key(params) : std::string{});
+  std::string segments{};
+  auto const segmentation = [&]() -> Segmentation {
+    if (cache != nullptr and cache->find(cache_key, segments)) {
+      try {
+        return decode_segmentation(segments);
+      } catch (gd::corrupted_cache_entry const&) {
+        // Segmented again below, and the entry is overwritten.
+      }
+    }
+    segments = segment_sentence(params);
+    if (cache != nullptr) {
+      cache->insert(cache_key, segments);
+    }
+    return decode_segmentation(segments);
+  }();
 
-  std::println(R"(<div class="gd-marisa">)");
+  std::println(out, R"(<div class="gd-marisa">)");
   std::ptrdiff_t pos_in_gd_word{ 0 };
-  std::vector<JpSet> alternatives{};
-  alternatives.reserve(20);
-
-  // Link longest words starting with each position in sentence.
-  for (auto const [idx, uni_char]: enum_unicode_chars(params.gd_sentence)) {
-    auto const headwords{ find_keywords_starting_with(
-      agent,
-      trie, //
-      params.gd_sentence.substr(idx, max_forward_search_len_bytes)
-    ) };
-
-    // set bword to the longest found key in the trie.
-    std::string const bword{ headwords.empty() ? std::string{ uni_char } : std::ranges::max(headwords, cmp_len) };
+
+  // Link the headword starting with each position in sentence.
+  for (auto const& [uni_char, headword, words]: segmentation.nodes) {
+    std::string_view const bword{ headword.empty() ? uni_char : headword };
     if (params.gd_word == bword) {
       pos_in_gd_word = static_cast<std::ptrdiff_t>(bword.length());
     } else {
@@ -206,41 +535,87 @@ void lookup_words(marisa_params params)
     }
 
     std::print(
+      out,
       R"(<a class="{}" href="bword:{}">{}</a>)",
       (pos_in_gd_word > 0 ? "gd-headword" : "gd-word"),
       bword,
       uni_char
     );
-    alternatives.push_back(headwords);
-  }
-
-  // Show available entries for other substrings.
-  std::println(R"(<div class="alternatives">)");
-  for (auto const& group: alternatives | std::views::filter(&JpSet::size)) {
-    std::println("<ul>");
-    for (auto const& word: group) {
-      std::println(
-        R"(<li><a class="{}" href="bword:{}">{}</a></li>)",
-        (word == params.gd_word ? "gd-headword" : ""),
-        word,
-        word
-      );
+  }
+
+  // Show available entries for other substrings, grouped by dictionary in the order of priority.
+  // The markup only names the word list of a link when there's more than one.
+  bool const several_dicts = segmentation.dict_names.size() > 1;
+  std::println(out, R"(<div class="alternatives">)");
+  auto const has_words = [](SegmentedNode const& n) { return not n.words.empty(); };
+  for (auto const& node: segmentation.nodes | std::views::filter(has_words)) {
+    std::println(out, "<ul>");
+    for (auto const [dict_idx, dict_name]: std::views::enumerate(segmentation.dict_names)) {
+      for (auto const& [word, source]: node.words) {
+        if (source != static_cast<std::size_t>(dict_idx)) {
+          continue;
+        }
+        std::println(
+          out,
+          R"(<li><a class="{}" href="bword:{}"{}>{}</a></li>)",
+          (word == params.gd_word ? "gd-headword" : ""),
+          word,
+          (several_dicts ? std::format(R"( data-dic="{}")", dict_name) : ""),
+          word
+        );
+      }
     }
-    std::println("</ul>"); // close ul
+    std::println(out, "</ul>"); // close ul
+  }
+  std::println(out, "</div>"); // close div.alternatives
+
+  std::println(out, "</div>"); // close div.gd-marisa
+  std::println(out, "{}", css_style);
+
+  if (not params.prefetch.empty()) {
+    auto const headwords = segmentation.nodes //
+                           | std::views::transform(&SegmentedNode::headword)
+                           | std::ranges::to<std::vector>();
+    start_prefetch(params.prefetch, params.gd_sentence, prefetch_order(headwords, params.gd_word));
   }
-  std::println("</div>"); // close div.alternatives
+}
+
+void marisa_split(std::span<std::string_view const> const args, std::ostream& out)
+{
+  try {
+    lookup_words(fill_args<marisa_params>(args), out);
+  } catch (gd::help_requested const& ex) {
+    std::println(out, help_text);
+  } catch (gd::runtime_error const& ex) {
+    std::println(out, "{}", ex.what());
+  }
+}
 
-  std::println("</div>"); // close div.gd-marisa
-  std::println("{}", css_style);
+void warmup_dic(marisa_warmup_params params, std::ostream& out)
+{
+  if (params.paths_to_dic.empty()) {
+    for (auto const& path: find_dic_files(params.extra_dics)) { params.paths_to_dic.push_back(path.string()); }
+  }
+  for (auto const& path: params.paths_to_dic) {
+    raise_if(
+      not std::filesystem::is_regular_file(path),
+      std::format(R"(Error. The dictionary file "{}" does not exist.)", path)
+    );
+    auto const start = std::chrono::steady_clock::now();
+    auto const n_pages = MappedFile{ path }.prefault();
+    auto const elapsed =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    std::println(out, "Warmed up {}: {} pages in {}.", path, n_pages, elapsed);
+  }
 }
 
-void marisa_split(std::span<std::string_view const> const args)
+void marisa_warmup(std::span<std::string_view const> const args, std::ostream& out)
 {
   try {
-    lookup_words(fill_args<marisa_params>(args));
+    warmup_dic(fill_args<marisa_warmup_params>(args), out);
   } catch (gd::help_requested const& ex) {
-    std::println(help_text);
+    std::print(out, warmup_help_text);
   } catch (gd::runtime_error const& ex) {
-    std::println("{}", ex.what());
+    std::println(out, "{}", ex.what());
   }
 }
@@ -1,5 +1,88 @@
 #pragma once
 
+#include "kana_conv.h"
+#include "marisa_dict.h"
 #include "precompiled.h"
+#include "utf8_index.h"
 
-auto marisa_split(std::span<std::string_view const> const args) -> void;
+inline constexpr std::size_t max_forward_search_len_bytes{ CharByteLen::THREE * 20UL };
+
+// Words found in the dictionary that start at one character of the sentence.
+struct LatticeNode
+{
+  std::string_view uni_char;
+  JpSet words;
+  std::string_view headword; // the word to link the character to, empty if there are no words
+  std::pmr::vector<std::size_t> sources; // index of the dictionary of each word, in the order of `words`
+};
+
+struct Lattice
+{
+  std::pmr::vector<LatticeNode> nodes;
+  // Deinflected terms of every span. Words in the nodes may point into them.
+  std::pmr::unordered_map<std::string_view, std::vector<ajt::rdricpp::Deinflection>> deinflections;
+  // Conjugated forms found in the index, with the rule chains the deinflector gave them when the index was built.
+  std::pmr::vector<InflectedForm> forms;
+};
+
+enum class DeinflectMode {
+  index, // look up conjugated forms in the precompiled index, or run the deinflector if a dictionary has none
+  runtime, // run the deinflector on every span
+};
+
+struct LatticeOptions
+{
+  DeinflectMode deinflect{ DeinflectMode::index };
+  // Keep only this many most frequent words per position. Applies to dictionaries with frequency ranks.
+  std::size_t top_k{ 10 };
+};
+
+struct RankedWord
+{
+  std::string_view word;
+  uint32_t rank;
+};
+
+// Longer words win, but frequent words weigh up to twice their length.
+auto headword_score(RankedWord const& word) -> double;
+// The `k` best ranked words, in no particular order.
+auto keep_top_k(
+  std::span<RankedWord const> words,
+  std::size_t k,
+  std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+) -> std::pmr::vector<RankedWord>;
+
+auto find_dic_file() -> std::filesystem::path;
+// The main word list, followed by the word lists in ~/.local/share/gd-tools/marisa_dicts/ if `with_extra_dics`.
+auto find_dic_files(bool with_extra_dics) -> std::vector<std::filesystem::path>;
+
+// Load a dictionary once per process. Later requests, e.g. from `gd-tools batch`, reuse it.
+auto cached_dict(std::filesystem::path const& path, TrieLoadMode mode) -> MarisaDict const&;
+
+// Deinflect every span of the sentence once and search the terms in every dictionary.
+// Spans start and end at grapheme cluster boundaries, see Utf8Index.
+// Dictionaries are ordered by priority: if several have the same word, it's attributed to the first one.
+// Everything is allocated from `resource`, which must outlive the lattice.
+auto build_lattice(
+  marisa::Agent& agent,
+  std::span<MarisaDict const* const> dicts,
+  Utf8Index const& sentence,
+  LatticeOptions const& options = {},
+  std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+) -> Lattice;
+auto build_lattice(
+  marisa::Agent& agent,
+  std::span<MarisaDict const* const> dicts,
+  std::string_view sentence,
+  LatticeOptions const& options = {},
+  std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+) -> Lattice;
+auto build_lattice(
+  marisa::Agent& agent,
+  MarisaDict const& dict,
+  std::string_view sentence,
+  LatticeOptions const& options = {},
+  std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+) -> Lattice;
+auto marisa_split(std::span<std::string_view const> const args, std::ostream& out = std::cout) -> void;
+auto marisa_warmup(std::span<std::string_view const> const args, std::ostream& out = std::cout) -> void;
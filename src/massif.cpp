@@ -71,15 +71,16 @@ struct massif_params
   }
 };
 
-void fetch_massif_examples(massif_params const& params)
+void fetch_massif_examples(massif_params const& params, std::ostream& out)
 {
-  cpr::Response const r = cpr::Get(
-    cpr::Url{ std::format("https://massif.la/ja/search?q={}", params.gd_word) },
-    cpr::Timeout{ params.max_time },
-    cpr::VerifySsl{ false }
-  );
+  // Reused by the next request of `gd-tools batch`, so the TLS handshake is done once.
+  thread_local cpr::Session session{};
+  session.SetUrl(cpr::Url{ std::format("https://massif.la/ja/search?q={}", params.gd_word) });
+  session.SetTimeout(cpr::Timeout{ params.max_time });
+  session.SetVerifySsl(cpr::VerifySsl{ false });
+  cpr::Response const r = session.Get();
   raise_if(r.status_code != 200, "Couldn't connect to Massif.");
-  std::println("<ul class=\"gd-massif\">");
+  std::println(out, "<ul class=\"gd-massif\">");
   for (auto const& line:
        r.text //
          | std::views::split('\n') //
@@ -88,19 +89,19 @@ void fetch_massif_examples(massif_params const& params)
              return not str_view.contains("<li class=\"text-japanese\">");
            })
          | std::views::take_while([](auto const str_view) { return not str_view.contains("</ul>"); })) {
-    std::println("{}", line);
+    std::println(out, "{}", line);
   }
-  std::println("</ul>");
-  std::println("{}", css_style);
+  std::println(out, "</ul>");
+  std::println(out, "{}", css_style);
 }
 
-void massif(std::span<std::string_view const> const args)
+void massif(std::span<std::string_view const> const args, std::ostream& out)
 {
   try {
-    fetch_massif_examples(fill_args<massif_params>(args));
+    fetch_massif_examples(fill_args<massif_params>(args), out);
   } catch (gd::help_requested const& ex) {
-    std::print(help_text);
+    std::print(out, help_text);
   } catch (gd::runtime_error const& ex) {
-    std::println("{}", ex.what());
+    std::println(out, "{}", ex.what());
   }
 }
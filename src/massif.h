@@ -2,4 +2,4 @@
 
 #include "precompiled.h"
 
-void massif(std::span<std::string_view const> const args);
+void massif(std::span<std::string_view const> const args, std::ostream& out = std::cout);
@@ -0,0 +1,379 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "mecab_batch.h"
+#include "mecab_split.h"
+#include "precompiled.h"
+#include "util.h"
+
+using json = nlohmann::json;
+
+static constexpr double bytes_per_mb{ 1024.0 * 1024.0 };
+static constexpr std::string_view help_text = R"EOF(usage: gd-tools mecab-batch [OPTIONS]
+
+Split every line of large text files into words with MeCab, using all cores.
+The dictionary is loaded once and shared by the worker threads.
+Workers segment chunks of lines while the input is still being read, and results are printed in the original order.
+
+OPTIONS
+  --input FILE        optional. Can be repeated. Reads stdin by default.
+  --output FILE       optional. Print to stdout by default.
+  --threads N         optional number of worker threads. Defaults to the number of cores.
+  --chunk-lines N     optional number of lines a worker takes at once (default 256).
+  --format FORMAT     optional. "wakati" (default) separates words with spaces,
+                      "json" prints {"line": 1, "tokens": [...]} for every line.
+  --user-dict PATH    optional path to the user dictionary.
+  --stats yes|no      optional. Print throughput to stderr when the input ends.
+
+EXAMPLES
+gd-tools mecab-batch --input novel.txt --output novel.wakati.txt
+gd-tools mecab-batch --format json --threads 4 < subtitles.txt
+)EOF";
+
+struct mecab_batch_params
+{
+  std::vector<std::string> inputs{};
+  std::string output{};
+  std::size_t n_threads{ std::max(1U, std::thread::hardware_concurrency()) };
+  std::size_t chunk_lines{ 256 };
+  SegmentFormat format{ SegmentFormat::wakati };
+  std::filesystem::path user_dict{}; // found when the model is loaded
+  std::filesystem::path dic_dir{};
+  bool stats{ false };
+
+  auto assign(std::string_view const key, std::string_view const value) -> void
+  {
+    if (key == "--input") {
+      inputs.emplace_back(value);
+    } else if (key == "--output") {
+      output = value;
+    } else if (key == "--threads") {
+      n_threads = parse_count(value, n_threads);
+    } else if (key == "--chunk-lines") {
+      chunk_lines = parse_count(value, chunk_lines);
+    } else if (key == "--format") {
+      raise_if(value != "wakati" and value != "json", std::format("Unknown format: {}", value));
+      format = (value == "json" ? SegmentFormat::json : SegmentFormat::wakati);
+    } else if (key == "--user-dict") {
+      user_dict = value;
+    } else if (key == "--stats") {
+      stats = (value == "yes");
+    } else {
+      throw gd::runtime_error(std::format("Unknown argument name: {}", key));
+    }
+  }
+};
+
+MecabModel::MecabModel(std::span<std::string const> const options)
+{
+  std::vector<char const*> argv{ "arg0" }; // unused
+  for (auto const& option: options) { argv.push_back(option.c_str()); }
+  m_model.reset(MeCab::createModel(static_cast<int>(argv.size()), const_cast<char**>(argv.data())));
+  raise_if(m_model == nullptr, std::format("Failed to load MeCab model: {}", MeCab::getLastError()));
+  m_tagger.reset(m_model->createTagger());
+  raise_if(m_tagger == nullptr, std::format("Failed to create MeCab tagger: {}", MeCab::getLastError()));
+}
+
+auto MecabModel::create_lattice() const -> std::unique_ptr<MeCab::Lattice>
+{
+  std::unique_ptr<MeCab::Lattice> lattice{ m_model->createLattice() };
+  raise_if(lattice == nullptr, "Failed to create MeCab lattice.");
+  return lattice;
+}
+
+auto MecabModel::segment(
+  MeCab::Lattice& lattice,
+  std::string_view const line,
+  std::size_t const line_number,
+  SegmentFormat const format
+) const -> std::string
+{
+  // The lattice points into `line` instead of copying it.
+  lattice.set_sentence(line.data(), line.size());
+  raise_if(not m_tagger->parse(&lattice), std::format("MeCab failed on line {}: {}", line_number, lattice.what()));
+
+  std::string result{};
+  json tokens = json::array();
+  std::size_t pos = 0;
+  for (auto const* node = lattice.bos_node(); node != nullptr; node = node->next) {
+    if (node->stat == MECAB_BOS_NODE or node->stat == MECAB_EOS_NODE) {
+      continue;
+    }
+    auto const token = make_token(*node, line, pos);
+    pos = token.end;
+    if (format == SegmentFormat::json) {
+      tokens.push_back(token_to_json(token));
+    } else {
+      result.append(result.empty() ? "" : " ").append(token.surface);
+    }
+  }
+  if (format == SegmentFormat::json) {
+    json const object{ { "line", line_number }, { "tokens", std::move(tokens) } };
+    result = object.dump(-1, ' ', false, json::error_handler_t::replace);
+  }
+  return result;
+}
+
+namespace {
+struct LineChunk
+{
+  std::size_t idx; // in the order of reading
+  std::size_t first_line;
+  std::vector<std::string> lines;
+};
+
+// Chunks of lines on their way from the reader through the workers to the output.
+// At most `max_in_flight` chunks are read but not written yet, so memory stays bounded however long the input is.
+class ChunkQueue
+{
+public:
+  explicit ChunkQueue(std::size_t const max_in_flight) : m_max_in_flight(max_in_flight) {}
+
+  // Blocks while the queue is full. False once a worker has failed.
+  auto push(std::vector<std::string> lines, std::size_t const first_line) -> bool
+  {
+    std::unique_lock lock{ m_mutex };
+    m_has_room.wait(lock, [this] { return m_error or m_n_read - m_n_written < m_max_in_flight; });
+    if (m_error) {
+      return false;
+    }
+    m_queued.push_back({ .idx = m_n_read++, .first_line = first_line, .lines = std::move(lines) });
+    m_has_work.notify_one();
+    return true;
+  }
+
+  // No more chunks will be pushed.
+  void close()
+  {
+    std::scoped_lock const lock{ m_mutex };
+    m_closed = true;
+    m_has_work.notify_all();
+  }
+
+  // The next chunk for a worker, or nothing once the input has ended or a worker has failed.
+  auto pop() -> std::optional<LineChunk>
+  {
+    std::unique_lock lock{ m_mutex };
+    m_has_work.wait(lock, [this] { return m_error or m_closed or not m_queued.empty(); });
+    if (m_error or m_queued.empty()) {
+      return std::nullopt;
+    }
+    auto chunk = std::move(m_queued.front());
+    m_queued.pop_front();
+    return chunk;
+  }
+
+  // Keep the results of a chunk, and write every chunk that is next in the order of reading.
+  void finish(std::size_t const idx, std::vector<std::string> results, auto const& write)
+  {
+    std::scoped_lock const lock{ m_mutex };
+    m_done.emplace(idx, std::move(results));
+    for (auto next = m_done.find(m_n_written); next != m_done.end(); next = m_done.find(m_n_written)) {
+      for (auto const& result: next->second) { write(result); }
+      m_done.erase(next);
+      ++m_n_written;
+    }
+    m_has_room.notify_one();
+  }
+
+  // Stop the reader and the other workers.
+  void fail(std::exception_ptr error)
+  {
+    std::scoped_lock const lock{ m_mutex };
+    if (not m_error) {
+      m_error = std::move(error);
+    }
+    m_has_room.notify_all();
+    m_has_work.notify_all();
+  }
+
+  auto error() const -> std::exception_ptr
+  {
+    std::scoped_lock const lock{ m_mutex };
+    return m_error;
+  }
+
+private:
+  std::size_t m_max_in_flight;
+  mutable std::mutex m_mutex{};
+  std::condition_variable m_has_room{};
+  std::condition_variable m_has_work{};
+  std::deque<LineChunk> m_queued{};
+  std::map<std::size_t, std::vector<std::string>> m_done{}; // finished out of order
+  std::size_t m_n_read{ 0 };
+  std::size_t m_n_written{ 0 };
+  bool m_closed{ false };
+  std::exception_ptr m_error{};
+};
+
+// One pool of workers, each with its own lattice, for the whole input.
+// `read_line` is called on this thread, `write_result` on the workers, one at a time and in the order of the lines.
+void segment_stream(
+  MecabModel const& model,
+  SegmentFormat const format,
+  std::size_t const n_threads,
+  std::size_t const chunk_lines,
+  auto&& read_line,
+  auto const& write_result
+)
+{
+  ChunkQueue queue{ 4 * n_threads };
+  auto const work = [&] {
+    try {
+      auto const lattice = model.create_lattice();
+      while (auto chunk = queue.pop()) {
+        std::vector<std::string> results{};
+        results.reserve(chunk->lines.size());
+        for (auto const& line: chunk->lines) {
+          results.push_back(model.segment(*lattice, line, chunk->first_line + results.size(), format));
+        }
+        queue.finish(chunk->idx, std::move(results), write_result);
+      }
+    } catch (...) {
+      queue.fail(std::current_exception());
+    }
+  };
+
+  {
+    std::vector<std::jthread> workers{};
+    for (std::size_t idx = 0; idx < n_threads; ++idx) { workers.emplace_back(work); }
+    std::size_t n_lines = 0;
+    std::vector<std::string> chunk{};
+    auto const push = [&] {
+      auto const first_line = n_lines + 1;
+      n_lines += chunk.size();
+      return queue.push(std::exchange(chunk, {}), first_line);
+    };
+    bool reading = true;
+    for (std::string line; reading and read_line(line);) {
+      chunk.push_back(std::move(line));
+      if (chunk.size() == chunk_lines) {
+        reading = push();
+      }
+    }
+    if (reading and not chunk.empty()) {
+      push();
+    }
+    queue.close();
+  }
+  if (auto const error = queue.error()) {
+    std::rethrow_exception(error);
+  }
+}
+} // namespace
+
+auto segment_lines(
+  MecabModel const& model,
+  std::span<std::string const> const lines,
+  SegmentFormat const format,
+  std::size_t const n_threads
+) -> std::vector<std::string>
+{
+  static constexpr std::size_t chunk_lines{ 256 };
+  std::vector<std::string> results{};
+  results.reserve(lines.size());
+  auto next = lines.begin();
+  segment_stream(
+    model,
+    format,
+    n_threads,
+    chunk_lines,
+    [&](std::string& line) {
+      if (next == lines.end()) {
+        return false;
+      }
+      line = *next++;
+      return true;
+    },
+    [&](std::string_view const result) { results.emplace_back(result); }
+  );
+  return results;
+}
+
+void segment_files(mecab_batch_params params)
+{
+  if (params.dic_dir.empty()) {
+    params.dic_dir = find_dic_dir();
+  }
+  if (params.user_dict.empty()) {
+    params.user_dict = find_user_dict_file();
+  }
+  raise_if((not std::filesystem::is_directory(params.dic_dir)), "Couldn't find dictionary directory.");
+  std::vector<std::string> options{ "--dicdir=" + params.dic_dir.string() };
+  if (std::filesystem::is_regular_file(params.user_dict)) {
+    options.push_back("--userdic=" + params.user_dict.string());
+  }
+  MecabModel const model{ options };
+
+  std::ofstream output_file{};
+  if (not params.output.empty()) {
+    output_file.open(params.output);
+    raise_if(not output_file.good(), std::format(R"(Error. Can't write "{}".)", params.output));
+  }
+  std::ostream& out = params.output.empty() ? std::cout : output_file;
+
+  auto const start = std::chrono::steady_clock::now();
+  std::size_t n_lines = 0;
+  std::size_t n_bytes = 0;
+  std::vector<std::ifstream> files{};
+  for (auto const& input: params.inputs) {
+    raise_if(not files.emplace_back(input).good(), std::format(R"(Error. Can't read "{}".)", input));
+  }
+  auto file = files.begin();
+  auto const read_line = [&](std::string& line) {
+    while (not std::getline(params.inputs.empty() ? std::cin : static_cast<std::istream&>(*file), line)) {
+      if (params.inputs.empty() or ++file == files.end()) {
+        return false;
+      }
+    }
+    ++n_lines;
+    n_bytes += line.size() + 1;
+    if (line.ends_with('\r')) {
+      line.pop_back();
+    }
+    return true;
+  };
+  auto const write_result = [&out](std::string_view const result) { out << result << '\n'; };
+  segment_stream(model, params.format, params.n_threads, params.chunk_lines, read_line, write_result);
+  out.flush();
+
+  auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+  if (params.stats) {
+    std::println(
+      std::cerr,
+      "Segmented {} lines ({:.1f} MB) in {:.3f}s with {} threads: {:.2f} MB/s.",
+      n_lines,
+      static_cast<double>(n_bytes) / bytes_per_mb,
+      elapsed.count(),
+      params.n_threads,
+      static_cast<double>(n_bytes) / bytes_per_mb / std::max(elapsed.count(), 1e-9)
+    );
+  }
+}
+
+void mecab_batch(std::span<std::string_view const> const args)
+{
+  try {
+    segment_files(fill_args<mecab_batch_params>(args));
+  } catch (gd::help_requested const& ex) {
+    std::print("{}", help_text);
+  } catch (gd::runtime_error const& ex) {
+    // Not into the output, which is data.
+    std::println(std::cerr, "{}", ex.what());
+  }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "precompiled.h"
+
+enum class SegmentFormat {
+  wakati, // surfaces separated by spaces, like `mecab -Owakati`
+  json, // one object per line with the tokens of gd-mecab --format json
+};
+
+// One MeCab model shared by all threads.
+// The model and its tagger are thread-safe, a lattice is not, so every worker parses with its own.
+class MecabModel
+{
+public:
+  // Options as passed to the mecab command, e.g. "--dicdir=...".
+  explicit MecabModel(std::span<std::string const> options);
+
+  auto create_lattice() const -> std::unique_ptr<MeCab::Lattice>;
+  auto segment(MeCab::Lattice& lattice, std::string_view line, std::size_t line_number, SegmentFormat format) const
+    -> std::string;
+
+private:
+  std::unique_ptr<MeCab::Model> m_model;
+  std::unique_ptr<MeCab::Tagger> m_tagger;
+};
+
+// Segment every line using `n_threads` workers, the same way `gd-tools mecab-batch` segments a file.
+// Returns one result per line, in the order of `lines`.
+auto segment_lines(
+  MecabModel const& model,
+  std::span<std::string const> lines,
+  SegmentFormat format,
+  std::size_t n_threads
+) -> std::vector<std::string>;
+
+auto mecab_batch(std::span<std::string_view const> args) -> void;
@@ -16,8 +16,13 @@
  *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "mecab_split.h"
 #include "kana_conv.h"
+#include "normalize.h"
 #include "precompiled.h"
+#include "prefetch.h"
+#include "resources.h"
+#include "segment_cache.h"
 #include "util.h"
 
 static constexpr std::string_view css_style = R"EOF(
@@ -65,56 +70,65 @@ OPTIONS
   --word %GDWORD%        required word
   --sentence %GDSEARCH%  required sentence
   --user-dict PATH       path to the user dictionary.
+  --format FORMAT        optional. "html" (default) for GoldenDict,
+                         "json" prints the tokens with their lemma, reading, part of speech and byte offsets.
+  --resolve-only yes     optional. Print where the dictionaries were found and how long it took, then exit.
+  --cache yes|no         optional. Reuse the tokens of a sentence that was looked up before (default yes).
+  --prefetch SPEC        optional. Look up the other words of the sentence in the background, e.g. "massif".
+                         Can be repeated. See `gd-tools prefetch --help`.
 )EOF";
 
-auto find_file_recursive(
-  std::vector<std::filesystem::path> possible_dirs, //
-  std::string_view const file_name
-) -> std::filesystem::path
-{
-  for (size_t idx = 0; idx < possible_dirs.size(); ++idx) {
-    if (!std::filesystem::is_directory(possible_dirs[idx])) {
-      continue;
-    }
-    for (auto const& dir_entry: std::filesystem::directory_iterator(possible_dirs.at(idx))) {
-      if (dir_entry.is_regular_file() and dir_entry.path().filename() == file_name) {
-        return dir_entry.path();
-      } else if (dir_entry.is_directory()) {
-        possible_dirs.push_back(dir_entry);
-      }
-    }
-  }
-  return "";
-}
+using json = nlohmann::json;
+
+enum class MecabFormat {
+  html,
+  json,
+};
+
+// Fields of a node's feature string in IPADIC, e.g. "動詞,自立,*,*,一段,連用形,食べる,タベ,タベ".
+static constexpr std::size_t feature_pos_idx{ 0 };
+static constexpr std::size_t feature_lemma_idx{ 6 };
+static constexpr std::size_t feature_reading_idx{ 7 };
+// Links and markup take roughly this many bytes per byte of the sentence.
+static constexpr std::size_t html_bytes_per_byte{ 12 };
 
 auto find_user_dict_file() -> std::filesystem::path
 {
-  static std::vector<std::filesystem::path> const possible_dirs = {
-    "/usr/share/gd-tools",
-    user_home() / ".local/share/gd-tools",
-    user_home() / ".local/share/Anki2/addons21",
-  };
-  return find_file_recursive(possible_dirs, "user_dic.dic");
+  return resolve_resource({
+    .file_name = "user_dic.dic",
+    .dirs = {
+      "/usr/share/gd-tools",
+      user_home() / ".local/share/gd-tools",
+      user_home() / ".local/share/Anki2/addons21",
+    },
+  });
 }
 
 auto find_dic_dir() -> std::filesystem::path
 {
-  static std::vector<std::filesystem::path> const possible_dirs = {
-    "/usr/lib/mecab/dic/mecab-ipadic-neologd", // neologd is preferred if available
-    "/usr/lib/mecab/dic",
-    "/usr/lib64/mecab/dic",
-    user_home() / ".local/share/Anki2/addons21",
-  };
+  auto const dicrc = resolve_resource({
+    .file_name = "dicrc",
+    .dirs = {
+      "/usr/lib/mecab/dic/mecab-ipadic-neologd", // neologd is preferred if available
+      "/usr/lib/mecab/dic",
+      "/usr/lib64/mecab/dic",
+      user_home() / ".local/share/Anki2/addons21",
+    },
+  });
   // parent path of an empty entry returns itself.
-  return find_file_recursive(possible_dirs, "dicrc").parent_path();
+  return dicrc.parent_path();
 }
 
 struct mecab_params
 {
   std::string gd_word{};
   std::string gd_sentence{};
-  std::filesystem::path user_dict{ find_user_dict_file() };
-  std::filesystem::path dic_dir{ find_dic_dir() };
+  std::filesystem::path user_dict{}; // found when the lookup needs it
+  std::filesystem::path dic_dir{};
+  MecabFormat format{ MecabFormat::html };
+  bool resolve_only{ false };
+  bool cache{ true };
+  std::vector<std::string> prefetch{};
 
   auto assign(std::string_view const key, std::string_view const value) -> void
   {
@@ -124,6 +138,15 @@ struct mecab_params
       gd_sentence = value;
     } else if (key == "--user-dict") {
       user_dict = value;
+    } else if (key == "--format") {
+      raise_if(value != "html" and value != "json", std::format("Unknown format: {}", value));
+      format = (value == "json" ? MecabFormat::json : MecabFormat::html);
+    } else if (key == "--resolve-only") {
+      resolve_only = (value == "yes");
+    } else if (key == "--cache") {
+      cache = (value != "no");
+    } else if (key == "--prefetch") {
+      prefetch.emplace_back(value);
     } else {
       throw gd::runtime_error(std::string(std::format("Unknown argument name: {}", key)));
     }
@@ -140,18 +163,192 @@ auto replace_all(std::string str, std::string_view const from, std::string_view
   return str;
 }
 
-void lookup_words(mecab_params params)
+auto cached_tagger(std::vector<char const*> const& args) -> MeCab::Tagger&
+{
+  // Loading the dictionary takes most of the time, so taggers are kept for the next request.
+  static std::mutex mutex{};
+  static std::map<std::string, std::unique_ptr<MeCab::Tagger>> taggers{};
+  std::scoped_lock const lock{ mutex };
+  auto& tagger = taggers[join_with(args, "\n")];
+  if (tagger == nullptr) {
+    tagger.reset(MeCab::createTagger((int)args.size(), (char**)(args.data())));
+  }
+  if (tagger == nullptr) {
+    throw gd::runtime_error("Failed to initialize Mecab tagger.");
+  }
+  return *tagger;
+}
+
+auto feature_field(std::string_view const feature, std::size_t idx) -> std::string_view
+{
+  for (auto const field: feature | std::views::split(',')) {
+    if (idx-- == 0) {
+      std::string_view const value{ field.begin(), field.end() };
+      return (value == "*" ? std::string_view{} : value);
+    }
+  }
+  return {};
+}
+
+auto make_token(MeCab::Node const& node, std::string_view const sentence, std::size_t const prev_end) -> MecabToken
+{
+  // `rlength` includes the whitespace that MeCab skipped before the token.
+  auto const begin = prev_end + static_cast<std::size_t>(node.rlength - node.length);
+  std::string_view const feature{ node.feature };
+  return {
+    .surface = sentence.substr(begin, node.length),
+    .lemma = (node.stat == MECAB_UNK_NODE ? std::string_view{} : feature_field(feature, feature_lemma_idx)),
+    .reading = feature_field(feature, feature_reading_idx),
+    .pos = feature_field(feature, feature_pos_idx),
+    .begin = begin,
+    .end = begin + node.length,
+  };
+}
+
+auto find_headword_spans(Utf8Index const& sentence, std::string_view const word) -> std::vector<ByteSpan>
+{
+  std::vector<ByteSpan> spans{};
+  if (word.empty()) {
+    return spans;
+  }
+  auto const text = sentence.text();
+  for (auto pos = text.find(word); pos != std::string_view::npos; pos = text.find(word, pos)) {
+    if (sentence.is_char_boundary(pos) and sentence.is_char_boundary(pos + word.size())) {
+      spans.emplace_back(pos, pos + word.size());
+      pos += word.size();
+    } else {
+      pos += 1;
+    }
+  }
+  return spans;
+}
+
+void append_highlighted(std::string& html, MecabToken const& token, std::span<ByteSpan const> const spans)
+{
+  std::size_t pos = token.begin;
+  for (auto const& span: spans) {
+    if (span.end <= pos or span.begin >= token.end) {
+      continue;
+    }
+    auto const bold_begin = std::max(pos, span.begin);
+    auto const bold_end = std::min(token.end, span.end);
+    html.append(token.surface.substr(pos - token.begin, bold_begin - pos));
+    html.append("<b>");
+    html.append(token.surface.substr(bold_begin - token.begin, bold_end - bold_begin));
+    html.append("</b>");
+    pos = bold_end;
+  }
+  html.append(token.surface.substr(pos - token.begin));
+}
+
+auto token_to_json(MecabToken const& token) -> json
+{
+  return json{
+    { "surface", token.surface },
+    { "lemma", token.lemma },
+    { "reading", token.reading },
+    { "pos", token.pos },
+    { "begin", token.begin },
+    { "end", token.end },
+  };
+}
+
+auto is_headword(MecabToken const& token, std::span<ByteSpan const> const spans) -> bool
 {
-  half_to_full(params.gd_word);
-  std::erase_if(params.gd_word, is_space);
-  std::erase_if(params.gd_sentence, is_space);
+  return std::ranges::any_of(spans, [&token](ByteSpan const& span) {
+    return span.begin < token.end and span.end > token.begin;
+  });
+}
 
+// Tokens are stored without the surface, which is a part of the sentence.
+auto encode_tokens(MeCab::Node const* node, std::string_view const sentence) -> std::string
+{
+  std::vector<MecabToken> tokens{};
+  std::size_t pos = 0;
+  for (; node != nullptr; node = node->next) {
+    if (node->stat == MECAB_BOS_NODE or node->stat == MECAB_EOS_NODE) {
+      continue;
+    }
+    pos = tokens.emplace_back(make_token(*node, sentence, pos)).end;
+  }
+  std::string bytes{};
+  append_u32(bytes, tokens.size());
+  for (auto const& token: tokens) {
+    append_str(bytes, token.lemma);
+    append_str(bytes, token.reading);
+    append_str(bytes, token.pos);
+    append_u32(bytes, token.begin);
+    append_u32(bytes, token.end);
+  }
+  return bytes;
+}
+
+auto decode_tokens(std::string_view const bytes, std::string_view const sentence) -> std::vector<MecabToken>
+{
+  ByteReader reader{ bytes };
+  std::vector<MecabToken> tokens(reader.count(5 * sizeof(uint32_t)));
+  for (auto& token: tokens) {
+    token.lemma = reader.str();
+    token.reading = reader.str();
+    token.pos = reader.str();
+    token.begin = reader.u32();
+    token.end = reader.u32();
+    if (token.begin > token.end or token.end > sentence.size()) {
+      throw gd::corrupted_cache_entry("Corrupted cache entry.");
+    }
+    token.surface = sentence.substr(token.begin, token.end - token.begin);
+  }
+  return tokens;
+}
+
+// Words that are worth looking up ahead: particles, auxiliaries and punctuation are rarely clicked.
+auto prefetch_words(std::span<MecabToken const> const tokens) -> std::vector<std::string_view>
+{
+  std::vector<std::string_view> words{};
+  for (auto const& token: tokens) {
+    if (token.pos != "助詞" and token.pos != "助動詞" and token.pos != "記号") {
+      words.push_back(token.lemma.empty() ? token.surface : token.lemma);
+    }
+  }
+  return words;
+}
+
+// Append a link per token to `html`.
+void render_tokens(std::span<MecabToken const> const tokens, std::span<ByteSpan const> const spans, std::string& html)
+{
+  for (auto const& token: tokens) {
+    auto const bword = (token.lemma.empty() ? token.surface : token.lemma);
+    html.append(R"(<a href="bword:)").append(bword).append(R"(" title=")").append(bword).append(R"(">)");
+    append_highlighted(html, token, spans);
+    html.append("</a>");
+  }
+  html.append("<br>");
+}
+
+void lookup_words(mecab_params params, std::ostream& out)
+{
+  normalize(params.gd_word);
+  normalize(params.gd_sentence);
   if (params.gd_sentence.empty()) {
     params.gd_sentence = params.gd_word;
-  } else {
-    half_to_full(params.gd_sentence);
   }
+  // Rejects invalid UTF-8 before it reaches MeCab.
+  Utf8Index const sentence{ params.gd_sentence };
 
+  auto const resolve_start = std::chrono::steady_clock::now();
+  if (params.dic_dir.empty()) {
+    params.dic_dir = find_dic_dir();
+  }
+  if (params.user_dict.empty()) {
+    params.user_dict = find_user_dict_file();
+  }
+  if (params.resolve_only) {
+    return print_resolved(
+      out,
+      { { "dicdir", params.dic_dir }, { "userdic", params.user_dict } },
+      std::chrono::steady_clock::now() - resolve_start
+    );
+  }
   raise_if((not std::filesystem::is_directory(params.dic_dir)), "Couldn't find dictionary directory.");
 
   auto dicdir = "--dicdir=" + params.dic_dir.string();
@@ -159,9 +356,6 @@ void lookup_words(mecab_params params)
   std::vector<char const*> args = {
     "arg0", // unused
     dicdir.c_str(), // dicdir
-    R"EOF(--node-format=<a href="bword:%f[6]" title="%f[6]">%m</a>)EOF", //
-    R"EOF(--unk-format=<a href="bword:%m" title="%m">%m</a>)EOF", //
-    "--eos-format=<br>",
   };
 
   auto userdic = params.user_dict.string();
@@ -171,33 +365,79 @@ void lookup_words(mecab_params params)
     args.push_back(userdic.c_str());
   }
 
-  std::unique_ptr<MeCab::Tagger> tagger{ MeCab::createTagger((int)args.size(), (char**)(args.data())) };
-
-  if (tagger == nullptr) {
-    throw gd::runtime_error("Failed to initialize Mecab tagger.");
+  // Clicking through a sentence only changes the word, so the dictionary isn't even loaded on a hit.
+  auto* const cache = (params.cache ? segment_cache() : nullptr);
+  std::string cache_key{};
+  if (cache != nullptr) {
+    cache_key = std::format(
+      "mecab\n{}\n{}\n{}",
+      file_identity(params.dic_dir / "sys.dic"),
+      file_identity(params.user_dict),
+      params.gd_sentence
+    );
   }
+  std::string segments{};
+  auto const tokens = [&]() -> std::vector<MecabToken> {
+    if (cache != nullptr and cache->find(cache_key, segments)) {
+      try {
+        return decode_tokens(segments, params.gd_sentence);
+      } catch (gd::corrupted_cache_entry const&) {
+        // Parsed again below, and the entry is overwritten.
+      }
+    }
+    auto& tagger = cached_tagger(args);
+    // A lattice per request, so that `gd-tools serve` can parse several sentences with one tagger at once.
+    std::unique_ptr<MeCab::Lattice> const lattice{ MeCab::createLattice() };
+    lattice->set_sentence(params.gd_sentence.c_str());
+    raise_if(
+      not tagger.parse(lattice.get()),
+      std::format("MeCab failed to parse the sentence: {}", lattice->what())
+    );
+    segments = encode_tokens(lattice->bos_node(), params.gd_sentence);
+    if (cache != nullptr) {
+      cache->insert(cache_key, segments);
+    }
+    return decode_tokens(segments, params.gd_sentence);
+  }();
 
-  std::string result = tagger->parse(params.gd_sentence.c_str());
-  result = replace_all(result, std::format(">{}<", params.gd_word), std::format("><b>{}</b><", params.gd_word));
-  std::println(R"EOF(<div class="gd-mecab">{}</div>)EOF", result);
-  std::println("{}", css_style);
+  auto const spans = find_headword_spans(sentence, params.gd_word);
+  if (params.format == MecabFormat::json) {
+    json tokens_json = json::array();
+    for (auto const& token: tokens) {
+      auto token_json = token_to_json(token);
+      token_json["headword"] = is_headword(token, spans);
+      tokens_json.push_back(std::move(token_json));
+    }
+    json const result{ { "sentence", params.gd_sentence }, { "tokens", std::move(tokens_json) } };
+    std::println(out, "{}", result.dump(-1, ' ', false, json::error_handler_t::replace));
+    return;
+  }
+  std::string html{};
+  html.reserve(params.gd_sentence.size() * html_bytes_per_byte);
+  render_tokens(tokens, spans, html);
+  std::println(out, R"EOF(<div class="gd-mecab">{}</div>)EOF", html);
+  std::println(out, "{}", css_style);
 
   // debug info, not shown in GD.
-  std::println(R"EOF(<div style="display: none;">)EOF");
-  std::println("dicdir: {}", params.dic_dir.string());
-  std::println("userdic: {}", params.user_dict.string());
+  std::println(out, R"EOF(<div style="display: none;">)EOF");
+  std::println(out, "dicdir: {}", params.dic_dir.string());
+  std::println(out, "userdic: {}", params.user_dict.string());
 
-  std::println("mecab args: [{}]", join_with(args, ", "));
-  std::println(R"EOF(</div>)EOF");
+  std::println(out, "mecab args: [{}]", join_with(args, ", "));
+  std::println(out, R"EOF(</div>)EOF");
+
+  if (not params.prefetch.empty()) {
+    start_prefetch(params.prefetch, params.gd_sentence, prefetch_order(prefetch_words(tokens), params.gd_word));
+  }
 }
 
-void mecab_split(std::span<std::string_view const> const args)
+void mecab_split(std::span<std::string_view const> const args, std::ostream& out)
 {
   try {
-    lookup_words(fill_args<mecab_params>(args));
+    lookup_words(fill_args<mecab_params>(args), out);
   } catch (gd::help_requested const& ex) {
-    std::println(help_text);
+    std::println(out, help_text);
   } catch (gd::runtime_error const& ex) {
-    std::println("{}", ex.what());
+    std::println(out, "{}", ex.what());
   }
 }
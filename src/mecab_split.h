@@ -1,6 +1,43 @@
 #pragma once
 
 #include "precompiled.h"
+#include "utf8_index.h"
 
-auto mecab_split(std::span<std::string_view const> const args) -> void;
+struct MecabToken
+{
+  std::string_view surface;
+  std::string_view lemma; // empty for unknown words
+  std::string_view reading;
+  std::string_view pos;
+  std::size_t begin; // byte offsets in the sentence
+  std::size_t end;
+};
+
+struct ByteSpan
+{
+  std::size_t begin;
+  std::size_t end;
+};
+
+auto find_user_dict_file() -> std::filesystem::path;
+auto find_dic_dir() -> std::filesystem::path;
+
+// A tagger for these arguments, created on the first call and kept for the next requests.
+auto cached_tagger(std::vector<char const*> const& args) -> MeCab::Tagger&;
+// Field `idx` of a comma-separated feature string, or an empty string if it's missing or "*".
+auto feature_field(std::string_view feature, std::size_t idx) -> std::string_view;
+
+// The token of a node that is neither BOS nor EOS. `prev_end` is where the previous token ended.
+auto make_token(MeCab::Node const& node, std::string_view sentence, std::size_t prev_end) -> MecabToken;
+// Without "headword", which only gd-mecab knows.
+auto token_to_json(MecabToken const& token) -> nlohmann::json;
+
+// Byte ranges of the sentence where the word occurs as whole characters,
+// e.g. "か" isn't found in "か゚" (U+304B U+309A).
+auto find_headword_spans(Utf8Index const& sentence, std::string_view word) -> std::vector<ByteSpan>;
+// Append the surface of the token, with the parts that belong to the headword in bold.
+// The headword may cover several tokens, or only a part of one.
+void append_highlighted(std::string& html, MecabToken const& token, std::span<ByteSpan const> spans);
+
+auto mecab_split(std::span<std::string_view const> const args, std::ostream& out = std::cout) -> void;
 auto replace_all(std::string str, std::string_view const from, std::string_view const to) -> std::string;
@@ -0,0 +1,188 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "normalize.h"
+#include "kana_conv.h"
+#include "precompiled.h"
+
+namespace {
+enum class ByteClass : uint8_t {
+  ascii,
+  space,
+  continuation,
+  lead, // start of a sequence that is copied as is: Cyrillic, CJK ideographs, emoji, etc.
+  kana_lead, // 0xE3: kana and CJK punctuation
+  halfwidth_lead, // 0xEF: halfwidth and fullwidth forms
+  invalid,
+};
+
+consteval auto make_byte_classes() -> std::array<ByteClass, 256>
+{
+  std::array<ByteClass, 256> table{};
+  for (std::size_t byte = 0; byte < table.size(); ++byte) {
+    if (byte == ' ' or byte == '\t' or byte == '\n' or byte == '\v' or byte == '\f' or byte == '\r') {
+      table[byte] = ByteClass::space;
+    } else if (byte < 0x80) {
+      table[byte] = ByteClass::ascii;
+    } else if (byte < 0xC0) {
+      table[byte] = ByteClass::continuation;
+    } else if (byte == kana_lead_byte) {
+      table[byte] = ByteClass::kana_lead;
+    } else if (byte == 0xEF) {
+      table[byte] = ByteClass::halfwidth_lead;
+    } else if (byte < 0xF8) {
+      table[byte] = ByteClass::lead;
+    } else {
+      table[byte] = ByteClass::invalid;
+    }
+  }
+  return table;
+}
+
+constexpr auto byte_classes = make_byte_classes();
+
+// Fullwidth forms of U+FF61-U+FF9D, in code point order. Each one is three bytes long.
+constexpr char32_t halfwidth_first{ 0xFF61 };
+constexpr char32_t halfwidth_last{ 0xFF9D };
+constexpr std::string_view fullwidth_forms{
+  "。「」、・ヲァィゥェォャュョッーアイウエオカキクケコサシスセソ"
+  "タチツテトナニヌネノハヒフヘホマミムメモヤユヨラリルレロワン"
+};
+static_assert(fullwidth_forms.size() == CharByteLen::THREE * (halfwidth_last - halfwidth_first + 1));
+
+// half_to_full() has always turned the spacing voiced sound marks ゛゜ (U+309B-U+309C)
+// into their halfwidth forms ﾞﾟ (U+FF9E-U+FF9F). Dictionaries are built with that in mind, so it stays.
+constexpr unsigned char spacing_marks_second{ 0x82 };
+constexpr unsigned char spacing_marks_first{ 0x9B };
+constexpr unsigned char spacing_marks_last{ 0x9C };
+constexpr std::string_view halfwidth_marks{ "ﾞﾟ" };
+
+constexpr auto hira_to_kata_table = make_kana_table<Direction::hira_to_kata>();
+constexpr auto kata_to_hira_table = make_kana_table<Direction::kata_to_hira>();
+
+auto is_continuation(unsigned char const byte) noexcept -> bool
+{
+  return byte_classes[byte] == ByteClass::continuation;
+}
+} // namespace
+
+auto normalize_into(std::string_view const in, std::span<char> const out, NormalizeOptions const& options) noexcept
+  -> std::size_t
+{
+  assert(out.size() >= in.size());
+  auto const* const kana_table = [&options]() -> std::array<uint16_t, kana_table_size> const* {
+    if (not options.fold_kana.has_value()) {
+      return nullptr;
+    }
+    return (*options.fold_kana == Direction::hira_to_kata ? &hira_to_kata_table : &kata_to_hira_table);
+  }();
+
+  // `out` may alias `in`. Nothing makes a character longer, so writes never overtake reads.
+  std::size_t read = 0;
+  std::size_t write = 0;
+  auto const byte_at = [&in](std::size_t const pos) { return static_cast<unsigned char>(in[pos]); };
+  auto const copy_sequence = [&] {
+    // The lead byte and whatever continuation bytes follow it.
+    out[write++] = in[read++];
+    for (std::size_t n = 1; n < CharByteLen::FOUR and read < in.size() and is_continuation(byte_at(read)); ++n) {
+      out[write++] = in[read++];
+    }
+  };
+  auto const put = [&](std::string_view const bytes) {
+    for (char const ch: bytes) { out[write++] = ch; }
+  };
+  // A three byte character that starts with kana_lead_byte, converted to the other script if asked to.
+  auto const put_kana = [&](char const lead, unsigned char const second, unsigned char const third) {
+    auto const idx = kana_table_index(second, third);
+    if (kana_table != nullptr and idx < kana_table->size() and (*kana_table)[idx] != 0) {
+      std::array const converted{
+        lead,
+        static_cast<char>((*kana_table)[idx] >> 8U),
+        static_cast<char>((*kana_table)[idx] & 0xFFU),
+      };
+      put({ converted.data(), converted.size() });
+    } else {
+      std::array const unchanged{ lead, static_cast<char>(second), static_cast<char>(third) };
+      put({ unchanged.data(), unchanged.size() });
+    }
+  };
+  auto const has_tail = [&] {
+    return read + 2 < in.size() and is_continuation(byte_at(read + 1)) and is_continuation(byte_at(read + 2));
+  };
+
+  while (read < in.size()) {
+    switch (byte_classes[byte_at(read)]) {
+      case ByteClass::ascii:
+        do { out[write++] = in[read++]; } while (read < in.size() and byte_classes[byte_at(read)] == ByteClass::ascii);
+        break;
+      case ByteClass::space:
+        if (not options.remove_spaces) {
+          out[write++] = in[read];
+        }
+        ++read;
+        break;
+      case ByteClass::lead:
+        // Runs of kanji and other text that is never converted.
+        do { copy_sequence(); } while (read < in.size() and byte_classes[byte_at(read)] == ByteClass::lead);
+        break;
+      case ByteClass::kana_lead: {
+        if (not has_tail()) {
+          copy_sequence();
+          break;
+        }
+        auto const second = byte_at(read + 1);
+        auto const third = byte_at(read + 2);
+        if (options.fold_width and second == spacing_marks_second and third >= spacing_marks_first
+            and third <= spacing_marks_last) {
+          put(halfwidth_marks.substr((third - spacing_marks_first) * CharByteLen::THREE, CharByteLen::THREE));
+        } else {
+          put_kana(in[read], second, third);
+        }
+        read += CharByteLen::THREE;
+        break;
+      }
+      case ByteClass::halfwidth_lead: {
+        if (not has_tail()) {
+          copy_sequence();
+          break;
+        }
+        char32_t const cp{ 0xF000U | ((byte_at(read + 1) & 0x3FU) << 6U) | (byte_at(read + 2) & 0x3FU) };
+        if (options.fold_width and cp >= halfwidth_first and cp <= halfwidth_last) {
+          auto const full = fullwidth_forms.substr((cp - halfwidth_first) * CharByteLen::THREE, CharByteLen::THREE);
+          put_kana(full[0], static_cast<unsigned char>(full[1]), static_cast<unsigned char>(full[2]));
+          read += CharByteLen::THREE;
+        } else {
+          copy_sequence();
+        }
+        break;
+      }
+      case ByteClass::continuation:
+      case ByteClass::invalid:
+        // Stray bytes are kept as they are.
+        out[write++] = in[read++];
+        break;
+    }
+  }
+  return write;
+}
+
+auto normalize(std::string& str, NormalizeOptions const& options) -> std::string&
+{
+  str.resize(normalize_into(str, str, options));
+  return str;
+}
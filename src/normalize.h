@@ -0,0 +1,20 @@
+#pragma once
+
+#include "kana_conv.h"
+#include "precompiled.h"
+
+struct NormalizeOptions
+{
+  bool fold_width{ true }; // halfwidth katakana and punctuation become fullwidth, like half_to_full() does
+  bool remove_spaces{ true }; // ASCII whitespace is dropped, like std::erase_if(str, is_space) does
+  std::optional<Direction> fold_kana{}; // convert kana to one script
+};
+
+// Normalize the input in one forward pass.
+// The output is never longer than the input, so `out` must have room for `in.size()` bytes.
+// `out` may start at the same address as `in`. Returns the number of bytes written.
+auto normalize_into(std::string_view in, std::span<char> out, NormalizeOptions const& options = {}) noexcept
+  -> std::size_t;
+
+// Normalize a string in place.
+auto normalize(std::string& str, NormalizeOptions const& options = {}) -> std::string&;
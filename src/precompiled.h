@@ -1,27 +1,54 @@
 // STL
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
 #include <charconv>
 #include <chrono>
+#include <cmath>
 #include <concepts>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
 #include <filesystem>
 #include <format>
+#include <future>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <limits>
+#include <map>
+#include <memory_resource>
+#include <mutex>
 #include <optional>
 #include <print>
 #include <ranges>
 #include <regex>
+#include <set>
 #include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
-// Getpid
+// Getpid, mmap
 #if __linux__
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/file.h> // flock
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
 #include <unistd.h> // Glibc's getpid
 #elif _WIN32
 #include <windows.h> // GetCurrentProcessId
@@ -34,3 +61,4 @@
 #include <mecab.h>
 #include <nlohmann/json.hpp>
 #include <rdricpp/rdricpp.h>
+#include <sqlite3.h>
@@ -0,0 +1,407 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "prefetch.h"
+#include "precompiled.h"
+#include "segment_cache.h"
+#include "serve.h"
+#include "util.h"
+
+static constexpr std::string_view help_text = R"EOF(usage: gd-tools prefetch [OPTIONS]
+
+Run lookups ahead of time and keep their output for two minutes,
+so that gd-massif and gd-images answer from memory when the word is clicked.
+gd-ankisearch output isn't kept, its lookups only fill the card cache (see --cache in gd-ankisearch --help).
+gd-marisa and gd-mecab start it in the background with the words of the sentence when given --prefetch.
+A newer prefetch with the same actions cancels the one that is running.
+The output is only used while the sentence it was fetched for is the one being read.
+
+OPTIONS
+  --action SPEC    required. An action with the options GoldenDict passes to it, without --word.
+                   Can be repeated. Quote options that contain spaces.
+  --word WORD      required. Can be repeated. Words are fetched in the given order.
+  --budget N       optional. Fetch at most N words (default 12).
+  --max-time SECS  optional. Give up on the remaining words after this time (default 30).
+  --threads N      optional. Number of lookups running at once (default 4).
+  --session ID     optional. Set by gd-marisa and gd-mecab to the sentence the words come from.
+
+EXAMPLES
+gd-tools prefetch --action massif --action "images --max-time 5" --word 食べる --word ケーキ
+)EOF";
+
+namespace {
+// Long enough to click through a sentence. Sources that change show up after this time at the latest.
+constexpr std::chrono::minutes prefetch_ttl{ 2 };
+
+struct prefetch_params
+{
+  std::vector<std::string> actions{};
+  std::vector<std::string> words{};
+  std::size_t budget{ 12 };
+  std::chrono::seconds max_time{ 30 };
+  std::size_t n_threads{ 4 };
+  std::string session{};
+
+  auto assign(std::string_view const key, std::string_view const value) -> void
+  {
+    if (key == "--action") {
+      actions.emplace_back(value);
+    } else if (key == "--word") {
+      words.emplace_back(value);
+    } else if (key == "--budget") {
+      budget = parse_number<std::size_t>(value).value_or(budget);
+    } else if (key == "--max-time") {
+      max_time = std::chrono::seconds{ parse_number<int64_t>(value).value_or(max_time.count()) };
+    } else if (key == "--threads") {
+      n_threads = parse_count(value, n_threads);
+    } else if (key == "--session") {
+      session = value;
+    } else {
+      throw gd::runtime_error(std::format("Unknown argument name: {}", key));
+    }
+  }
+};
+
+auto prefetch_dir() -> std::filesystem::path
+{
+  return user_runtime_dir() / "prefetch";
+}
+
+void make_prefetch_dir()
+{
+  make_private_dir(user_runtime_dir());
+  make_private_dir(prefetch_dir());
+}
+
+// Sessions with the same specs, i.e. of the same GoldenDict entry, replace each other.
+// Entries with other specs keep their own session and their own prefetch.
+auto specs_file_name(std::string_view const session, std::string_view const extension) -> std::string
+{
+  return std::format("prefetch.{:016x}.{}", djbx33a(session.substr(0, session.find('-'))), extension);
+}
+
+// Holds the pid of the newest prefetch of the session's specs. The others stop when they see it changed.
+auto generation_path(std::string_view const session) -> std::filesystem::path
+{
+  return user_runtime_dir() / specs_file_name(session, "pid");
+}
+
+// Holds the id of the sentence being read with the session's specs. Only output fetched for it is used.
+auto session_path(std::string_view const session) -> std::filesystem::path
+{
+  return user_runtime_dir() / specs_file_name(session, "session");
+}
+
+// A card added while reading must show up on the next click, so ankisearch output isn't kept.
+// Prefetching it fills the card cache instead, and the click only downloads the cards modified since.
+auto keeps_output(std::string_view const action) -> bool
+{
+  return action != "ankisearch";
+}
+
+// The same lookup with options in another order, as GoldenDict and a prefetch spec may write them, has the same key.
+// Pairs are formed like fill_args() does.
+auto result_key(std::string_view const action, std::span<std::string_view const> const args) -> std::string
+{
+  std::vector<std::pair<std::string_view, std::string_view>> options{};
+  for (std::size_t idx = 0; idx < args.size();) {
+    if (args[idx].starts_with("-") and idx + 1 < args.size()) {
+      options.emplace_back(args[idx], args[idx + 1]);
+      idx += 2;
+    } else {
+      options.emplace_back(args[idx], "");
+      idx += 1;
+    }
+  }
+  std::ranges::sort(options);
+  std::string key{ action };
+  for (auto const& [name, value]: options) { key.append("\n").append(name).append("=").append(value); }
+  return key;
+}
+
+auto result_path(std::string_view const key) -> std::filesystem::path
+{
+  return prefetch_dir() / std::format("{:016x}", djbx33a(key));
+}
+
+auto is_expired(std::filesystem::path const& path) -> bool
+{
+  std::error_code ec{};
+  auto const mtime = std::filesystem::last_write_time(path, ec);
+  return ec or std::filesystem::file_time_type::clock::now() - mtime > prefetch_ttl;
+}
+
+void remove_expired()
+{
+  std::error_code ec{};
+  for (auto const& entry: std::filesystem::directory_iterator(prefetch_dir(), ec)) {
+    if (is_expired(entry.path())) {
+      std::filesystem::remove(entry.path(), ec);
+    }
+  }
+}
+
+// Split on spaces, keeping text in double quotes together.
+auto split_spec(std::string_view const spec) -> std::vector<std::string>
+{
+  std::vector<std::string> result{};
+  std::string current{};
+  bool in_quotes = false;
+  bool has_token = false;
+  for (char const ch: spec) {
+    if (ch == '"') {
+      in_quotes = not in_quotes;
+      has_token = true;
+    } else if (is_space(ch) and not in_quotes) {
+      if (has_token) {
+        result.push_back(std::exchange(current, {}));
+      }
+      has_token = false;
+    } else {
+      current.push_back(ch);
+      has_token = true;
+    }
+  }
+  if (has_token) {
+    result.push_back(std::move(current));
+  }
+  return result;
+}
+
+struct PrefetchTask
+{
+  std::string action;
+  std::vector<std::string> args; // ends with --word WORD
+};
+
+void fetch(std::string_view const session, PrefetchTask const& task)
+{
+  std::vector<std::string_view> const args{ task.args.begin(), task.args.end() };
+  if (find_prefetched(task.action, args).has_value()) {
+    return;
+  }
+  std::ostringstream out{};
+  if (serve_or_run(task.action, args, out)) {
+    store_prefetched(session, task.action, args, out.view());
+  }
+}
+
+void run_prefetch(prefetch_params const& params)
+{
+  raise_if(params.actions.empty() or params.words.empty(), "Not enough parameters.");
+  auto const deadline = std::chrono::steady_clock::now() + params.max_time;
+
+  std::vector<PrefetchTask> tasks{};
+  for (auto const& word: params.words | std::views::take(params.budget)) {
+    for (auto const& spec: params.actions) {
+      auto args = split_spec(spec);
+      raise_if(args.empty() or not is_prefetchable(args.front()), std::format("Can't prefetch: {}", spec));
+      auto action = std::move(args.front());
+      args.erase(args.begin());
+      if (not keeps_output(action)) {
+        args.emplace_back("--cache");
+        args.emplace_back("yes");
+      }
+      args.emplace_back("--word");
+      args.push_back(word);
+      tasks.push_back({ .action = std::move(action), .args = std::move(args) });
+    }
+  }
+
+  // Without a session from gd-marisa or gd-mecab, the words of this run make their own.
+  auto const session =
+    (params.session.empty() ? prefetch_session_id(params.actions, std::format("manual {}", this_pid)) : params.session);
+  if (params.session.empty()) {
+    begin_prefetch_session(session);
+  }
+  make_prefetch_dir();
+  write_file_atomic(generation_path(session), this_pid);
+  remove_expired();
+
+  auto const is_cancelled = [&deadline, &session] {
+    return std::chrono::steady_clock::now() > deadline or read_file(generation_path(session)) != this_pid;
+  };
+  std::atomic_size_t next_task{ 0 };
+  std::vector<std::jthread> workers{};
+  for (std::size_t idx = 0; idx < std::min(params.n_threads, tasks.size()); ++idx) {
+    workers.emplace_back([&] {
+      for (auto task_idx = next_task++; task_idx < tasks.size() and not is_cancelled(); task_idx = next_task++) {
+        try {
+          fetch(session, tasks[task_idx]);
+        } catch (std::exception const&) {
+          // The word is looked up again when it's clicked.
+        }
+      }
+    });
+  }
+}
+} // namespace
+
+auto is_prefetchable(std::string_view const action) -> bool
+{
+  return action == "massif" or action == "images" or action == "ankisearch";
+}
+
+auto prefetch_session_id(std::span<std::string const> const specs, std::string_view const sentence) -> std::string
+{
+  std::vector<std::string_view> sorted{ specs.begin(), specs.end() };
+  std::ranges::sort(sorted);
+  return std::format("{:016x}-{:016x}", djbx33a(join_with(sorted, "\n")), djbx33a(sentence));
+}
+
+auto prefetch_order(std::span<std::string_view const> const words, std::string_view const clicked)
+  -> std::vector<std::string_view>
+{
+  // GoldenDict looks up the clicked word itself. The reader most likely goes on to the words after it.
+  auto const clicked_it = std::ranges::find(words, clicked);
+  auto const start = (clicked_it == words.end() ? words.begin() : std::next(clicked_it));
+  std::vector<std::string_view> result{};
+  auto const add = [&](std::string_view const word) {
+    // fill_args() would take a word starting with "-" for an option.
+    if (word.empty() or word == clicked or word.starts_with("-") or std::ranges::contains(result, word)) {
+      return;
+    }
+    result.push_back(word);
+  };
+  std::ranges::for_each(start, words.end(), add);
+  std::ranges::for_each(words.begin(), start, add);
+  return result;
+}
+
+auto find_prefetched(std::string_view const action, std::span<std::string_view const> const args)
+  -> std::optional<std::string>
+{
+  if (not keeps_output(action)) {
+    return std::nullopt;
+  }
+  auto const key = result_key(action, args);
+  auto const path = result_path(key);
+  // Another user could have put anything in a shared directory.
+  if (not is_private_dir(user_runtime_dir()) or is_expired(path)) {
+    return std::nullopt;
+  }
+  auto const content = read_file(path);
+  try {
+    ByteReader reader{ content };
+    auto const stored_key = reader.str();
+    auto const session = reader.str();
+    // Another lookup with the same hash, or a sentence that the entry with these specs has moved on from.
+    if (stored_key != key or session.empty() or read_file(session_path(session)) != session) {
+      return std::nullopt;
+    }
+    return std::string{ reader.str() };
+  } catch (gd::runtime_error const&) {
+    return std::nullopt;
+  }
+}
+
+void store_prefetched(
+  std::string_view const session,
+  std::string_view const action,
+  std::span<std::string_view const> const args,
+  std::string_view const output
+)
+{
+  // Errors are printed as plain text and results as HTML. An error shouldn't outlive its cause.
+  if (not keeps_output(action) or not output.starts_with("<")) {
+    return;
+  }
+  auto const key = result_key(action, args);
+  std::string content{};
+  append_str(content, key);
+  append_str(content, session);
+  append_str(content, output);
+  try {
+    make_prefetch_dir();
+  } catch (gd::runtime_error const&) {
+    return;
+  }
+  write_file_atomic(result_path(key), content);
+}
+
+void begin_prefetch_session(std::string_view const session)
+{
+  make_private_dir(user_runtime_dir());
+  // Clicking through a sentence begins the same session again, which keeps its output.
+  if (read_file(session_path(session)) != session) {
+    write_file_atomic(session_path(session), session);
+  }
+}
+
+void start_prefetch(
+  std::span<std::string const> const specs,
+  std::string_view const sentence,
+  std::span<std::string_view const> const words
+)
+{
+  if (specs.empty()) {
+    return;
+  }
+  // Even a sentence without words to fetch ends the session of the previous one.
+  auto const session = prefetch_session_id(specs, sentence);
+  try {
+    begin_prefetch_session(session);
+  } catch (gd::runtime_error const&) {
+    return; // nothing that's fetched could be used
+  }
+  if (words.empty()) {
+    return;
+  }
+  std::vector<std::string> arg_strings{ "gd-tools", "prefetch", "--session", session };
+  for (auto const& spec: specs) {
+    arg_strings.emplace_back("--action");
+    arg_strings.push_back(spec);
+  }
+  for (auto const word: words) {
+    arg_strings.emplace_back("--word");
+    arg_strings.emplace_back(word);
+  }
+  std::vector<char*> argv{};
+  for (auto& arg: arg_strings) { argv.push_back(arg.data()); }
+  argv.push_back(nullptr);
+
+  // GoldenDict reads the output until every copy of stdout is closed, so the child gets /dev/null.
+  // Its own session keeps it alive when GoldenDict kills the process group of a finished lookup.
+  posix_spawn_file_actions_t file_actions{};
+  posix_spawn_file_actions_init(&file_actions);
+  for (int const fd: { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO }) {
+    posix_spawn_file_actions_addopen(&file_actions, fd, "/dev/null", (fd == STDIN_FILENO ? O_RDONLY : O_WRONLY), 0);
+  }
+  posix_spawnattr_t attr{};
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setflags(&attr, static_cast<short>(POSIX_SPAWN_SETSID));
+  pid_t pid{};
+  int const rc = ::posix_spawn(&pid, "/proc/self/exe", &file_actions, &attr, argv.data(), environ);
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&file_actions);
+  if (rc == 0) {
+    // Short-lived processes exit before the child and leave it to init. `gd-tools serve` has to reap it.
+    std::thread{ [pid] { ::waitpid(pid, nullptr, 0); } }.detach();
+  }
+}
+
+auto prefetch(std::span<std::string_view const> const args) -> void
+{
+  try {
+    run_prefetch(fill_args<prefetch_params>(args));
+  } catch (gd::help_requested const& ex) {
+    std::print("{}", help_text);
+  } catch (gd::runtime_error const& ex) {
+    std::println("{}", ex.what());
+  }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "precompiled.h"
+
+// Actions that `gd-tools prefetch` can look up ahead: massif and images, whose output it keeps,
+// and ankisearch, whose lookups only fill the card cache.
+auto is_prefetchable(std::string_view action) -> bool;
+
+// Output stored by `gd-tools prefetch` for exactly this lookup in the current session, if it's recent enough.
+// Options may come in any order.
+auto find_prefetched(std::string_view action, std::span<std::string_view const> args) -> std::optional<std::string>;
+void store_prefetched(
+  std::string_view session,
+  std::string_view action,
+  std::span<std::string_view const> args,
+  std::string_view output
+);
+
+// A session is the sentence being read in a GoldenDict entry with these prefetch specs.
+// The same sentence with the same specs is the same session, whichever word of it was clicked.
+auto prefetch_session_id(std::span<std::string const> specs, std::string_view sentence) -> std::string;
+// Output stored for earlier sessions with the same specs is ignored from now on.
+// Sessions with other specs, e.g. of a gd-mecab entry next to a gd-marisa one, stay as they are.
+// Throws gd::runtime_error if user_runtime_dir() isn't private.
+void begin_prefetch_session(std::string_view session);
+
+// Words of a segmented sentence in the order they're likely to be clicked after `clicked`, without duplicates.
+auto prefetch_order(std::span<std::string_view const> words, std::string_view clicked) -> std::vector<std::string_view>;
+
+// Begin the session of the sentence, start `gd-tools prefetch` in a detached process and return immediately.
+// Each spec is an action with the options GoldenDict passes to it, e.g. "images --max-time 5".
+// Words are fetched in the given order, so the likely next clicks should come first.
+void start_prefetch(
+  std::span<std::string const> specs,
+  std::string_view sentence,
+  std::span<std::string_view const> words
+);
+
+auto prefetch(std::span<std::string_view const> const args) -> void;
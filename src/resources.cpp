@@ -0,0 +1,231 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "resources.h"
+#include "precompiled.h"
+#include "util.h"
+
+using json = nlohmann::json;
+
+namespace {
+constexpr int index_version{ 2 };
+constexpr int64_t missing_dir_mtime{ -1 };
+// Directories up to this depth are recorded: the roots and e.g. every add-on folder in addons21.
+constexpr std::size_t recorded_depth{ 1 };
+// A file can appear deeper than the recorded directories without changing their times,
+// so a miss is only trusted for a short while.
+constexpr std::chrono::seconds miss_ttl{ 30 };
+
+struct DirMtime
+{
+  std::string dir;
+  int64_t mtime;
+};
+
+struct IndexEntry
+{
+  std::string result; // empty if the file wasn't found
+  std::vector<DirMtime> dirs;
+  int64_t walked_at; // seconds since the epoch
+};
+
+using ResourceIndex = std::map<std::string, IndexEntry>;
+
+struct ResolverState
+{
+  std::mutex mutex{};
+  std::optional<ResourceIndex> index{};
+  ResolverStats stats{};
+};
+
+auto resolver_state() -> ResolverState&
+{
+  static ResolverState state{};
+  return state;
+}
+
+auto mtime_of(std::filesystem::path const& dir) -> int64_t
+{
+  std::error_code ec{};
+  auto const time = std::filesystem::last_write_time(dir, ec);
+  return ec ? missing_dir_mtime : static_cast<int64_t>(time.time_since_epoch().count());
+}
+
+auto index_key(ResourceQuery const& query) -> std::string
+{
+  std::string key{ query.file_name };
+  key.append(query.recursive ? "\nrecursive" : "\nflat");
+  for (auto const& dir: query.dirs) { key.append("\n").append(dir.string()); }
+  return key;
+}
+
+auto now_seconds() -> int64_t
+{
+  return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+auto is_fresh(IndexEntry const& entry) -> bool
+{
+  if (entry.result.empty() and now_seconds() - entry.walked_at > miss_ttl.count()) {
+    return false;
+  }
+  std::error_code ec{};
+  if (not entry.result.empty() and not std::filesystem::is_regular_file(entry.result, ec)) {
+    return false;
+  }
+  return std::ranges::all_of(entry.dirs, [](DirMtime const& dir) { return mtime_of(dir.dir) == dir.mtime; });
+}
+
+auto walk(ResourceQuery const& query) -> IndexEntry
+{
+  IndexEntry entry{ .result = {}, .dirs = {}, .walked_at = now_seconds() };
+  auto const record = [&entry](std::filesystem::path const& dir) {
+    entry.dirs.emplace_back(dir.string(), mtime_of(dir));
+  };
+
+  // Breadth-first: the roots in the given order, then their subdirectories in the order they're found.
+  std::vector<std::pair<std::filesystem::path, std::size_t>> queue{};
+  for (auto const& dir: query.dirs) { queue.emplace_back(dir, 0); }
+  for (std::size_t idx = 0; idx < queue.size() and entry.result.empty(); ++idx) {
+    auto const [dir, depth] = queue[idx];
+    if (depth <= recorded_depth) {
+      record(dir);
+    }
+    std::error_code ec{};
+    if (not query.recursive) {
+      if (auto const candidate = dir / query.file_name; std::filesystem::is_regular_file(candidate, ec)) {
+        entry.result = candidate.string();
+      }
+      continue;
+    }
+    // Unreadable directories and broken entries are skipped.
+    for (auto it = std::filesystem::directory_iterator(dir, ec); not ec and it != std::filesystem::directory_iterator{};
+         it.increment(ec)) {
+      std::error_code entry_ec{};
+      if (it->is_regular_file(entry_ec) and it->path().filename() == query.file_name) {
+        entry.result = it->path().string();
+        if (depth > recorded_depth) {
+          record(dir);
+        }
+        break;
+      }
+      if (it->is_directory(entry_ec)) {
+        queue.emplace_back(it->path(), depth + 1);
+      }
+    }
+  }
+  return entry;
+}
+
+auto load_index(std::filesystem::path const& path) -> ResourceIndex
+{
+  // The index is only a cache: if it's missing or broken, everything is resolved again.
+  ResourceIndex index{};
+  std::ifstream file{ path };
+  if (not file.good()) {
+    return index;
+  }
+  auto const data = json::parse(file, nullptr, false);
+  if (data.is_discarded() or not data.is_object() or data.value("version", 0) != index_version) {
+    return index;
+  }
+  try {
+    for (auto const& [key, value]: data.at("entries").items()) {
+      IndexEntry entry{
+        .result = value.at("result").get<std::string>(),
+        .dirs = {},
+        .walked_at = value.at("walked_at").get<int64_t>(),
+      };
+      for (auto const& dir: value.at("dirs")) {
+        entry.dirs.emplace_back(dir.at(0).get<std::string>(), dir.at(1).get<int64_t>());
+      }
+      index.emplace(key, std::move(entry));
+    }
+  } catch (json::exception const&) {
+    index.clear();
+  }
+  return index;
+}
+
+void save_index(std::filesystem::path const& path, ResourceIndex const& index)
+{
+  json entries = json::object();
+  for (auto const& [key, entry]: index) {
+    json dirs = json::array();
+    for (auto const& dir: entry.dirs) { dirs.push_back(json::array({ dir.dir, dir.mtime })); }
+    entries[key] = json{ { "result", entry.result }, { "dirs", std::move(dirs) }, { "walked_at", entry.walked_at } };
+  }
+  json const data{ { "version", index_version }, { "entries", std::move(entries) } };
+
+  std::error_code ec{};
+  std::filesystem::create_directories(path.parent_path(), ec);
+  write_file_atomic(path, data.dump(-1, ' ', false, json::error_handler_t::replace));
+}
+} // namespace
+
+auto resource_index_path() -> std::filesystem::path
+{
+  return user_cache_dir() / "resources.json";
+}
+
+auto resolve_resource(ResourceQuery const& query) -> std::filesystem::path
+{
+  auto& state = resolver_state();
+  std::scoped_lock const lock{ state.mutex };
+  auto const index_path = resource_index_path();
+  if (not state.index.has_value()) {
+    state.index = load_index(index_path);
+  }
+
+  auto const key = index_key(query);
+  if (auto const it = state.index->find(key); it != state.index->end() and is_fresh(it->second)) {
+    ++state.stats.index_hits;
+    return it->second.result;
+  }
+  ++state.stats.walks;
+  auto const& entry = (*state.index)[key] = walk(query);
+  save_index(index_path, *state.index);
+  return entry.result;
+}
+
+auto resolver_stats() -> ResolverStats
+{
+  auto& state = resolver_state();
+  std::scoped_lock const lock{ state.mutex };
+  return state.stats;
+}
+
+void print_resolved(
+  std::ostream& out,
+  std::vector<std::pair<std::string, std::filesystem::path>> const& paths,
+  std::chrono::steady_clock::duration const elapsed
+)
+{
+  for (auto const& [name, path]: paths) {
+    std::println(out, "{}: {}", name, (path.empty() ? "(not found)" : path.string()));
+  }
+  auto const stats = resolver_stats();
+  std::println(
+    out,
+    "resolved in {:.3f} ms ({} from the index, {} directory walks)",
+    std::chrono::duration<double, std::milli>(elapsed).count(),
+    stats.index_hits,
+    stats.walks
+  );
+  std::println(out, "index: {}", resource_index_path().string());
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "precompiled.h"
+
+// A file to look for, e.g. MeCab's dicrc somewhere inside an Anki add-on.
+struct ResourceQuery
+{
+  std::string file_name;
+  std::vector<std::filesystem::path> dirs; // searched in order
+  bool recursive{ true }; // search subdirectories, breadth-first
+};
+
+struct ResolverStats
+{
+  std::size_t index_hits;
+  std::size_t walks;
+};
+
+// $XDG_CACHE_HOME/gd-tools/resources.json, or ~/.cache/gd-tools/resources.json.
+auto resource_index_path() -> std::filesystem::path;
+
+// Path of the first file named `query.file_name` in `query.dirs`, or an empty path if there's none.
+// The answer is remembered in the on-disk index together with the modification times of the directories
+// that decide it: the search roots, their direct subdirectories and the directory of the result.
+// Later calls only check those times, and walk the directories again if any of them changed.
+// A file that wasn't found is looked for again after half a minute.
+auto resolve_resource(ResourceQuery const& query) -> std::filesystem::path;
+
+// Counters of this process, for `--resolve-only`.
+auto resolver_stats() -> ResolverStats;
+
+// Print the resolved paths, the time it took and the counters, for `--resolve-only`.
+void print_resolved(
+  std::ostream& out,
+  std::vector<std::pair<std::string, std::filesystem::path>> const& paths,
+  std::chrono::steady_clock::duration elapsed
+);
@@ -0,0 +1,381 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "segment_cache.h"
+#include "precompiled.h"
+#include "util.h"
+
+static constexpr std::string_view help_text = R"EOF(usage: gd-tools segment-cache [OPTIONS]
+
+Show how often gd-marisa and gd-mecab found the sentence in the segmentation cache.
+
+OPTIONS
+  --clear yes  optional. Remove every entry and reset the counters.
+
+EXAMPLES
+gd-tools segment-cache
+gd-tools segment-cache --clear yes
+)EOF";
+
+namespace {
+constexpr uint64_t cache_magic{ "gd-tools segment cache"_h };
+constexpr uint32_t cache_version{ 1 };
+constexpr std::size_t n_slots{ SegmentCache::n_sets * SegmentCache::n_ways };
+
+struct CacheHeader
+{
+  uint64_t magic;
+  uint32_t version;
+  uint32_t n_sets;
+  uint32_t n_ways;
+  uint32_t slot_size;
+  uint64_t clock; // incremented on every use, orders the slots by recency
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+};
+
+struct SlotHeader
+{
+  uint64_t hash;
+  uint64_t last_used;
+  uint32_t key_size; // zero if the slot is empty
+  uint32_t value_size;
+};
+
+constexpr std::size_t header_size{ 4096 }; // slots start on a page boundary
+constexpr std::size_t slot_capacity{ SegmentCache::slot_size - sizeof(SlotHeader) };
+constexpr std::size_t file_size{ header_size + n_slots * SegmentCache::slot_size };
+static_assert(sizeof(CacheHeader) <= header_size);
+
+class FileLock
+{
+public:
+  explicit FileLock(int const fd) : m_fd(fd) { ::flock(m_fd, LOCK_EX); }
+  ~FileLock() { ::flock(m_fd, LOCK_UN); }
+  FileLock(FileLock const&) = delete;
+  auto operator=(FileLock const&) -> FileLock& = delete;
+
+private:
+  int m_fd;
+};
+
+auto slot_header(std::byte* const slot) -> SlotHeader&
+{
+  return *static_cast<SlotHeader*>(static_cast<void*>(slot));
+}
+
+auto slot_data(std::byte* const slot) -> char*
+{
+  return static_cast<char*>(static_cast<void*>(slot + sizeof(SlotHeader)));
+}
+
+// Another process may have left anything in the file, so sizes are checked before they're used.
+auto is_valid(SlotHeader const& slot_hdr) -> bool
+{
+  return slot_hdr.key_size != 0 and uint64_t{ slot_hdr.key_size } + slot_hdr.value_size <= slot_capacity;
+}
+
+auto set_of(uint64_t const hash) -> std::size_t
+{
+  // The low bits of djbx33a barely change between similar sentences, so they're mixed first.
+  static constexpr uint64_t fibonacci_mul{ 0x9E3779B97F4A7C15 };
+  return static_cast<std::size_t>(((hash * fibonacci_mul) >> 32U) % SegmentCache::n_sets) * SegmentCache::n_ways;
+}
+
+struct segment_cache_params
+{
+  bool clear{ false };
+
+  auto assign(std::string_view const key, std::string_view const value) -> void
+  {
+    if (key == "--clear") {
+      clear = (value == "yes");
+    } else {
+      throw gd::runtime_error(std::format("Unknown argument name: {}", key));
+    }
+  }
+};
+} // namespace
+
+SegmentCache::SegmentCache(std::filesystem::path path) : m_path(std::move(path))
+{
+  m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, 0600);
+  raise_if(m_fd < 0, std::format(R"(Error. Can't open file "{}".)", m_path.string()));
+
+  FileLock const lock{ m_fd };
+  struct stat st{};
+  bool const has_size = ::fstat(m_fd, &st) == 0 and static_cast<std::size_t>(st.st_size) == file_size;
+  if (not has_size and ::ftruncate(m_fd, static_cast<off_t>(file_size)) != 0) {
+    ::close(m_fd);
+    throw gd::runtime_error(std::format(R"(Error. Can't resize file "{}".)", m_path.string()));
+  }
+  m_addr = ::mmap(nullptr, file_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (m_addr == MAP_FAILED) {
+    m_addr = nullptr;
+    ::close(m_fd);
+    throw gd::runtime_error(std::format(R"(Error. Can't map file "{}".)", m_path.string()));
+  }
+  auto const& header = *static_cast<CacheHeader const*>(m_addr);
+  if (not has_size or header.magic != cache_magic or header.version != cache_version or header.n_sets != n_sets
+      or header.n_ways != n_ways or header.slot_size != slot_size) {
+    reset_locked();
+  }
+}
+
+SegmentCache::~SegmentCache()
+{
+  ::munmap(m_addr, file_size);
+  ::close(m_fd);
+}
+
+void SegmentCache::reset_locked()
+{
+  // Cutting the file to zero length drops every slot without touching its pages.
+  raise_if(
+    ::ftruncate(m_fd, 0) != 0 or ::ftruncate(m_fd, static_cast<off_t>(file_size)) != 0,
+    std::format(R"(Error. Can't resize file "{}".)", m_path.string())
+  );
+  *static_cast<CacheHeader*>(m_addr) = CacheHeader{
+    .magic = cache_magic,
+    .version = cache_version,
+    .n_sets = n_sets,
+    .n_ways = n_ways,
+    .slot_size = slot_size,
+    .clock = 0,
+    .hits = 0,
+    .misses = 0,
+    .evictions = 0,
+  };
+}
+
+auto SegmentCache::slot_at(std::size_t const idx) const -> std::byte*
+{
+  return static_cast<std::byte*>(m_addr) + header_size + idx * slot_size;
+}
+
+auto SegmentCache::find(std::string_view const key, std::string& value) -> bool
+{
+  std::scoped_lock const lock{ m_mutex };
+  FileLock const file_lock{ m_fd };
+  auto& header = *static_cast<CacheHeader*>(m_addr);
+  auto const hash = djbx33a(key);
+  auto const first = set_of(hash);
+  for (std::size_t idx = first; idx < first + n_ways; ++idx) {
+    auto* const slot = slot_at(idx);
+    auto& slot_hdr = slot_header(slot);
+    if (slot_hdr.hash == hash and slot_hdr.key_size == key.size() and is_valid(slot_hdr)
+        and std::string_view{ slot_data(slot), slot_hdr.key_size } == key) {
+      slot_hdr.last_used = ++header.clock;
+      ++header.hits;
+      value.assign(slot_data(slot) + slot_hdr.key_size, slot_hdr.value_size);
+      return true;
+    }
+  }
+  ++header.misses;
+  return false;
+}
+
+void SegmentCache::insert(std::string_view const key, std::string_view const value)
+{
+  if (key.empty() or key.size() + value.size() > slot_capacity) {
+    return;
+  }
+  std::scoped_lock const lock{ m_mutex };
+  FileLock const file_lock{ m_fd };
+  auto& header = *static_cast<CacheHeader*>(m_addr);
+  auto const hash = djbx33a(key);
+
+  // The slot with the same key, else an empty slot, else the least recently used one.
+  auto const first = set_of(hash);
+  auto const has_key = [&](std::byte* const slot) {
+    auto const& slot_hdr = slot_header(slot);
+    return slot_hdr.hash == hash and is_valid(slot_hdr)
+           and std::string_view{ slot_data(slot), slot_hdr.key_size } == key;
+  };
+  std::byte* target = nullptr;
+  for (std::size_t idx = first; idx < first + n_ways and target == nullptr; ++idx) {
+    target = (has_key(slot_at(idx)) ? slot_at(idx) : nullptr);
+  }
+  for (std::size_t idx = first; idx < first + n_ways and target == nullptr; ++idx) {
+    target = (not is_valid(slot_header(slot_at(idx))) ? slot_at(idx) : nullptr);
+  }
+  if (target == nullptr) {
+    target = slot_at(first);
+    for (std::size_t idx = first + 1; idx < first + n_ways; ++idx) {
+      if (slot_header(slot_at(idx)).last_used < slot_header(target).last_used) {
+        target = slot_at(idx);
+      }
+    }
+    ++header.evictions;
+  }
+  auto& slot_hdr = slot_header(target);
+  std::ranges::copy(key, slot_data(target));
+  std::ranges::copy(value, slot_data(target) + key.size());
+  slot_hdr.hash = hash;
+  slot_hdr.last_used = ++header.clock;
+  slot_hdr.key_size = static_cast<uint32_t>(key.size());
+  slot_hdr.value_size = static_cast<uint32_t>(value.size());
+}
+
+auto SegmentCache::stats() -> SegmentCacheStats
+{
+  std::scoped_lock const lock{ m_mutex };
+  FileLock const file_lock{ m_fd };
+  auto const& header = *static_cast<CacheHeader const*>(m_addr);
+  std::size_t entries = 0;
+  for (std::size_t idx = 0; idx < n_slots; ++idx) { entries += is_valid(slot_header(slot_at(idx))); }
+  return {
+    .entries = entries,
+    .capacity = n_slots,
+    .hits = header.hits,
+    .misses = header.misses,
+    .evictions = header.evictions,
+  };
+}
+
+void SegmentCache::clear()
+{
+  std::scoped_lock const lock{ m_mutex };
+  FileLock const file_lock{ m_fd };
+  reset_locked();
+}
+
+auto segment_cache_path() -> std::filesystem::path
+{
+  return user_runtime_dir() / "segments.cache";
+}
+
+auto segment_cache() -> SegmentCache*
+{
+  // The cache only saves time, so lookups go on without it if it can't be opened.
+  static std::unique_ptr<SegmentCache> const cache = []() -> std::unique_ptr<SegmentCache> {
+    try {
+      make_private_dir(user_runtime_dir());
+      return std::make_unique<SegmentCache>(segment_cache_path());
+    } catch (gd::runtime_error const&) {
+      return nullptr;
+    }
+  }();
+  return cache.get();
+}
+
+auto file_identity(std::filesystem::path const& path) -> std::string
+{
+  std::error_code ec{};
+  auto const size = std::filesystem::file_size(path, ec);
+  auto const mtime = std::filesystem::last_write_time(path, ec);
+  if (ec) {
+    return std::format("{} missing", path.string());
+  }
+  return std::format("{} {} {}", path.string(), size, mtime.time_since_epoch().count());
+}
+
+void append_u32(std::string& out, std::size_t const value)
+{
+  auto const u32 = static_cast<uint32_t>(value);
+  std::array<char, sizeof(u32)> bytes{};
+  std::memcpy(bytes.data(), &u32, sizeof(u32));
+  out.append(bytes.data(), bytes.size());
+}
+
+void append_u64(std::string& out, uint64_t const value)
+{
+  std::array<char, sizeof(value)> bytes{};
+  std::memcpy(bytes.data(), &value, sizeof(value));
+  out.append(bytes.data(), bytes.size());
+}
+
+void append_str(std::string& out, std::string_view const str)
+{
+  append_u32(out, str.size());
+  out.append(str);
+}
+
+auto ByteReader::u32() -> uint32_t
+{
+  uint32_t value{};
+  if (m_bytes.size() < sizeof(value)) {
+    throw gd::corrupted_cache_entry("Corrupted cache entry.");
+  }
+  std::memcpy(&value, m_bytes.data(), sizeof(value));
+  m_bytes.remove_prefix(sizeof(value));
+  return value;
+}
+
+auto ByteReader::u64() -> uint64_t
+{
+  uint64_t value{};
+  if (m_bytes.size() < sizeof(value)) {
+    throw gd::corrupted_cache_entry("Corrupted cache entry.");
+  }
+  std::memcpy(&value, m_bytes.data(), sizeof(value));
+  m_bytes.remove_prefix(sizeof(value));
+  return value;
+}
+
+auto ByteReader::str() -> std::string_view
+{
+  auto const size = u32();
+  if (m_bytes.size() < size) {
+    throw gd::corrupted_cache_entry("Corrupted cache entry.");
+  }
+  auto const result = m_bytes.substr(0, size);
+  m_bytes.remove_prefix(size);
+  return result;
+}
+
+auto ByteReader::count(std::size_t const min_size) -> std::size_t
+{
+  auto const n = std::size_t{ u32() };
+  if (n > m_bytes.size() / min_size) {
+    throw gd::corrupted_cache_entry("Corrupted cache entry.");
+  }
+  return n;
+}
+
+void print_cache_stats(segment_cache_params const& params)
+{
+  auto* const cache = segment_cache();
+  raise_if(cache == nullptr, std::format(R"(Error. Can't open "{}".)", segment_cache_path().string()));
+  if (params.clear) {
+    cache->clear();
+  }
+  auto const stats = cache->stats();
+  auto const lookups = stats.hits + stats.misses;
+  std::println("path: {}", cache->path().string());
+  std::println("entries: {} of {}", stats.entries, stats.capacity);
+  std::println(
+    "hits: {}, misses: {} ({:.1f}% hits)",
+    stats.hits,
+    stats.misses,
+    (lookups == 0 ? 0.0 : 100.0 * static_cast<double>(stats.hits) / static_cast<double>(lookups))
+  );
+  std::println("evictions: {}", stats.evictions);
+}
+
+void segment_cache_tool(std::span<std::string_view const> const args)
+{
+  try {
+    print_cache_stats(fill_args<segment_cache_params>(args));
+  } catch (gd::help_requested const& ex) {
+    std::print("{}", help_text);
+  } catch (gd::runtime_error const& ex) {
+    std::println("{}", ex.what());
+  }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "precompiled.h"
+#include "util.h"
+
+namespace gd {
+// A cached value that can't be decoded. Callers compute the value again, like on a miss.
+class corrupted_cache_entry : public runtime_error
+{
+public:
+  using runtime_error::runtime_error;
+};
+} // namespace gd
+
+struct SegmentCacheStats
+{
+  std::size_t entries;
+  std::size_t capacity;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+};
+
+// Segmentations of sentences, shared by every gd-tools process of the user through a memory-mapped file.
+// GoldenDict starts a new process for every click, but the sentence stays the same while the word changes,
+// so later clicks only have to render the highlight.
+// Keys are hashed into sets of `n_ways` slots, and a full set evicts its least recently used entry.
+// Every operation holds an exclusive flock() on the file.
+class SegmentCache
+{
+public:
+  static constexpr std::size_t n_sets{ 64 };
+  static constexpr std::size_t n_ways{ 8 };
+  static constexpr std::size_t slot_size{ 16UL * 1024UL }; // key and value together
+
+  // Creates the file, or resets it if it was made by another version. The directory must exist.
+  // A symlink in place of the file is refused.
+  explicit SegmentCache(std::filesystem::path path);
+  ~SegmentCache();
+
+  SegmentCache(SegmentCache const&) = delete;
+  auto operator=(SegmentCache const&) -> SegmentCache& = delete;
+
+  // Copy the value stored for `key` to `value`. Returns false if there's none.
+  // A slot whose sizes don't fit in it is treated as empty.
+  auto find(std::string_view key, std::string& value) -> bool;
+  // Values that don't fit in a slot are not stored.
+  void insert(std::string_view key, std::string_view value);
+  auto stats() -> SegmentCacheStats;
+  void clear();
+  auto path() const -> std::filesystem::path const& { return m_path; }
+
+private:
+  void reset_locked();
+  auto slot_at(std::size_t idx) const -> std::byte*;
+
+  std::filesystem::path m_path;
+  std::mutex m_mutex{}; // flock() doesn't exclude threads that share the descriptor
+  int m_fd{ -1 };
+  void* m_addr{ nullptr };
+};
+
+// segments.cache in user_runtime_dir().
+auto segment_cache_path() -> std::filesystem::path;
+// The cache of this process, or nullptr if the file can't be opened
+// or user_runtime_dir() isn't private, see make_private_dir().
+auto segment_cache() -> SegmentCache*;
+
+// Path, size and modification time, so that a rebuilt dictionary doesn't match old keys.
+auto file_identity(std::filesystem::path const& path) -> std::string;
+
+// Cached values are sequences of numbers and length-prefixed strings.
+void append_u32(std::string& out, std::size_t value);
+void append_u64(std::string& out, uint64_t value);
+void append_str(std::string& out, std::string_view str);
+
+// Throws gd::corrupted_cache_entry if the bytes end too early.
+class ByteReader
+{
+public:
+  explicit ByteReader(std::string_view const bytes) : m_bytes(bytes) {}
+
+  auto u32() -> uint32_t;
+  auto u64() -> uint64_t;
+  auto str() -> std::string_view;
+  // A number of elements that take at least `min_size` bytes each, so a damaged count can't ask for gigabytes.
+  auto count(std::size_t min_size) -> std::size_t;
+  auto empty() const -> bool { return m_bytes.empty(); }
+
+private:
+  std::string_view m_bytes;
+};
+
+auto segment_cache_tool(std::span<std::string_view const> const args) -> void;
@@ -0,0 +1,450 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "serve.h"
+#include "actions.h"
+#include "precompiled.h"
+#include "segment_cache.h"
+#include "util.h"
+
+using namespace std::string_view_literals;
+
+static constexpr std::string_view help_text = R"EOF(usage: gd-tools serve [OPTIONS]
+
+Answer the lookups of gd-marisa, gd-mecab, gd-ankisearch and the other programs from one resident process.
+While it runs, the programs pass their arguments over a Unix domain socket and print the answer,
+so dictionaries, MeCab taggers and HTTP connections are loaded once.
+When it's not running, or GD_TOOLS_NO_SERVER=1 is set, the programs do the work themselves.
+Lookups from another working directory, or with other HOME, XDG_* or proxy variables than the server's,
+aren't forwarded, so that they give the same results as without the server.
+If the server doesn't take a lookup within half a second, e.g. because all its threads are busy,
+the program does it itself.
+The directory of the socket is created with mode 0700, and only processes of the same user are answered.
+
+OPTIONS
+  --socket PATH    optional. Defaults to $XDG_RUNTIME_DIR/gd-tools/serve.sock.
+  --threads N      optional number of worker threads. Defaults to the number of cores.
+  --warmup yes|no  optional. Load the default word lists and MeCab dictionary on start (default yes).
+
+EXAMPLES
+gd-tools serve &
+gd-marisa --word 食べ --sentence ケーキを食べた
+)EOF";
+
+namespace {
+constexpr std::size_t max_request_size{ 1024UL * 1024UL };
+constexpr std::chrono::milliseconds request_timeout{ 5000 }; // how long a worker waits for a slow client
+constexpr std::chrono::milliseconds accept_timeout{ 500 }; // until a worker has read the request
+constexpr std::chrono::milliseconds response_timeout{ 30'000 }; // massif and images wait for the network
+constexpr uint32_t status_unknown_action{ 0 };
+constexpr uint32_t status_done{ 1 };
+constexpr uint32_t status_accepted{ 2 };
+constexpr uint32_t status_other_context{ 3 };
+
+// Read by gd-tools itself and by libcurl. The working directory is compared too.
+constexpr auto context_variables = std::to_array<char const*>({
+  "HOME",
+  "XDG_RUNTIME_DIR",
+  "XDG_CACHE_HOME",
+  "http_proxy",
+  "https_proxy",
+  "HTTPS_PROXY",
+  "all_proxy",
+  "ALL_PROXY",
+  "no_proxy",
+  "NO_PROXY",
+});
+
+class UniqueFd
+{
+public:
+  explicit UniqueFd(int const fd) : m_fd(fd) {}
+  ~UniqueFd()
+  {
+    if (m_fd >= 0) {
+      ::close(m_fd);
+    }
+  }
+  UniqueFd(UniqueFd const&) = delete;
+  auto operator=(UniqueFd const&) -> UniqueFd& = delete;
+
+  auto get() const noexcept -> int { return m_fd; }
+
+private:
+  int m_fd;
+};
+
+auto socket_address(std::filesystem::path const& path) -> std::optional<sockaddr_un>
+{
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.native().size() >= sizeof(address.sun_path)) {
+    return std::nullopt;
+  }
+  std::ranges::copy(path.native(), address.sun_path);
+  return address;
+}
+
+// A connected socket, or -1.
+auto connect_to(std::filesystem::path const& path) -> int
+{
+  auto const address = socket_address(path);
+  if (not address.has_value()) {
+    return -1;
+  }
+  int const fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd >= 0 and ::connect(fd, reinterpret_cast<sockaddr const*>(&*address), sizeof(*address)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Whether the process at the other end of a connected socket runs as this user.
+auto is_peer_this_user(int const fd) -> bool
+{
+  ucred cred{};
+  socklen_t size = sizeof(cred);
+  return ::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &size) == 0 and cred.uid == ::getuid();
+}
+
+void set_timeouts(int const fd, std::chrono::milliseconds const timeout)
+{
+  timeval const tv{
+    .tv_sec = static_cast<time_t>(timeout.count() / 1000),
+    .tv_usec = static_cast<suseconds_t>(timeout.count() % 1000 * 1000),
+  };
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+auto write_all(int const fd, std::string_view bytes) -> bool
+{
+  while (not bytes.empty()) {
+    // MSG_NOSIGNAL: a peer that went away is an error, not a SIGPIPE.
+    auto const n = ::send(fd, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+    if (n < 0 and errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    bytes.remove_prefix(static_cast<std::size_t>(n));
+  }
+  return true;
+}
+
+// Read `size` bytes, or until the end if `size` is empty.
+auto read_bytes(int const fd, std::optional<std::size_t> const size = std::nullopt) -> std::optional<std::string>
+{
+  std::string result{};
+  std::array<char, 64UL * 1024UL> buffer{};
+  while (not size.has_value() or result.size() < *size) {
+    auto const want = (size.has_value() ? std::min(buffer.size(), *size - result.size()) : buffer.size());
+    auto const n = ::recv(fd, buffer.data(), want, 0);
+    if (n < 0 and errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return std::nullopt;
+    }
+    if (n == 0) {
+      return (size.has_value() ? std::nullopt : std::optional{ std::move(result) });
+    }
+    result.append(buffer.data(), static_cast<std::size_t>(n));
+  }
+  return result;
+}
+
+// What a lookup depends on besides its arguments: the working directory and the variables above.
+auto lookup_context() -> std::string
+{
+  std::error_code ec{};
+  std::string context{ std::filesystem::current_path(ec).string() };
+  for (auto const* const name: context_variables) {
+    auto const* const value = std::getenv(name);
+    context.append(1, '\0').append(name);
+    if (value != nullptr) {
+      context.append(1, '=').append(value);
+    }
+  }
+  return context;
+}
+
+// A request is the context of the client, the action and its arguments.
+// The server answers status_accepted as soon as it has read the request,
+// then a status, the output of the action and what it printed to stderr.
+auto encode_request(std::string_view const action, std::span<std::string_view const> const args) -> std::string
+{
+  std::string payload{};
+  append_str(payload, lookup_context());
+  append_u32(payload, args.size() + 1);
+  append_str(payload, action);
+  for (auto const arg: args) { append_str(payload, arg); }
+  std::string frame{};
+  append_str(frame, payload);
+  return frame;
+}
+
+void answer_connection(int const client, std::string_view const context)
+{
+  UniqueFd const fd{ client };
+  if (not is_peer_this_user(fd.get())) {
+    return;
+  }
+  set_timeouts(fd.get(), request_timeout);
+  auto const header = read_bytes(fd.get(), sizeof(uint32_t));
+  if (not header.has_value()) {
+    return;
+  }
+  auto const size = ByteReader{ *header }.u32();
+  auto const payload = (size <= max_request_size ? read_bytes(fd.get(), size) : std::nullopt);
+  if (not payload.has_value()) {
+    return;
+  }
+
+  std::ostringstream output{};
+  std::ostringstream errors{}; // e.g. of --stats, printed to the client's stderr
+  uint32_t status = status_done;
+  try {
+    ByteReader reader{ *payload };
+    // Relative paths and the environment would mean something else here. The client runs the lookup itself.
+    if (reader.str() != context) {
+      std::string response{};
+      append_u32(response, status_other_context);
+      static_cast<void>(write_all(fd.get(), response));
+      return;
+    }
+    std::string accepted{};
+    append_u32(accepted, status_accepted);
+    if (not write_all(fd.get(), accepted)) {
+      return;
+    }
+    auto const n_args = reader.u32();
+    raise_if(n_args == 0 or n_args > payload->size(), "Error. Malformed request.");
+    std::vector<std::string_view> args(n_args);
+    for (auto& arg: args) { arg = reader.str(); }
+    if (not run_action(args.front(), std::span{ args }.subspan(1), output, errors)) {
+      status = status_unknown_action;
+    }
+  } catch (std::exception const& ex) {
+    // Like in batch mode, a failed request doesn't stop the server.
+    std::println(output, "{}", ex.what());
+  }
+  std::string response{};
+  append_u32(response, status);
+  append_str(response, output.view());
+  append_str(response, errors.view());
+  static_cast<void>(write_all(fd.get(), response));
+}
+
+struct serve_params
+{
+  std::filesystem::path socket{ server_socket_path() };
+  std::size_t n_threads{ std::max(1U, std::thread::hardware_concurrency()) };
+  bool warmup{ true };
+
+  auto assign(std::string_view const key, std::string_view const value) -> void
+  {
+    if (key == "--socket") {
+      socket = value;
+    } else if (key == "--threads") {
+      n_threads = parse_count(value, n_threads);
+    } else if (key == "--warmup") {
+      warmup = (value == "yes");
+    } else {
+      throw gd::runtime_error(std::format("Unknown argument name: {}", key));
+    }
+  }
+};
+} // namespace
+
+auto server_socket_path() -> std::filesystem::path
+{
+  return user_runtime_dir() / "serve.sock";
+}
+
+ActionServer::ActionServer(std::filesystem::path path, std::size_t const n_threads)
+  : m_path(std::move(path))
+  , m_n_threads(std::max<std::size_t>(1, n_threads))
+  , m_context(lookup_context())
+{
+  auto const address = socket_address(m_path);
+  raise_if(not address.has_value(), std::format(R"(Error. The socket path "{}" is too long.)", m_path.string()));
+  if (UniqueFd const other{ connect_to(m_path) }; other.get() >= 0) {
+    throw gd::runtime_error(std::format(R"(Error. A server is already listening on "{}".)", m_path.string()));
+  }
+  make_private_dir(m_path.parent_path());
+  std::error_code ec{};
+  std::filesystem::remove(m_path, ec); // left behind by a server that was killed
+
+  m_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  raise_if(m_fd < 0, "Error. Can't create a socket.");
+  if (::bind(m_fd, reinterpret_cast<sockaddr const*>(&*address), sizeof(*address)) != 0
+      or ::chmod(m_path.c_str(), 0600) != 0 or ::listen(m_fd, SOMAXCONN) != 0) {
+    ::close(m_fd);
+    throw gd::runtime_error(std::format(R"(Error. Can't listen on "{}".)", m_path.string()));
+  }
+}
+
+ActionServer::~ActionServer()
+{
+  ::close(m_fd);
+  std::error_code ec{};
+  std::filesystem::remove(m_path, ec);
+}
+
+void ActionServer::run()
+{
+  std::mutex mutex{};
+  std::condition_variable_any ready{};
+  std::deque<int> pending{};
+  {
+    std::vector<std::jthread> workers{};
+    for (std::size_t idx = 0; idx < m_n_threads; ++idx) {
+      workers.emplace_back([&](std::stop_token const stop) {
+        while (true) {
+          int client = -1;
+          {
+            std::unique_lock lock{ mutex };
+            if (not ready.wait(lock, stop, [&pending] { return not pending.empty(); })) {
+              return;
+            }
+            client = pending.front();
+            pending.pop_front();
+          }
+          answer_connection(client, m_context);
+        }
+      });
+    }
+
+    while (not m_stopping) {
+      int const client = ::accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client < 0) {
+        // stop() shuts the socket down, which makes accept() fail.
+        if (m_stopping or errno == EBADF or errno == EINVAL or errno == ENOTSOCK) {
+          break;
+        }
+        continue;
+      }
+      {
+        std::scoped_lock const lock{ mutex };
+        pending.push_back(client);
+      }
+      ready.notify_one();
+    }
+  } // workers finish the request they're answering and stop
+  for (int const client: pending) { ::close(client); }
+}
+
+void ActionServer::stop()
+{
+  m_stopping = true;
+  ::shutdown(m_fd, SHUT_RDWR);
+}
+
+auto forward_to_server(
+  std::filesystem::path const& socket_path,
+  std::string_view const action,
+  std::span<std::string_view const> const args,
+  std::ostream& out,
+  std::ostream& err
+) -> bool
+{
+  // Whatever listens there must run as this user, else another user could answer the lookups.
+  UniqueFd const fd{ connect_to(socket_path) };
+  if (fd.get() < 0 or not is_peer_this_user(fd.get())) {
+    return false;
+  }
+  // A server that is stuck, or busy with other lookups, is given up on before the lookup gets noticeably slower.
+  set_timeouts(fd.get(), accept_timeout);
+  if (not write_all(fd.get(), encode_request(action, args))) {
+    return false;
+  }
+  auto const accepted = read_bytes(fd.get(), sizeof(uint32_t));
+  if (not accepted.has_value() or ByteReader{ *accepted }.u32() != status_accepted) {
+    return false;
+  }
+  set_timeouts(fd.get(), response_timeout);
+  auto const response = read_bytes(fd.get());
+  if (not response.has_value()) {
+    return false;
+  }
+  try {
+    // Nothing is printed unless the whole response arrived, so the caller can still run the action itself.
+    ByteReader reader{ *response };
+    if (reader.u32() != status_done) {
+      return false;
+    }
+    auto const output = reader.str();
+    auto const errors = reader.str();
+    out << output;
+    err << errors;
+  } catch (gd::runtime_error const&) {
+    return false;
+  }
+  return true;
+}
+
+auto serve_or_run(std::string_view const action, std::span<std::string_view const> const args, std::ostream& out)
+  -> bool
+{
+  char const* const no_server = std::getenv("GD_TOOLS_NO_SERVER");
+  auto const socket_path = server_socket_path();
+  bool const use_server = (no_server == nullptr or *no_server == '\0') and is_private_dir(socket_path.parent_path());
+  if (use_server and forward_to_server(socket_path, action, args, out)) {
+    return true;
+  }
+  return run_action(action, args, out);
+}
+
+void warm_up()
+{
+  // A lookup with the segment cache off loads the default dictionaries and the tagger.
+  std::ostringstream sink{};
+  for (auto const action: { "marisa"sv, "mecab"sv }) {
+    auto const args = std::to_array({ "--word"sv, "日本"sv, "--cache"sv, "no"sv });
+    try {
+      run_action(action, args, sink);
+    } catch (std::exception const&) {
+      // Missing dictionaries are reported when they're needed.
+    }
+  }
+}
+
+void run_server(serve_params const& params)
+{
+  ActionServer server{ params.socket, params.n_threads };
+  if (params.warmup) {
+    warm_up();
+  }
+  std::println("Listening on {} with {} threads.", params.socket.string(), params.n_threads);
+  std::cout.flush();
+  server.run();
+}
+
+void serve(std::span<std::string_view const> const args)
+{
+  try {
+    run_server(fill_args<serve_params>(args));
+  } catch (gd::help_requested const& ex) {
+    std::print("{}", help_text);
+  } catch (gd::runtime_error const& ex) {
+    std::println("{}", ex.what());
+  }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "precompiled.h"
+
+// serve.sock in user_runtime_dir().
+auto server_socket_path() -> std::filesystem::path;
+
+// Answers the actions of run_action() on a Unix domain socket with a pool of worker threads.
+// Dictionaries, MeCab taggers and connections stay loaded in the process between requests.
+class ActionServer
+{
+public:
+  // Binds the socket. Its directory is made with make_private_dir().
+  // Only lookups from the current working directory and environment are answered.
+  // Throws if the directory isn't private or another server is listening on the socket.
+  ActionServer(std::filesystem::path path, std::size_t n_threads);
+  ~ActionServer();
+
+  ActionServer(ActionServer const&) = delete;
+  auto operator=(ActionServer const&) -> ActionServer& = delete;
+
+  // Accept connections until stop() is called.
+  void run();
+  // Safe to call from another thread.
+  void stop();
+
+private:
+  std::filesystem::path m_path;
+  std::size_t m_n_threads;
+  std::string m_context; // working directory and environment when the server started
+  int m_fd{ -1 };
+  std::atomic_bool m_stopping{ false };
+};
+
+// Let the server at `socket_path` run the action and print its output to `out`, and its diagnostics to `err`.
+// Returns false if no server took the request within half a second, the server runs as another user,
+// or it has another working directory or environment, so that the caller can run the action itself.
+auto forward_to_server(
+  std::filesystem::path const& socket_path,
+  std::string_view action,
+  std::span<std::string_view const> args,
+  std::ostream& out,
+  std::ostream& err = std::cerr
+) -> bool;
+
+// Forward the action to `gd-tools serve` if it's running, or run it in this process.
+// Returns false if there's no action with this name.
+auto serve_or_run(std::string_view action, std::span<std::string_view const> args, std::ostream& out = std::cout)
+  -> bool;
+
+auto serve(std::span<std::string_view const> const args) -> void;
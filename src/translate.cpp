@@ -64,7 +64,7 @@ struct translate_params
   }
 };
 
-void exec_translate(translate_params const& params)
+void exec_translate(translate_params const& params, std::ostream& out)
 {
   auto cmd_argos = sp::Popen(
     {
@@ -81,21 +81,21 @@ void exec_translate(translate_params const& params)
 
   auto const [stdout, stderr] = cmd_argos.communicate();
 
-  std::println("<div{}>", params.spoiler ? " class=\"spoiler\"" : "");
-  std::println("{}", std::string_view(stdout.buf.data(), stdout.length));
-  std::println("</div>");
-  std::println("{}", css_style);
+  std::println(out, "<div{}>", params.spoiler ? " class=\"spoiler\"" : "");
+  std::println(out, "{}", std::string_view(stdout.buf.data(), stdout.length));
+  std::println(out, "</div>");
+  std::println(out, "{}", css_style);
 }
 
-void translate(std::span<std::string_view const> const args)
+void translate(std::span<std::string_view const> const args, std::ostream& out)
 {
   try {
-    exec_translate(fill_args<translate_params>(args));
+    exec_translate(fill_args<translate_params>(args), out);
   } catch (gd::help_requested const& ex) {
-    std::print(help_text);
+    std::print(out, help_text);
   } catch (gd::runtime_error const& ex) {
-    std::println("{}", ex.what());
+    std::println(out, "{}", ex.what());
   } catch (std::runtime_error const& ex) {
-    std::println("subprocess error. {}", ex.what());
+    std::println(out, "subprocess error. {}", ex.what());
   }
 }
@@ -2,4 +2,4 @@
 
 #include "precompiled.h"
 
-void translate(std::span<std::string_view const> const args);
\ No newline at end of file
+void translate(std::span<std::string_view const> const args, std::ostream& out = std::cout);
\ No newline at end of file
@@ -0,0 +1,197 @@
+/*
+ *  gd-tools - a set of programs to enhance goldendict for immersion learning.
+ *  Copyright (C) 2026 Ajatt-Tools
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "utf8_index.h"
+#include "precompiled.h"
+#include "util.h"
+
+namespace {
+struct DecodedChar
+{
+  char32_t cp;
+  std::size_t len; // 0 if the sequence is invalid
+};
+
+constexpr DecodedChar invalid_char{ 0, 0 };
+constexpr std::size_t ascii_block_size{ sizeof(uint64_t) };
+constexpr uint64_t non_ascii_bits{ 0x8080808080808080 };
+
+// Eight ASCII bytes in a row are checked with one comparison.
+auto is_ascii_block(std::string_view const str, std::size_t const pos) noexcept -> bool
+{
+  uint64_t block;
+  std::memcpy(&block, str.data() + pos, ascii_block_size);
+  return (block & non_ascii_bits) == 0;
+}
+
+auto decode_at(std::string_view const str, std::size_t const pos) noexcept -> DecodedChar
+{
+  auto const byte = [&](std::size_t const offset) -> char32_t {
+    return static_cast<unsigned char>(str[pos + offset]);
+  };
+  auto const continues = [&](std::size_t const len) {
+    if (pos + len > str.size()) {
+      return false;
+    }
+    for (std::size_t offset = 1; offset < len; ++offset) {
+      if ((byte(offset) & 0xC0U) != 0x80U) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  char32_t const lead = byte(0);
+  if (lead < 0x80U) {
+    return { lead, CharByteLen::ONE };
+  }
+  if (lead < 0xC2U) {
+    // A continuation byte without a lead byte, or an overlong two byte sequence.
+    return invalid_char;
+  }
+  if (lead < 0xE0U) {
+    if (not continues(CharByteLen::TWO)) {
+      return invalid_char;
+    }
+    return { ((lead & 0x1FU) << 6U) | (byte(1) & 0x3FU), CharByteLen::TWO };
+  }
+  if (lead < 0xF0U) {
+    if (not continues(CharByteLen::THREE)) {
+      return invalid_char;
+    }
+    char32_t const cp{ ((lead & 0x0FU) << 12U) | ((byte(1) & 0x3FU) << 6U) | (byte(2) & 0x3FU) };
+    if (cp < 0x800U or (cp >= 0xD800U and cp <= 0xDFFFU)) {
+      return invalid_char;
+    }
+    return { cp, CharByteLen::THREE };
+  }
+  if (lead < 0xF5U) {
+    if (not continues(CharByteLen::FOUR)) {
+      return invalid_char;
+    }
+    char32_t const cp{ ((lead & 0x07U) << 18U) | ((byte(1) & 0x3FU) << 12U) | ((byte(2) & 0x3FU) << 6U)
+                       | (byte(3) & 0x3FU) };
+    if (cp < 0x10000U or cp > 0x10FFFFU) {
+      return invalid_char;
+    }
+    return { cp, CharByteLen::FOUR };
+  }
+  return invalid_char;
+}
+
+struct CodePointRange
+{
+  char32_t first;
+  char32_t last;
+};
+
+// Code points that don't start a new character. Covers the marks that occur in Japanese text and emoji sequences.
+constexpr auto grapheme_extend_ranges = std::to_array<CodePointRange>({
+  { 0x0300, 0x036F }, // combining diacritical marks
+  { 0x1AB0, 0x1AFF }, // combining diacritical marks extended
+  { 0x1DC0, 0x1DFF }, // combining diacritical marks supplement
+  { 0x200C, 0x200D }, // zero width non-joiner and joiner
+  { 0x20D0, 0x20FF }, // combining marks for symbols
+  { 0x302A, 0x302F }, // ideographic tone marks
+  { 0x3099, 0x309A }, // combining kana voiced and semi-voiced sound marks
+  { 0xFE00, 0xFE0F }, // variation selectors
+  { 0xFE20, 0xFE2F }, // combining half marks
+  { 0xFF9E, 0xFF9F }, // halfwidth kana voiced and semi-voiced sound marks
+  { 0x1F3FB, 0x1F3FF }, // emoji skin tone modifiers
+  { 0xE0020, 0xE007F }, // tags
+  { 0xE0100, 0xE01EF }, // ideographic variation selectors
+});
+
+constexpr char32_t zero_width_joiner{ 0x200D };
+constexpr CodePointRange regional_indicators{ 0x1F1E6, 0x1F1FF };
+} // namespace
+
+auto find_invalid_utf8(std::string_view const str) noexcept -> std::optional<std::size_t>
+{
+  std::size_t pos = 0;
+  while (pos < str.size()) {
+    if (pos + ascii_block_size <= str.size() and is_ascii_block(str, pos)) {
+      pos += ascii_block_size;
+      continue;
+    }
+    auto const decoded = decode_at(str, pos);
+    if (decoded.len == 0) {
+      return pos;
+    }
+    pos += decoded.len;
+  }
+  return std::nullopt;
+}
+
+auto is_grapheme_extend(char32_t const cp) noexcept -> bool
+{
+  if (cp < grapheme_extend_ranges.front().first) {
+    // Most text is ASCII or kana, which never extend.
+    return false;
+  }
+  return std::ranges::any_of(grapheme_extend_ranges, [cp](CodePointRange const& range) {
+    return cp >= range.first and cp <= range.last;
+  });
+}
+
+Utf8Index::Utf8Index(std::string_view const text, std::pmr::memory_resource* const resource)
+  : m_text{ text }
+  , m_code_points{ resource }
+  , m_chars{ resource }
+{
+  raise_if(text.size() > std::numeric_limits<uint32_t>::max(), "Text is too long.");
+  // Japanese text takes three bytes per character.
+  m_code_points.reserve(text.size() / CharByteLen::THREE + 1);
+  m_chars.reserve(text.size() / CharByteLen::THREE + 1);
+
+  char32_t prev_cp{ 0 };
+  bool odd_regional_indicator{ false };
+  std::size_t pos = 0;
+  while (pos < text.size()) {
+    if (pos + ascii_block_size <= text.size() and is_ascii_block(text, pos)) {
+      // "\r\n" would be one character, but it's rare enough to leave it to the slow path.
+      if (std::memchr(text.data() + pos, '\r', ascii_block_size) == nullptr) {
+        for (auto const offset: std::views::iota(pos, pos + ascii_block_size)) {
+          m_code_points.push_back(static_cast<uint32_t>(offset));
+          m_chars.push_back(static_cast<uint32_t>(offset));
+        }
+        prev_cp = static_cast<unsigned char>(text[pos + ascii_block_size - 1]);
+        odd_regional_indicator = false;
+        pos += ascii_block_size;
+        continue;
+      }
+    }
+    auto const [cp, len] = decode_at(text, pos);
+    if (len == 0) {
+      throw gd::runtime_error{ std::format("Invalid UTF-8 at byte {}.", pos) };
+    }
+    bool const is_regional_indicator = cp >= regional_indicators.first and cp <= regional_indicators.last;
+    bool const extends = not m_chars.empty()
+                         and (is_grapheme_extend(cp) or prev_cp == zero_width_joiner
+                              or (prev_cp == U'\r' and cp == U'\n') or (is_regional_indicator and odd_regional_indicator));
+    m_code_points.push_back(static_cast<uint32_t>(pos));
+    if (not extends) {
+      m_chars.push_back(static_cast<uint32_t>(pos));
+    }
+    // Flags are pairs of regional indicators.
+    odd_regional_indicator = is_regional_indicator and not odd_regional_indicator;
+    prev_cp = cp;
+    pos += len;
+  }
+  m_chars.push_back(static_cast<uint32_t>(text.size()));
+}
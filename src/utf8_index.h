@@ -0,0 +1,61 @@
+#pragma once
+
+#include "kana_conv.h"
+#include "precompiled.h"
+
+// Position of the first invalid byte, or nullopt if the whole string is valid UTF-8.
+// Rejects overlong encodings, surrogates and code points above U+10FFFF.
+auto find_invalid_utf8(std::string_view str) noexcept -> std::optional<std::size_t>;
+
+// Combining marks, variation selectors and other code points that extend the previous character.
+auto is_grapheme_extend(char32_t cp) noexcept -> bool;
+
+// A string that was validated and decoded once.
+// Characters are grapheme clusters: "か゚" (U+304B U+309A) or a kanji with a variation selector is one character.
+// The index doesn't own the text, which must outlive it.
+class Utf8Index
+{
+public:
+  // Throws gd::runtime_error if the text is not valid UTF-8.
+  explicit Utf8Index(
+    std::string_view text,
+    std::pmr::memory_resource* resource = std::pmr::get_default_resource()
+  );
+
+  auto text() const noexcept -> std::string_view { return m_text; }
+  // Number of characters.
+  auto size() const noexcept -> std::size_t { return m_chars.size() - 1; }
+  auto empty() const noexcept -> bool { return size() == 0; }
+
+  // Byte offset of a character. `byte_offset(size())` is the length of the text.
+  auto byte_offset(std::size_t const idx) const -> std::size_t { return m_chars[idx]; }
+  auto operator[](std::size_t const idx) const -> Utf8CharView
+  {
+    return { byte_offset(idx), m_text.substr(byte_offset(idx), byte_offset(idx + 1) - byte_offset(idx)) };
+  }
+  // Whether a character starts at this byte offset. The end of the text is a boundary too.
+  auto is_char_boundary(std::size_t const offset) const -> bool { return std::ranges::binary_search(m_chars, offset); }
+  // Characters [first, last) of the text.
+  auto substr(std::size_t const first, std::size_t const last) const -> std::string_view
+  {
+    return m_text.substr(byte_offset(first), byte_offset(last) - byte_offset(first));
+  }
+  // Byte offset of every code point.
+  auto code_points() const noexcept -> std::span<uint32_t const> { return m_code_points; }
+  auto code_point(std::size_t const idx) const -> std::string_view
+  {
+    auto const end = (idx + 1 < m_code_points.size() ? m_code_points[idx + 1] : m_text.size());
+    return m_text.substr(m_code_points[idx], end - m_code_points[idx]);
+  }
+
+  auto chars() const
+  {
+    return std::views::iota(std::size_t{ 0 }, size())
+           | std::views::transform([this](std::size_t const idx) { return (*this)[idx]; });
+  }
+
+private:
+  std::string_view m_text;
+  std::pmr::vector<uint32_t> m_code_points;
+  std::pmr::vector<uint32_t> m_chars; // byte offset of every character, followed by the length of the text
+};
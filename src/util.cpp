@@ -74,3 +74,46 @@ void str_replace(std::string& str, std::string_view from, std::string_view to) n
     str.replace(idx, from.length(), to);
   }
 }
+
+auto is_private_dir(std::filesystem::path const& dir) -> bool
+{
+  struct stat st{};
+  return ::lstat(dir.c_str(), &st) == 0 and S_ISDIR(st.st_mode) and st.st_uid == ::getuid()
+         and (st.st_mode & (S_IRWXG | S_IRWXO)) == 0;
+}
+
+void make_private_dir(std::filesystem::path const& dir)
+{
+  std::error_code ec{};
+  std::filesystem::create_directories(dir.parent_path(), ec);
+  ::mkdir(dir.c_str(), 0700);
+  raise_if(
+    not is_private_dir(dir),
+    std::format(R"(Error. "{}" must be a directory that only you can access.)", dir.string())
+  );
+}
+
+auto read_file(std::filesystem::path const& path) -> std::string
+{
+  std::ifstream file{ path, std::ios::binary };
+  return std::string{ std::istreambuf_iterator<char>{ file }, std::istreambuf_iterator<char>{} };
+}
+
+void write_file_atomic(std::filesystem::path const& path, std::string_view const content)
+{
+  // Threads of `gd-tools serve` may write the same file at once.
+  static std::atomic_size_t n_written{ 0 };
+  auto const tmp = std::filesystem::path{ path }.concat(std::format(".{}.{}.tmp", this_pid, n_written++));
+  {
+    std::ofstream file{ tmp, std::ios::binary | std::ios::trunc };
+    file.write(content.data(), static_cast<std::streamsize>(content.size()));
+    if (not file.good()) {
+      return;
+    }
+  }
+  std::error_code ec{};
+  std::filesystem::rename(tmp, path, ec);
+  if (ec) {
+    std::filesystem::remove(tmp, ec);
+  }
+}
@@ -25,9 +25,11 @@ inline void raise_if(bool expr, std::string_view const message = "Invalid argume
 }
 
 template<typename T>
-concept PassedParamsStruct = requires(T params) {
+concept PassedParamsStruct = requires(T params) { params.assign("a", "b"); };
+
+template<typename T>
+concept WordParamsStruct = PassedParamsStruct<T> and requires(T params) {
   { params.gd_word } -> std::convertible_to<std::string_view>;
-  params.assign("a", "b");
 };
 
 template<PassedParamsStruct T>
@@ -50,8 +52,11 @@ auto fill_args(std::span<std::string_view const> const args) -> T
     params.assign(*it, value);
     it += advance;
   }
-  if (params.gd_word.empty()) {
-    throw gd::help_requested();
+  if constexpr (WordParamsStruct<T>) {
+    // Commands that operate on a word can't do anything without it.
+    if (params.gd_word.empty()) {
+      throw gd::help_requested();
+    }
   }
   return params;
 }
@@ -67,6 +72,12 @@ auto parse_number(std::string_view const s) -> std::optional<Integral>
     return std::nullopt;
 };
 
+// Options such as `--threads N`: an unparsable value keeps `fallback`, and zero means one.
+inline auto parse_count(std::string_view const s, std::size_t const fallback) -> std::size_t
+{
+  return std::max<std::size_t>(1, parse_number<std::size_t>(s).value_or(fallback));
+}
+
 auto is_space(char const ch) noexcept -> bool;
 
 auto strtrim(std::string_view str) noexcept -> std::string;
@@ -85,6 +96,38 @@ inline auto user_home() -> std::filesystem::path
   return std::getenv("HOME");
 }
 
+// $XDG_RUNTIME_DIR/gd-tools, or a directory of the user in /tmp. Not created here.
+inline auto user_runtime_dir() -> std::filesystem::path
+{
+  char const* const runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+  if (runtime_dir != nullptr and *runtime_dir != '\0') {
+    return std::filesystem::path{ runtime_dir } / "gd-tools";
+  }
+  return std::filesystem::temp_directory_path() / std::format("gd-tools-{}", ::getuid());
+}
+
+// Whether only this user can use the directory:
+// it must be a directory, not a symlink, owned by this user and without group or other permissions.
+auto is_private_dir(std::filesystem::path const& dir) -> bool;
+// Create the directory with mode 0700 if it's missing, then check it with is_private_dir().
+// Throws gd::runtime_error if the check fails, e.g. if someone else made /tmp/gd-tools-<uid> first.
+void make_private_dir(std::filesystem::path const& dir);
+
+// $XDG_CACHE_HOME/gd-tools, or ~/.cache/gd-tools. Not created here.
+inline auto user_cache_dir() -> std::filesystem::path
+{
+  char const* const cache_home = std::getenv("XDG_CACHE_HOME");
+  if (cache_home != nullptr and *cache_home != '\0') {
+    return std::filesystem::path{ cache_home } / "gd-tools";
+  }
+  return user_home() / ".cache" / "gd-tools";
+}
+
+// The whole file, or an empty string if it can't be read.
+auto read_file(std::filesystem::path const& path) -> std::string;
+// Write to a temporary file and rename it, so that readers see either the old file or the new one.
+void write_file_atomic(std::filesystem::path const& path, std::string_view content);
+
 template<typename Stored>
 auto join_with(std::vector<Stored> const& seq, std::string_view const sep) -> std::string
 {
@@ -97,3 +140,19 @@ auto join_with(std::vector<Stored> const& seq, std::string_view const sep) -> st
   }
   return ss.str();
 }
+
+template<std::integral Ret = uint64_t>
+constexpr auto djbx33a(std::string_view const s) -> Ret
+{
+  static constexpr Ret init = 5381;
+  static constexpr Ret mul = 33;
+
+  Ret acc = init;
+  for (auto const ch: s) { acc = (acc * mul) + static_cast<Ret>(ch); }
+  return acc;
+}
+
+constexpr auto operator""_h(char const* s, [[maybe_unused]] size_t const size)
+{
+  return djbx33a(std::string_view(s, size));
+}
@@ -0,0 +1,382 @@
+#include "ankiconnect_standin.h"
+#include "precompiled.h"
+#include "util.h"
+
+using json = nlohmann::json;
+
+namespace {
+constexpr uint64_t first_card_id{ 1'700'000'000'000 };
+constexpr uint64_t first_note_id{ 1'600'000'000'000 };
+constexpr std::size_t cards_per_note{ 2 };
+constexpr int64_t first_mod{ 1'690'000'000 }; // seconds since the epoch, like Anki's
+constexpr uint64_t deck_id{ 1'500'000'000'000 };
+constexpr uint64_t notetype_id{ 1'400'000'000'000 };
+
+// Fields belong to the note, so both cards of a note show the same ones.
+auto vocab_field(uint64_t const note_idx) -> std::string
+{
+  return std::format("食べる{}", note_idx);
+}
+
+auto sentence_field(uint64_t const note_idx) -> std::string
+{
+  return std::format(R"(ケーキを食べる。<img src="{}.webp">)", note_idx);
+}
+
+auto note_tag(uint64_t const note_idx) -> std::string
+{
+  return std::format("tag{}", note_idx % 5);
+}
+
+auto note_of(uint64_t const cid) -> uint64_t
+{
+  return first_note_id + (cid - first_card_id) / cards_per_note;
+}
+
+auto card_json(uint64_t const cid, std::string_view const deck_name) -> json
+{
+  auto const idx = cid - first_card_id;
+  auto const note_idx = idx / cards_per_note;
+  return {
+    { "cardId", cid },
+    { "note", note_of(cid) },
+    { "deckName", deck_name },
+    { "modelName", "Japanese sentences" },
+    { "mod", first_mod },
+    { "queue", static_cast<int64_t>(idx % 3) },
+    { "type", static_cast<int64_t>(idx % 3) },
+    { "fields",
+      {
+        { "VocabKanji", { { "value", vocab_field(note_idx) }, { "order", 0 } } },
+        { "SentKanji", { { "value", sentence_field(note_idx) }, { "order", 1 } } },
+      } },
+  };
+}
+
+auto note_json(uint64_t const nid, int64_t const mod) -> json
+{
+  auto const idx = nid - first_note_id;
+  auto const first_cid = first_card_id + idx * cards_per_note;
+  return {
+    { "noteId", nid },
+    { "modelName", "Japanese sentences" },
+    { "mod", mod },
+    { "tags", { "standin", note_tag(idx) } },
+    { "fields", card_json(first_cid, "").at("fields") },
+    { "cards", { first_cid, first_cid + 1 } },
+  };
+}
+
+auto read_some(int const fd, std::string& buffer) -> bool
+{
+  std::array<char, 16UL * 1024UL> chunk{};
+  auto const n = ::recv(fd, chunk.data(), chunk.size(), 0);
+  if (n <= 0) {
+    return false;
+  }
+  buffer.append(chunk.data(), static_cast<std::size_t>(n));
+  return true;
+}
+
+auto send_all(int const fd, std::string_view bytes) -> bool
+{
+  while (not bytes.empty()) {
+    auto const n = ::send(fd, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    bytes.remove_prefix(static_cast<std::size_t>(n));
+  }
+  return true;
+}
+
+auto header_value(std::string_view const headers, std::string_view const name) -> std::string_view
+{
+  for (auto const line: headers | std::views::split(std::string_view{ "\r\n" })) {
+    std::string_view const sv{ line.begin(), line.end() };
+    auto const colon = sv.find(':');
+    if (colon == std::string_view::npos or colon != name.size()) {
+      continue;
+    }
+    if (std::ranges::equal(sv.substr(0, colon), name, {}, ::tolower, ::tolower)) {
+      auto value = sv.substr(colon + 1);
+      while (value.starts_with(' ')) { value.remove_prefix(1); }
+      return value;
+    }
+  }
+  return {};
+}
+} // namespace
+
+AnkiConnectStandIn::AnkiConnectStandIn(std::size_t const n_cards, std::chrono::microseconds const delay)
+  : m_n_cards(n_cards)
+  , m_delay(delay)
+{
+  m_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = 0; // any free port
+  socklen_t size = sizeof(address);
+  if (m_fd < 0 or ::bind(m_fd, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0
+      or ::listen(m_fd, SOMAXCONN) != 0 or ::getsockname(m_fd, reinterpret_cast<sockaddr*>(&address), &size) != 0) {
+    ::close(m_fd);
+    throw std::runtime_error("Can't start the AnkiConnect stand-in.");
+  }
+  m_port = ntohs(address.sin_port);
+  m_acceptor = std::jthread{ [this] {
+    while (true) {
+      int const client = ::accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (client < 0) {
+        return; // the destructor shut the socket down
+      }
+      std::scoped_lock const lock{ m_mutex };
+      m_clients.push_back(client);
+      m_threads.emplace_back([this, client] { serve_connection(client); });
+    }
+  } };
+}
+
+AnkiConnectStandIn::~AnkiConnectStandIn()
+{
+  ::shutdown(m_fd, SHUT_RDWR);
+  m_acceptor.join();
+  // Clients keep their connections open, so they're shut down to end the threads that read them.
+  std::vector<std::jthread> threads{};
+  {
+    std::scoped_lock const lock{ m_mutex };
+    for (int const client: m_clients) { ::shutdown(client, SHUT_RDWR); }
+    threads = std::move(m_threads);
+  }
+  threads.clear();
+  for (int const client: m_clients) { ::close(client); }
+  ::close(m_fd);
+}
+
+auto AnkiConnectStandIn::address() const -> std::string
+{
+  return std::format("127.0.0.1:{}", m_port);
+}
+
+auto AnkiConnectStandIn::n_requests(std::string_view const action) const -> std::size_t
+{
+  std::scoped_lock const lock{ m_mutex };
+  auto const it = m_requests.find(std::string{ action });
+  return (it != m_requests.end() ? it->second : 0);
+}
+
+auto AnkiConnectStandIn::n_connections() const -> std::size_t
+{
+  std::scoped_lock const lock{ m_mutex };
+  return m_clients.size();
+}
+
+void AnkiConnectStandIn::edit_note(uint64_t const nid)
+{
+  std::scoped_lock const lock{ m_mutex };
+  ++m_edits[nid];
+}
+
+void AnkiConnectStandIn::rename_deck(std::string name)
+{
+  std::scoped_lock const lock{ m_mutex };
+  m_deck_name = std::move(name);
+}
+
+auto AnkiConnectStandIn::deck_name() const -> std::string
+{
+  std::scoped_lock const lock{ m_mutex };
+  return m_deck_name;
+}
+
+auto AnkiConnectStandIn::note_mod(uint64_t const nid) const -> int64_t
+{
+  std::scoped_lock const lock{ m_mutex };
+  auto const edits = m_edits.find(nid);
+  return first_mod + (edits != m_edits.end() ? edits->second : 0);
+}
+
+void AnkiConnectStandIn::serve_connection(int const fd)
+{
+  // HTTP/1.1 with keep-alive, enough for curl.
+  std::string buffer{};
+  while (true) {
+    std::size_t header_end{};
+    while ((header_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+      if (not read_some(fd, buffer)) {
+        return;
+      }
+    }
+    std::string_view const headers{ buffer.data(), header_end };
+    auto const content_length = parse_number<std::size_t>(header_value(headers, "content-length")).value_or(0);
+    if (header_value(headers, "expect") == "100-continue" and not send_all(fd, "HTTP/1.1 100 Continue\r\n\r\n")) {
+      return;
+    }
+    auto const body_start = header_end + 4;
+    while (buffer.size() < body_start + content_length) {
+      if (not read_some(fd, buffer)) {
+        return;
+      }
+    }
+    json response{};
+    try {
+      response = answer(json::parse(buffer.substr(body_start, content_length)));
+    } catch (json::exception const& ex) {
+      response = { { "result", nullptr }, { "error", ex.what() } };
+    }
+    buffer.erase(0, body_start + content_length);
+    auto const body = response.dump();
+    auto const reply = std::format(
+      "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: {}\r\n\r\n{}",
+      body.size(),
+      body
+    );
+    if (not send_all(fd, reply)) {
+      return;
+    }
+  }
+}
+
+auto AnkiConnectStandIn::answer(json const& request) -> json
+{
+  // AnkiConnect runs every request on Anki's main thread.
+  std::scoped_lock const main_thread{ m_main_thread };
+  std::this_thread::sleep_for(m_delay);
+  return answer_action(request);
+}
+
+auto AnkiConnectStandIn::answer_action(json const& request) -> json
+{
+  auto const action = request.at("action").get<std::string>();
+  {
+    std::scoped_lock const lock{ m_mutex };
+    ++m_requests[action];
+  }
+
+  json result{};
+  if (action == "findCards") {
+    result = json::array();
+    for (std::size_t idx = 0; idx < m_n_cards; ++idx) { result.push_back(first_card_id + idx); }
+  } else if (action == "cardsInfo") {
+    result = json::array();
+    for (uint64_t const cid: request.at("params").at("cards")) { result.push_back(card_json(cid, deck_name())); }
+  } else if (action == "notesInfo") {
+    result = json::array();
+    for (uint64_t const nid: request.at("params").at("notes")) { result.push_back(note_json(nid, note_mod(nid))); }
+  } else if (action == "getNoteTags") {
+    auto const nid = request.at("params").at("note").get<uint64_t>();
+    result = note_json(nid, note_mod(nid)).at("tags");
+  } else if (action == "cardsModTime") {
+    result = json::array();
+    for (uint64_t const cid: request.at("params").at("cards")) {
+      result.push_back({ { "cardId", cid }, { "mod", first_mod } });
+    }
+  } else if (action == "notesModTime") {
+    result = json::array();
+    for (uint64_t const nid: request.at("params").at("notes")) {
+      result.push_back({ { "noteId", nid }, { "mod", note_mod(nid) } });
+    }
+  } else if (action == "getDecks") {
+    result = json::object();
+    result[deck_name()] = request.at("params").at("cards");
+  } else if (action == "getMediaDirPath") {
+    result = "/tmp/collection.media";
+  } else if (action == "multi") {
+    result = json::array();
+    for (auto const& inner: request.at("params").at("actions")) { result.push_back(answer_action(inner)); }
+  } else {
+    return { { "result", nullptr }, { "error", "unsupported action" } };
+  }
+  return { { "result", std::move(result) }, { "error", nullptr } };
+}
+
+void write_standin_collection(std::filesystem::path const& path, std::size_t const n_cards)
+{
+  std::filesystem::remove(path);
+  sqlite3* db{ nullptr };
+  raise_if(sqlite3_open(path.c_str(), &db) != SQLITE_OK, "Can't create the collection.");
+  auto const check = [db](int const rc, int const expected) {
+    raise_if(rc != expected, sqlite3_errmsg(db));
+  };
+  auto const exec = [db, &check](char const* const sql) {
+    check(sqlite3_exec(db, sql, nullptr, nullptr, nullptr), SQLITE_OK);
+  };
+  // Anki sorts these names with its own collation, so it has to exist to build the indexes.
+  sqlite3_create_collation_v2(
+    db,
+    "unicase",
+    SQLITE_UTF8,
+    nullptr,
+    [](void*, int const lhs_size, void const* const lhs, int const rhs_size, void const* const rhs) -> int {
+      auto const common = std::memcmp(lhs, rhs, static_cast<std::size_t>(std::min(lhs_size, rhs_size)));
+      return (common != 0) ? common : (lhs_size - rhs_size);
+    },
+    nullptr
+  );
+  // The tables of Anki's schema 18 that gd-ankisearch reads.
+  exec(R"SQL(
+    PRAGMA journal_mode = WAL;
+    CREATE TABLE col (id integer PRIMARY KEY, crt integer NOT NULL, mod integer NOT NULL, scm integer NOT NULL,
+      ver integer NOT NULL, dty integer NOT NULL, usn integer NOT NULL, ls integer NOT NULL, conf text NOT NULL,
+      models text NOT NULL, decks text NOT NULL, dconf text NOT NULL, tags text NOT NULL);
+    CREATE TABLE notes (id integer PRIMARY KEY, guid text NOT NULL, mid integer NOT NULL, mod integer NOT NULL,
+      usn integer NOT NULL, tags text NOT NULL, flds text NOT NULL, sfld integer NOT NULL, csum integer NOT NULL,
+      flags integer NOT NULL, data text NOT NULL);
+    CREATE TABLE cards (id integer PRIMARY KEY, nid integer NOT NULL, did integer NOT NULL, ord integer NOT NULL,
+      mod integer NOT NULL, usn integer NOT NULL, type integer NOT NULL, queue integer NOT NULL, due integer NOT NULL,
+      ivl integer NOT NULL, factor integer NOT NULL, reps integer NOT NULL, lapses integer NOT NULL,
+      left integer NOT NULL, odue integer NOT NULL, odid integer NOT NULL, flags integer NOT NULL, data text NOT NULL);
+    CREATE INDEX ix_cards_nid ON cards (nid);
+    CREATE TABLE decks (id integer PRIMARY KEY NOT NULL, name text NOT NULL COLLATE unicase,
+      mtime_secs integer NOT NULL, usn integer NOT NULL, common blob NOT NULL, kind blob NOT NULL);
+    CREATE UNIQUE INDEX idx_decks_name ON decks (name);
+    CREATE TABLE fields (ntid integer NOT NULL, ord integer NOT NULL, name text NOT NULL COLLATE unicase,
+      config blob NOT NULL, PRIMARY KEY (ntid, ord)) WITHOUT ROWID;
+    CREATE UNIQUE INDEX idx_fields_name_ntid ON fields (name, ntid);
+    INSERT INTO col VALUES (1, 0, 0, 0, 18, 0, 0, 0, '', '', '', '', '');
+    INSERT INTO decks VALUES (1, 'Default', 0, 0, '', '');
+  )SQL");
+  exec(std::format("INSERT INTO decks VALUES ({}, 'Mining', 0, 0, '', '');", deck_id).c_str());
+  exec(std::format("INSERT INTO fields VALUES ({0}, 0, 'VocabKanji', ''), ({0}, 1, 'SentKanji', '');", notetype_id)
+         .c_str());
+
+  exec("BEGIN");
+  sqlite3_stmt* note{ nullptr };
+  sqlite3_stmt* card{ nullptr };
+  sqlite3_prepare_v2(db, "INSERT INTO notes VALUES (?, '', ?, ?, 0, ?, ?, 0, 0, 0, '')", -1, &note, nullptr);
+  sqlite3_prepare_v2(
+    db,
+    "INSERT INTO cards VALUES (?, ?, ?, ?, ?, 0, ?, ?, 0, 0, 0, 0, 0, 0, 0, 0, 0, '')",
+    -1,
+    &card,
+    nullptr
+  );
+  for (uint64_t idx = 0; idx < n_cards; ++idx) {
+    auto const note_idx = idx / cards_per_note;
+    if (idx % cards_per_note == 0) {
+      // Anki keeps the tags between spaces, and the fields separated by 0x1f.
+      auto const tags = std::format(" standin {} ", note_tag(note_idx));
+      auto const flds = std::format("{}\x1f{}", vocab_field(note_idx), sentence_field(note_idx));
+      sqlite3_bind_int64(note, 1, static_cast<int64_t>(first_note_id + note_idx));
+      sqlite3_bind_int64(note, 2, static_cast<int64_t>(notetype_id));
+      sqlite3_bind_int64(note, 3, first_mod);
+      sqlite3_bind_text(note, 4, tags.data(), static_cast<int>(tags.size()), SQLITE_TRANSIENT);
+      sqlite3_bind_text(note, 5, flds.data(), static_cast<int>(flds.size()), SQLITE_TRANSIENT);
+      check(sqlite3_step(note), SQLITE_DONE);
+      sqlite3_reset(note);
+    }
+    sqlite3_bind_int64(card, 1, static_cast<int64_t>(first_card_id + idx));
+    sqlite3_bind_int64(card, 2, static_cast<int64_t>(first_note_id + note_idx));
+    sqlite3_bind_int64(card, 3, static_cast<int64_t>(deck_id));
+    sqlite3_bind_int64(card, 4, static_cast<int64_t>(idx % cards_per_note));
+    sqlite3_bind_int64(card, 5, first_mod);
+    sqlite3_bind_int64(card, 6, static_cast<int64_t>(idx % 3));
+    sqlite3_bind_int64(card, 7, static_cast<int64_t>(idx % 3));
+    check(sqlite3_step(card), SQLITE_DONE);
+    sqlite3_reset(card);
+  }
+  sqlite3_finalize(note);
+  sqlite3_finalize(card);
+  exec("COMMIT");
+  sqlite3_close(db);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "precompiled.h"
+
+// A local imitation of AnkiConnect for tests and benchmarks of gd-ankisearch.
+// Every search finds all `n_cards` cards. Cards come in pairs that belong to the same note.
+// Like Anki, it answers one request at a time, each after `delay`, and the actions of a multi request together.
+class AnkiConnectStandIn
+{
+public:
+  explicit AnkiConnectStandIn(std::size_t n_cards, std::chrono::microseconds delay = {});
+  ~AnkiConnectStandIn();
+
+  AnkiConnectStandIn(AnkiConnectStandIn const&) = delete;
+  auto operator=(AnkiConnectStandIn const&) -> AnkiConnectStandIn& = delete;
+
+  // For --ankiconnect, e.g. "127.0.0.1:40123".
+  auto address() const -> std::string;
+  // Requests answered so far, by AnkiConnect action. The actions inside a multi request count too.
+  auto n_requests(std::string_view action) const -> std::size_t;
+  auto n_connections() const -> std::size_t;
+  // Changes the modification time of the note, as an edit in Anki would.
+  void edit_note(uint64_t nid);
+  // Renames the deck of all cards. Like in Anki, their modification times stay the same.
+  void rename_deck(std::string name);
+
+private:
+  void serve_connection(int fd);
+  auto answer(nlohmann::json const& request) -> nlohmann::json;
+  auto answer_action(nlohmann::json const& request) -> nlohmann::json;
+  auto note_mod(uint64_t nid) const -> int64_t;
+  auto deck_name() const -> std::string;
+
+  std::size_t m_n_cards;
+  std::chrono::microseconds m_delay;
+  int m_fd{ -1 };
+  uint16_t m_port{ 0 };
+  std::mutex m_main_thread{};
+  mutable std::mutex m_mutex{}; // the fields below
+  std::unordered_map<std::string, std::size_t> m_requests{};
+  std::unordered_map<uint64_t, int64_t> m_edits{}; // by note id
+  std::string m_deck_name{ "Mining" };
+  std::vector<int> m_clients{};
+  std::vector<std::jthread> m_threads{};
+  std::jthread m_acceptor{}; // started last
+};
+
+// The cards of a stand-in with `n_cards` in a collection.anki2 file, for gd-ankisearch --collection.
+// The stand-in's getMediaDirPath answers /tmp/collection.media wherever the file is.
+void write_standin_collection(std::filesystem::path const& path, std::size_t n_cards);
@@ -0,0 +1,653 @@
+#include "anki_search.h"
+#include "ankiconnect.h"
+#include "ankiconnect_standin.h"
+#include "kana_conv.h"
+#include "marisa_annotate.h"
+#include "marisa_build.h"
+#include "marisa_split.h"
+#include "mecab_batch.h"
+#include "mecab_split.h"
+#include "scoped_env.h"
+#include "utf8_index.h"
+#include "util.h"
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <random>
+
+// Benchmarks are hidden by default. Run them with `xmake run tests "[!benchmark]"`.
+
+namespace {
+auto synthetic_words(std::size_t const n_words) -> std::vector<std::string>
+{
+  // Random kana words, 2-6 characters long. The seed is fixed so that runs are comparable.
+  std::vector<std::string_view> kana{};
+  std::ranges::copy(iter_unicode_chars(hiragana_chars), std::back_inserter(kana));
+  std::minstd_rand gen{ 42 };
+  std::uniform_int_distribution<std::size_t> pick_kana{ 0, kana.size() - 1 };
+  std::uniform_int_distribution<std::size_t> pick_len{ 2, 6 };
+
+  std::vector<std::string> words{};
+  words.reserve(n_words);
+  for (std::size_t idx = 0; idx < n_words; ++idx) {
+    std::string word{};
+    for (std::size_t len = pick_len(gen); len > 0; --len) { word.append(kana.at(pick_kana(gen))); }
+    words.push_back(std::move(word));
+  }
+  return words;
+}
+
+// The map-based conversion that kana_conv used before, kept as a reference.
+auto map_convert_kana(std::string_view const str, std::string_view const from, std::string_view const to)
+  -> std::string
+{
+  static std::unordered_map<std::string_view, std::string_view> const map = [&] {
+    std::unordered_map<std::string_view, std::string_view> result{};
+    for (auto const [from_char, to_char]: std::views::zip(iter_unicode_chars(from), iter_unicode_chars(to))) {
+      result.emplace(from_char, to_char);
+    }
+    return result;
+  }();
+  std::string result{};
+  result.reserve(str.length());
+  for (auto const ch: iter_unicode_chars(str)) {
+    auto const found = map.find(ch);
+    result.append(found != map.end() ? found->second : ch);
+  }
+  return result;
+}
+
+auto make_test_dic(std::span<std::string const> const words) -> std::filesystem::path
+{
+  auto const path = std::filesystem::temp_directory_path() / std::format("gd-tools-bench-{}.dic", this_pid);
+  marisa::Keyset keyset;
+  for (auto const& word: words) { keyset.push_back(word.c_str(), word.length()); }
+  marisa::Trie trie;
+  trie.build(keyset);
+  trie.save(path.c_str());
+  return path;
+}
+
+auto make_queries(std::span<std::string const> const words) -> std::vector<std::string>
+{
+  // Suffixes of a "sentence" glued together from dictionary words, like gd-marisa queries them.
+  std::string sentence{};
+  for (auto const& word: words | std::views::take(20)) { sentence.append(word); }
+  std::vector<std::string> queries{};
+  for (auto const [idx, uni_char]: enum_unicode_chars(sentence)) { queries.emplace_back(sentence.substr(idx)); }
+  return queries;
+}
+
+void evict_from_page_cache(std::filesystem::path const& path)
+{
+  // Drops clean pages of a file that nobody has mapped. Doesn't need root, unlike drop_caches.
+  int const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  REQUIRE(fd >= 0);
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  ::close(fd);
+}
+
+auto make_sentence(std::span<std::string const> const words, std::size_t const n_chars) -> std::string
+{
+  std::string sentence{};
+  std::size_t len = 0;
+  for (auto const& word: words) {
+    for (std::string_view const uni_char: iter_unicode_chars(word)) {
+      if (len++ == n_chars) {
+        return sentence;
+      }
+      sentence.append(uni_char);
+    }
+  }
+  return sentence;
+}
+
+auto naive_lookup(marisa::Agent& agent, MarisaDict const& dict, std::string const& sentence)
+  -> std::vector<std::vector<std::string>>
+{
+  // gd-marisa before the lattice: each position deinflects and searches every prefix of its window.
+  std::vector<std::vector<std::string>> result{};
+  for (auto const [idx, uni_char]: enum_unicode_chars(sentence)) {
+    std::string const window = sentence.substr(idx, max_forward_search_len_bytes);
+    std::vector<std::string> terms{};
+    for (auto const& variant: { window, hiragana_to_katakana(window), katakana_to_hiragana(window) }) {
+      for (auto const ch: enum_unicode_chars(variant) | std::views::reverse) {
+        for (auto const& deinflection: ajt::rdricpp::deinflect(variant.substr(0UL, ch.idx + ch.ch.size()))) {
+          terms.push_back(deinflection.term);
+        }
+      }
+    }
+    std::vector<std::string_view> const term_views(terms.begin(), terms.end());
+    JpSet words{};
+    for (std::string_view const word: dict.common_prefix_search(agent, term_views)) { words.emplace(word); }
+    result.emplace_back(words.begin(), words.end());
+  }
+  return result;
+}
+
+class CountingResource : public std::pmr::memory_resource
+{
+public:
+  auto n_allocations() const noexcept -> std::size_t { return m_n_allocations; }
+
+private:
+  auto do_allocate(std::size_t const bytes, std::size_t const alignment) -> void* override
+  {
+    ++m_n_allocations;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void* const ptr, std::size_t const bytes, std::size_t const alignment) override
+  {
+    std::pmr::new_delete_resource()->deallocate(ptr, bytes, alignment);
+  }
+  auto do_is_equal(std::pmr::memory_resource const& other) const noexcept -> bool override { return this == &other; }
+
+  std::size_t m_n_allocations{ 0 };
+};
+
+struct OldKanaInsensitiveMore
+{
+  // JpSet's comparator before KanaInsensitiveKey: converts both operands on every comparison.
+  bool operator()(std::string const& lhs, std::string const& rhs) const
+  {
+    if (lhs.length() != rhs.length()) {
+      return lhs.length() > rhs.length();
+    } else {
+      return hiragana_to_katakana(lhs) > hiragana_to_katakana(rhs);
+    }
+  }
+};
+
+auto lookup_all(std::filesystem::path const& path, TrieLoadMode const mode, std::span<std::string const> const queries)
+  -> std::size_t
+{
+  marisa::Trie trie;
+  marisa::Agent agent;
+  load_trie(trie, path, mode);
+  std::size_t n_hits = 0;
+  for (auto const& query: queries) {
+    agent.set_query(query.c_str(), query.length());
+    while (trie.common_prefix_search(agent)) { ++n_hits; }
+  }
+  return n_hits;
+}
+} // namespace
+
+TEST_CASE("Trie load modes", "[!benchmark][marisa]")
+{
+  auto const words = synthetic_words(300'000);
+  auto const queries = make_queries(words);
+  auto const path = make_test_dic(words);
+
+  REQUIRE(lookup_all(path, TrieLoadMode::read, queries) == lookup_all(path, TrieLoadMode::mmap, queries));
+
+  BENCHMARK("load(), cold")
+  {
+    evict_from_page_cache(path);
+    return lookup_all(path, TrieLoadMode::read, queries);
+  };
+  BENCHMARK("mmap(), cold")
+  {
+    evict_from_page_cache(path);
+    return lookup_all(path, TrieLoadMode::mmap, queries);
+  };
+  BENCHMARK("load(), warm")
+  {
+    return lookup_all(path, TrieLoadMode::read, queries);
+  };
+  BENCHMARK("mmap(), warm")
+  {
+    return lookup_all(path, TrieLoadMode::mmap, queries);
+  };
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Sentence lattice", "[!benchmark][marisa]")
+{
+  auto const words = synthetic_words(300'000);
+  auto const path = make_test_dic(words);
+  MarisaDict const dict{ path, TrieLoadMode::mmap };
+  marisa::Agent agent;
+
+  for (std::size_t const n_chars: { 10UL, 20UL, 40UL, 80UL }) {
+    auto const sentence = make_sentence(std::span{ words }.subspan(n_chars), n_chars);
+
+    auto const lattice = build_lattice(agent, dict, sentence);
+    auto const reference = naive_lookup(agent, dict, sentence);
+    REQUIRE(lattice.nodes.size() == reference.size());
+    for (auto const [node, expected]: std::views::zip(lattice.nodes, reference)) {
+      REQUIRE(std::ranges::equal(node.words, expected));
+    }
+
+    BENCHMARK(std::format("per position, {} chars", n_chars))
+    {
+      return naive_lookup(agent, dict, sentence);
+    };
+    BENCHMARK(std::format("lattice, {} chars", n_chars))
+    {
+      return build_lattice(agent, dict, sentence);
+    };
+  }
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("JpSet insert", "[!benchmark][JpSet]")
+{
+  // A few hundred candidates, a third of them are kana variants of other candidates.
+  std::vector<std::string> candidates{};
+  for (auto const& word: synthetic_words(200)) {
+    candidates.push_back(word);
+    if (candidates.size() % 2 == 0) {
+      candidates.push_back(hiragana_to_katakana(word));
+    }
+  }
+
+  JpSet flat{};
+  std::set<std::string, OldKanaInsensitiveMore> tree{};
+  for (auto const& word: candidates) {
+    flat.emplace(word);
+    tree.emplace(word);
+  }
+  REQUIRE(std::ranges::equal(flat, tree));
+
+  BENCHMARK("std::set with converting comparator")
+  {
+    std::set<std::string, OldKanaInsensitiveMore> set{};
+    for (auto const& word: candidates) { set.emplace(word); }
+    return set.size();
+  };
+  BENCHMARK("JpSet")
+  {
+    JpSet set{};
+    for (auto const& word: candidates) { set.emplace(word); }
+    return set.size();
+  };
+}
+
+TEST_CASE("Lookup arena", "[!benchmark][marisa]")
+{
+  auto const words = synthetic_words(300'000);
+  auto const path = make_test_dic(words);
+  MarisaDict const dict{ path, TrieLoadMode::mmap };
+  marisa::Agent agent;
+  auto const sentence = make_sentence(words, 40);
+
+  // Only allocations made through the memory resource are counted. rdricpp allocates on its own.
+  CountingResource heap_counter{};
+  static_cast<void>(build_lattice(agent, dict, sentence, {}, &heap_counter));
+  CountingResource arena_counter{};
+  {
+    std::pmr::monotonic_buffer_resource arena{ &arena_counter };
+    static_cast<void>(build_lattice(agent, dict, sentence, {}, &arena));
+  }
+  std::println(
+    "Allocations per lookup: {} without arena, {} with arena.",
+    heap_counter.n_allocations(),
+    arena_counter.n_allocations()
+  );
+  REQUIRE(arena_counter.n_allocations() < heap_counter.n_allocations());
+
+  BENCHMARK("heap")
+  {
+    return build_lattice(agent, dict, sentence).nodes.size();
+  };
+  BENCHMARK("arena")
+  {
+    std::array<std::byte, 32UL * 1024UL> buffer;
+    std::pmr::monotonic_buffer_resource arena{ buffer.data(), buffer.size() };
+    return build_lattice(agent, dict, sentence, {}, &arena).nodes.size();
+  };
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Deinflection modes", "[!benchmark][marisa]")
+{
+  // Random kana words often end like verbs or adjectives, so they get plenty of conjugated forms.
+  auto const words = synthetic_words(20'000);
+  auto const path = make_test_dic(words);
+  auto const n_forms = write_forms_index(words, forms_path(path));
+  MarisaDict const dict{ path, TrieLoadMode::mmap };
+  REQUIRE(dict.forms() != nullptr);
+  marisa::Agent agent;
+  std::println("Conjugated forms: {} of {} words.", n_forms, words.size());
+
+  for (std::size_t const n_chars: { 20UL, 80UL }) {
+    auto const sentence = make_sentence(words, n_chars);
+    BENCHMARK(std::format("runtime, {} chars", n_chars))
+    {
+      return build_lattice(agent, dict, sentence, { .deinflect = DeinflectMode::runtime }).nodes.size();
+    };
+    BENCHMARK(std::format("index, {} chars", n_chars))
+    {
+      return build_lattice(agent, dict, sentence, { .deinflect = DeinflectMode::index }).nodes.size();
+    };
+  }
+
+  std::filesystem::remove(path);
+  std::filesystem::remove(forms_path(path));
+  std::filesystem::remove(forms_path(path) += entries_file_ext);
+}
+
+TEST_CASE("Subtitle annotation scaling", "[!benchmark][marisa]")
+{
+  auto const words = synthetic_words(300'000);
+  auto const path = make_test_dic(words);
+  MarisaDict const dict{ path, TrieLoadMode::mmap };
+  auto const dicts = std::array{ &dict };
+
+  // An episode has a few hundred lines of 10-30 characters.
+  std::vector<SubtitleLine> lines{};
+  for (std::size_t idx = 0; idx < 400; ++idx) {
+    lines.emplace_back(idx + 1, "", "", make_sentence(std::span{ words }.subspan(idx * 10), 10 + idx % 20));
+  }
+
+  auto const reference = annotate_lines(lines, dicts, {}, 1);
+  for (std::size_t n_threads = 1; n_threads <= std::max(1U, std::thread::hardware_concurrency()); n_threads *= 2) {
+    REQUIRE(annotate_lines(lines, dicts, {}, n_threads) == reference);
+    BENCHMARK(std::format("{} threads", n_threads))
+    {
+      return annotate_lines(lines, dicts, {}, n_threads).size();
+    };
+  }
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Kana conversion", "[!benchmark][hiragana_to_katakana]")
+{
+  // Subtitle-like text: kana mixed with kanji, punctuation and some ASCII.
+  std::string text{};
+  for (auto const& word: synthetic_words(20'000)) {
+    text.append(word);
+    text.append(text.size() % 3 == 0 ? "、漢字を" : "。Test ");
+  }
+  REQUIRE(map_convert_kana(text, hiragana_chars, katakana_chars) == hiragana_to_katakana(text));
+
+  BENCHMARK("map lookup")
+  {
+    return map_convert_kana(text, hiragana_chars, katakana_chars).size();
+  };
+  BENCHMARK("table, new string")
+  {
+    return hiragana_to_katakana(text).size();
+  };
+  std::string buffer{};
+  BENCHMARK("table, in place")
+  {
+    buffer = text;
+    convert_kana_in_place<Direction::hira_to_kata>(buffer);
+    return buffer.size();
+  };
+}
+
+TEST_CASE("UTF-8 index", "[!benchmark][iterate]")
+{
+  // A long subtitle file's worth of mixed text.
+  std::string text{};
+  for (auto const& word: synthetic_words(200'000)) {
+    text.append(word);
+    text.append(text.size() % 3 == 0 ? "、漢字を" : "。Test ");
+  }
+  Utf8Index const index{ text };
+  // The views split "か゚" in two, the index keeps it whole.
+  REQUIRE(index.code_points().size() == static_cast<std::size_t>(std::ranges::distance(enum_unicode_chars(text))));
+
+  BENCHMARK("views, decode")
+  {
+    std::vector<Utf8CharView> chars{};
+    std::ranges::copy(enum_unicode_chars(text), std::back_inserter(chars));
+    return chars.size();
+  };
+  BENCHMARK("index, validate and decode")
+  {
+    return Utf8Index{ text }.size();
+  };
+  BENCHMARK("validate only")
+  {
+    return find_invalid_utf8(text).has_value();
+  };
+  // The tools used to walk the same sentence several times.
+  BENCHMARK("views, 4 passes")
+  {
+    std::size_t total{ 0 };
+    for (int pass = 0; pass < 4; ++pass) {
+      for (auto const [idx, ch]: enum_unicode_chars(text)) { total += ch.size(); }
+    }
+    return total;
+  };
+  BENCHMARK("index, 4 passes")
+  {
+    std::size_t total{ 0 };
+    for (int pass = 0; pass < 4; ++pass) {
+      for (auto const [idx, ch]: index.chars()) { total += ch.size(); }
+    }
+    return total;
+  };
+}
+
+TEST_CASE("MeCab segmentation scaling", "[!benchmark][mecab]")
+{
+  auto const dic_dir = find_dic_dir();
+  if (dic_dir.empty()) {
+    SKIP("MeCab dictionary is not installed.");
+  }
+  auto const options = std::vector<std::string>{ "--dicdir=" + dic_dir.string() };
+  MecabModel const model{ options };
+
+  // About 5 MB of text, so that one run shows the throughput in MB/s.
+  auto const sentences = std::to_array<std::string_view>({
+    "ケーキを食べたかったけど、もう売り切れていた。",
+    "明日は雨が降るらしいから、傘を持っていきなさい。",
+    "この本を読み終わったら貸してあげる。",
+  });
+  std::vector<std::string> lines{};
+  std::size_t n_bytes = 0;
+  for (std::size_t idx = 0; n_bytes < 5UL * 1024UL * 1024UL; ++idx) {
+    lines.emplace_back(sentences[idx % sentences.size()]);
+    n_bytes += lines.back().size() + 1;
+  }
+
+  auto const reference = segment_lines(model, lines, SegmentFormat::wakati, 1);
+  for (std::size_t n_threads = 1; n_threads <= std::max(1U, std::thread::hardware_concurrency()); n_threads *= 2) {
+    REQUIRE(segment_lines(model, lines, SegmentFormat::wakati, n_threads) == reference);
+    BENCHMARK(std::format("{} threads, {:.1f} MB", n_threads, static_cast<double>(n_bytes) / (1024.0 * 1024.0)))
+    {
+      return segment_lines(model, lines, SegmentFormat::wakati, n_threads).size();
+    };
+  }
+}
+
+TEST_CASE("AnkiConnect round trips", "[!benchmark][ankisearch]")
+{
+  // Anki takes about this long to answer a small request when it's idle.
+  constexpr std::chrono::microseconds anki_delay{ 500 };
+  for (std::size_t const n_hits: { 10UL, 100UL, 1000UL }) {
+    AnkiConnectStandIn const anki{ n_hits, anki_delay };
+    auto const address = anki.address();
+    auto const args = std::to_array<std::string_view>({
+      "--word",
+      "食べる",
+      "--show-fields",
+      "VocabKanji,SentKanji",
+      "--ankiconnect",
+      address,
+      "--cache",
+      "no",
+    });
+    BENCHMARK(std::format("gd-ankisearch, {} hits", n_hits))
+    {
+      std::ostringstream out{};
+      search_anki_cards(args, out);
+      return out.view().size();
+    };
+
+    // What the row loop used to add: a getNoteTags request per card.
+    cpr::Session session{};
+    session.SetUrl(cpr::Url{ address });
+    BENCHMARK(std::format("getNoteTags per card, {} hits", n_hits))
+    {
+      std::size_t total = 0;
+      for (std::size_t idx = 0; idx < n_hits; ++idx) {
+        session.SetBody(cpr::Body{ R"({"action": "getNoteTags", "version": 6, "params": {"note": 1600000000000}})" });
+        total += session.Post().text.size();
+      }
+      return total;
+    };
+  }
+}
+
+TEST_CASE("AnkiConnect chunks in flight", "[!benchmark][ankisearch]")
+{
+  constexpr std::chrono::microseconds anki_delay{ 500 };
+  constexpr std::size_t n_hits{ 1000 };
+  AnkiConnectStandIn const anki{ n_hits, anki_delay };
+  auto const address = anki.address();
+  for (std::string_view const max_requests: { "1", "2", "4", "8" }) {
+    auto const args = std::to_array<std::string_view>({
+      "--word",
+      "食べる",
+      "--show-fields",
+      "VocabKanji,SentKanji",
+      "--ankiconnect",
+      address,
+      "--cache",
+      "no",
+      "--chunk-size",
+      "100",
+      "--max-requests",
+      max_requests,
+    });
+    BENCHMARK(std::format("{} hits, {} requests at once", n_hits, max_requests))
+    {
+      std::ostringstream out{};
+      search_anki_cards(args, out);
+      return out.view().size();
+    };
+  }
+}
+
+TEST_CASE("AnkiConnect card cache", "[!benchmark][ankisearch]")
+{
+  constexpr std::chrono::microseconds anki_delay{ 500 };
+  auto const root = std::filesystem::temp_directory_path() / std::format("gd-tools-bench-cards-{}", this_pid);
+  ScopedEnv const cache_home{ "XDG_CACHE_HOME", root.string() };
+  for (std::size_t const n_hits: { 10UL, 100UL, 1000UL }) {
+    AnkiConnectStandIn const anki{ n_hits, anki_delay };
+    auto const address = anki.address();
+    for (std::string_view const cache: { "no", "yes" }) {
+      auto const args = std::to_array<std::string_view>({
+        "--word",
+        "食べる",
+        "--show-fields",
+        "VocabKanji,SentKanji",
+        "--ankiconnect",
+        address,
+        "--cache",
+        cache,
+      });
+      // The cache is filled by the first run, so the benchmark measures lookups that find every card there.
+      BENCHMARK(std::format("{} hits, cache: {}", n_hits, cache))
+      {
+        std::ostringstream out{};
+        search_anki_cards(args, out);
+        return out.view().size();
+      };
+    }
+  }
+  std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Anki collection", "[!benchmark][ankisearch]")
+{
+  constexpr std::chrono::microseconds anki_delay{ 500 };
+  constexpr std::size_t n_notes{ 100'000 };
+  auto const root = std::filesystem::temp_directory_path() / std::format("gd-tools-bench-collection-{}", this_pid);
+  std::filesystem::create_directories(root);
+  auto const collection = (root / "collection.anki2").string();
+  write_standin_collection(collection, 2 * n_notes);
+  // The stand-in answers the first `n_hits` cards to any search, the collection the ones that match.
+  // 食べる1234 is in 11 notes of the collection, 食べる12 in 1111.
+  for (auto const& [word, n_hits]: { std::pair{ "食べる1234", 22UL }, std::pair{ "食べる12", 2222UL } }) {
+    AnkiConnectStandIn const anki{ n_hits, anki_delay };
+    auto const address = anki.address();
+    auto const ankiconnect_args = std::to_array<std::string_view>({
+      "--word",
+      word,
+      "--show-fields",
+      "VocabKanji,SentKanji",
+      "--ankiconnect",
+      address,
+      "--cache",
+      "no",
+    });
+    BENCHMARK(std::format("AnkiConnect, {} hits", n_hits))
+    {
+      std::ostringstream out{};
+      search_anki_cards(ankiconnect_args, out);
+      return out.view().size();
+    };
+    auto const collection_args = std::to_array<std::string_view>({
+      "--word",
+      word,
+      "--show-fields",
+      "VocabKanji,SentKanji",
+      "--collection",
+      collection,
+    });
+    BENCHMARK(std::format("collection of {} notes, {} hits", n_notes, n_hits))
+    {
+      std::ostringstream out{};
+      search_anki_cards(collection_args, out);
+      return out.view().size();
+    };
+    // While Anki has the profile open, the collection is locked and every lookup falls back to AnkiConnect.
+    sqlite3* anki_db{ nullptr };
+    sqlite3_open(collection.c_str(), &anki_db);
+    sqlite3_exec(
+      anki_db,
+      "PRAGMA locking_mode = EXCLUSIVE; BEGIN IMMEDIATE; UPDATE col SET mod = 1; COMMIT;",
+      nullptr,
+      nullptr,
+      nullptr
+    );
+    auto const locked_args = std::to_array<std::string_view>({
+      "--word",
+      word,
+      "--show-fields",
+      "VocabKanji,SentKanji",
+      "--collection",
+      collection,
+      "--ankiconnect",
+      address,
+      "--cache",
+      "no",
+    });
+    BENCHMARK(std::format("locked collection, then AnkiConnect, {} hits", n_hits))
+    {
+      std::ostringstream out{};
+      search_anki_cards(locked_args, out);
+      return out.view().size();
+    };
+    sqlite3_close(anki_db);
+  }
+  std::filesystem::remove_all(root);
+}
+
+TEST_CASE("AnkiConnect sessions", "[!benchmark][ankisearch]")
+{
+  AnkiConnectStandIn const anki{ 10 };
+  auto const address = anki.address();
+  auto const request = R"({"action": "getMediaDirPath", "version": 6})";
+  BENCHMARK("pooled session")
+  {
+    return ankiconnect_call({ .address = address }, "getMediaDirPath", request).size();
+  };
+  // How every request was made before sessions were kept: a new handle and connection.
+  BENCHMARK("cpr::Post")
+  {
+    return cpr::Post(cpr::Url{ address }, cpr::Body{ request }, cpr::Header{ { "Content-Type", "application/json" } })
+      .text.size();
+  };
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "precompiled.h"
+
+// Sets an environment variable until the end of the scope, also when a REQUIRE fails in between.
+class ScopedEnv
+{
+public:
+  ScopedEnv(std::string name, std::string const& value) : m_name(std::move(name))
+  {
+    if (auto const* const old_value = std::getenv(m_name.c_str()); old_value != nullptr) {
+      m_old_value = old_value;
+    }
+    ::setenv(m_name.c_str(), value.c_str(), 1);
+  }
+
+  ~ScopedEnv()
+  {
+    if (m_old_value.has_value()) {
+      ::setenv(m_name.c_str(), m_old_value->c_str(), 1);
+    } else {
+      ::unsetenv(m_name.c_str());
+    }
+  }
+
+  ScopedEnv(ScopedEnv const&) = delete;
+  auto operator=(ScopedEnv const&) -> ScopedEnv& = delete;
+
+private:
+  std::string m_name;
+  std::optional<std::string> m_old_value{};
+};
@@ -1,11 +1,86 @@
+#include "actions.h"
+#include "anki_collection.h"
+#include "anki_search.h"
+#include "ankiconnect.h"
+#include "ankiconnect_standin.h"
+#include "batch.h"
+#include "card_cache.h"
+#include "inflect.h"
 #include "kana_conv.h"
+#include "marisa_annotate.h"
+#include "marisa_build.h"
+#include "marisa_dict.h"
+#include "mandarin.h"
+#include "marisa_split.h"
 #include "mecab_split.h"
+#include "normalize.h"
+#include "prefetch.h"
+#include "resources.h"
+#include "scoped_env.h"
+#include "segment_cache.h"
+#include "serve.h"
+#include "utf8_index.h"
 #include "util.h"
 #include <catch2/catch_test_macros.hpp>
+#include <random>
 
 using SVec = std::vector<std::string_view>;
 using namespace std::string_view_literals;
 
+namespace {
+auto temp_dic_path(std::string_view const name) -> std::filesystem::path
+{
+  return std::filesystem::temp_directory_path() / std::format("gd-tools-test-{}-{}.dic", name, this_pid);
+}
+
+auto make_plain_dic(std::span<std::string const> const words, std::filesystem::path const& path)
+  -> std::filesystem::path
+{
+  marisa::Keyset keyset;
+  for (auto const& word: words) { keyset.push_back(word.c_str(), word.length()); }
+  marisa::Trie trie;
+  trie.build(keyset);
+  trie.save(path.c_str());
+  return path;
+}
+
+// half_to_full() as it was before the normalization pass replaced it.
+auto reference_half_to_full(std::string str) -> std::string
+{
+  static std::unordered_map<std::string_view, std::string_view> const conv_map = {
+    { "ｱ", "ア" }, { "ｲ", "イ" }, { "ｳ", "ウ" }, { "ｴ", "エ" }, { "ｵ", "オ" }, { "ｶ", "カ" }, { "ｷ", "キ" },
+    { "ｸ", "ク" }, { "ｹ", "ケ" }, { "ｺ", "コ" }, { "ｻ", "サ" }, { "ｼ", "シ" }, { "ｽ", "ス" }, { "ｾ", "セ" },
+    { "ｿ", "ソ" }, { "ﾀ", "タ" }, { "ﾁ", "チ" }, { "ﾂ", "ツ" }, { "ﾃ", "テ" }, { "ﾄ", "ト" }, { "ﾅ", "ナ" },
+    { "ﾆ", "ニ" }, { "ﾇ", "ヌ" }, { "ﾈ", "ネ" }, { "ﾉ", "ノ" }, { "ﾊ", "ハ" }, { "ﾋ", "ヒ" }, { "ﾌ", "フ" },
+    { "ﾍ", "ヘ" }, { "ﾎ", "ホ" }, { "ﾏ", "マ" }, { "ﾐ", "ミ" }, { "ﾑ", "ム" }, { "ﾒ", "メ" }, { "ﾓ", "モ" },
+    { "ﾔ", "ヤ" }, { "ﾕ", "ユ" }, { "ﾖ", "ヨ" }, { "ﾗ", "ラ" }, { "ﾘ", "リ" }, { "ﾙ", "ル" }, { "ﾚ", "レ" },
+    { "ﾛ", "ロ" }, { "ﾜ", "ワ" }, { "ｦ", "ヲ" }, { "ﾝ", "ン" }, { "ｧ", "ァ" }, { "ｨ", "ィ" }, { "ｩ", "ゥ" },
+    { "ｪ", "ェ" }, { "ｫ", "ォ" }, { "ｯ", "ッ" }, { "ｬ", "ャ" }, { "ｭ", "ュ" }, { "ｮ", "ョ" }, { "｡", "。" },
+    { "､", "、" }, { "･", "・" }, { "゛", "ﾞ" }, { "゜", "ﾟ" }, { "｢", "「" }, { "｣", "」" }, { "ｰ", "ー" }
+  };
+  std::string result{};
+  for (auto const uni_char: iter_unicode_chars(str)) {
+    auto const found = conv_map.find(uni_char);
+    result.append(found != conv_map.end() ? found->second : uni_char);
+  }
+  return result;
+}
+
+// Random text made of the pieces that normalization treats differently.
+auto random_mixed_text(std::minstd_rand& gen) -> std::string
+{
+  static auto const pieces = SVec{
+    "a", "Z", "1", " ", "\t", "\n", "\r", "ｶ", "ﾞ", "ｰ", "｡", "｢", "ﾝ", "゛", "゜", "あ", "か゚", "ア", "ヴ",
+    "ゝ", "ヽ", "、", "「", "\u3000", "漢", "字", "я", "é", "😀", "ﾟ", "ｯ", "ゖ", "ヶ", "ー", "・",
+  };
+  std::uniform_int_distribution<std::size_t> pick_piece{ 0, pieces.size() - 1 };
+  std::uniform_int_distribution<std::size_t> pick_len{ 0, 40 };
+  std::string text{};
+  for (std::size_t len = pick_len(gen); len > 0; --len) { text.append(pieces.at(pick_piece(gen))); }
+  return text;
+}
+} // namespace
+
 TEST_CASE("Hiragana to katakana", "[hiragana_to_katakana]")
 {
   REQUIRE(hiragana_to_katakana("あいうえお") == "アイウエオ");
@@ -18,6 +93,25 @@ TEST_CASE("Hiragana to katakana", "[hiragana_to_katakana]")
   );
 }
 
+TEST_CASE("Kana conversion table", "[hiragana_to_katakana]")
+{
+  REQUIRE(hiragana_to_katakana(hiragana_chars) == katakana_chars);
+  REQUIRE(katakana_to_hiragana(katakana_chars) == hiragana_chars);
+  REQUIRE(hiragana_to_katakana("ゝゞゔゕゖ") == "ヽヾヴヵヶ");
+  REQUIRE(katakana_to_hiragana("ヷヸヹヺ・ー") == "ヷヸヹヺ・ー");
+  REQUIRE(hiragana_to_katakana("「ゟ」〜ㇰ") == "「ゟ」〜ㇰ");
+  REQUIRE(hiragana_to_katakana("Plain ASCII text, 16+ bytes long") == "Plain ASCII text, 16+ bytes long");
+
+  std::string text{ "Test か゚き゚ 漢字とカナ" };
+  convert_kana_in_place<Direction::kata_to_hira>(text);
+  REQUIRE(text == "Test か゚き゚ 漢字とかな");
+  convert_kana_in_place<Direction::hira_to_kata>(text);
+  REQUIRE(text == "Test カ゚キ゚ 漢字トカナ");
+
+  // Truncated sequences at the end are left alone.
+  REQUIRE(hiragana_to_katakana("あ\xE3\x81") == "ア\xE3\x81");
+}
+
 TEST_CASE("Trim string", "[strtrim]")
 {
   REQUIRE(strtrim("  あいうえお ") == "あいうえお");
@@ -33,6 +127,43 @@ TEST_CASE("Iterate chars", "[iterate]")
   REQUIRE(test_vec == ref_vec);
 }
 
+TEST_CASE("UTF-8 index", "[iterate]")
+{
+  SECTION("Same characters as the views")
+  {
+    auto const test_case = "あいうえおabcdeабвгд😀 long ASCII tail"sv;
+    Utf8Index const index{ test_case };
+    auto test_vec = SVec{};
+    std::ranges::transform(index.chars(), std::back_inserter(test_vec), &Utf8CharView::ch);
+    auto ref_vec = SVec{};
+    std::ranges::copy(iter_unicode_chars(test_case), std::back_inserter(ref_vec));
+    REQUIRE(test_vec == ref_vec);
+    REQUIRE(index.code_points().size() == index.size());
+    REQUIRE(index.substr(1, 3) == "いう");
+    REQUIRE(index.byte_offset(index.size()) == test_case.size());
+  }
+  SECTION("Grapheme clusters")
+  {
+    Utf8Index const index{ "か゚き\u309A神\U000E0100だ👍🏽🇯🇵\r\n" };
+    auto test_vec = SVec{};
+    std::ranges::transform(index.chars(), std::back_inserter(test_vec), &Utf8CharView::ch);
+    REQUIRE(test_vec == SVec{ "か゚", "き\u309A", "神\U000E0100", "だ", "👍🏽", "🇯🇵", "\r\n" });
+    REQUIRE(index.code_points().size() == 13);
+    REQUIRE(index.code_point(1) == "\u309A");
+  }
+  SECTION("Invalid input")
+  {
+    REQUIRE(find_invalid_utf8("あいう abc") == std::nullopt);
+    REQUIRE(find_invalid_utf8("abcdefgh\x80") == 8);
+    REQUIRE(find_invalid_utf8("あ\xE3\x81") == 3);
+    REQUIRE(find_invalid_utf8("\xC0\xAF") == 0); // overlong '/'
+    REQUIRE(find_invalid_utf8("\xED\xA0\x80") == 0); // surrogate
+    REQUIRE(find_invalid_utf8("\xF4\x90\x80\x80") == 0); // above U+10FFFF
+    REQUIRE_THROWS_AS(Utf8Index{ "abc\xFF" }, gd::runtime_error);
+    REQUIRE(Utf8Index{ "" }.empty());
+  }
+}
+
 TEST_CASE("half to full", "[convert]")
 {
   std::string from =
@@ -42,12 +173,87 @@ TEST_CASE("half to full", "[convert]")
     "ラ リ ル レ ロ ワ ヲ ン ァ ィ ゥ ェ ォ ッ ャ ュ ョ";
   half_to_full(from);
   REQUIRE(from == to);
+
+  std::string voiced{ "ｶﾞｷﾞ｡" };
+  REQUIRE(half_to_full(voiced) == "カﾞキﾞ。");
+}
+
+TEST_CASE("Normalization", "[normalize]")
+{
+  SECTION("Examples")
+  {
+    std::string text{ " ｶﾞｯｺｳ ﾆ\tｲｸ｡\n" };
+    REQUIRE(normalize(text) == "カﾞッコウニイク。");
+    text = "お前は もう ﾀﾞﾒだ";
+    REQUIRE(normalize(text, { .fold_kana = Direction::hira_to_kata }) == "オ前ハモウタﾞメダ");
+    text = "ｶﾀｶﾅ ﾃﾞｽ";
+    REQUIRE(normalize(text, { .remove_spaces = false, .fold_kana = Direction::kata_to_hira }) == "かたかな てﾞす");
+    text = "";
+    REQUIRE(normalize(text).empty());
+    text = "\xE3\x81 \xEF";
+    REQUIRE(normalize(text) == "\xE3\x81\xEF");
+  }
+  SECTION("Same result as the separate steps")
+  {
+    std::minstd_rand gen{ 42 };
+    for (int round = 0; round < 2000; ++round) {
+      auto const text = random_mixed_text(gen);
+
+      auto expected = reference_half_to_full(text);
+      std::erase_if(expected, is_space);
+      auto actual = text;
+      REQUIRE(normalize(actual) == expected);
+
+      actual = text;
+      REQUIRE(normalize(actual, { .remove_spaces = false }) == reference_half_to_full(text));
+      actual = text;
+      REQUIRE(half_to_full(actual) == reference_half_to_full(text));
+
+      actual = text;
+      REQUIRE(
+        normalize(actual, { .fold_width = false, .remove_spaces = false, .fold_kana = Direction::hira_to_kata })
+        == hiragana_to_katakana(text)
+      );
+      actual = text;
+      REQUIRE(
+        normalize(actual, { .fold_kana = Direction::kata_to_hira }) == katakana_to_hiragana(expected)
+      );
+    }
+  }
+  SECTION("Separate output buffer")
+  {
+    std::string_view const text{ "ｱｲｳ abc 漢字" };
+    std::array<char, 64> buffer{};
+    auto const len = normalize_into(text, buffer);
+    REQUIRE(std::string_view{ buffer.data(), len } == "アイウabc漢字");
+  }
+}
+
+TEST_CASE("Mandarin input", "[mandarin]")
+{
+  REQUIRE(sanitize_mandarin("今天 天气") == "今天天气");
+  REQUIRE(sanitize_mandarin("今天tianqi很好") == "今天 很好");
+  REQUIRE(sanitize_mandarin("jin tian TIAN qi 好") == " 好");
+  REQUIRE(sanitize_mandarin("我们\n去") == "我们 去");
+  REQUIRE(sanitize_mandarin("三2个，") == "三2个，");
 }
 
 TEST_CASE("JpSet", "[JpSet]")
 {
   JpSet set = { "キサマ", "きさま" };
   REQUIRE(set.size() == 1);
+  REQUIRE(*set.begin() == "キサマ");
+  REQUIRE(set.contains("きさま"));
+
+  // Longer words go first.
+  set.emplace("き");
+  set.emplace("きさまら");
+  REQUIRE_FALSE(set.emplace("キサマラ"));
+  REQUIRE(std::vector<std::string>(set.begin(), set.end()) == std::vector<std::string>{ "きさまら", "キサマ", "き" });
+
+  auto const hash = KanaInsensitiveHash{};
+  REQUIRE(hash(KanaInsensitiveKey{ "きさま" }) == hash(KanaInsensitiveKey{ "キサマ" }));
+  REQUIRE(KanaInsensitiveKey{ "きさま" } == KanaInsensitiveKey{ "キサマ" });
 }
 
 TEST_CASE("replace_all", "[replace_all]")
@@ -57,3 +263,867 @@ TEST_CASE("replace_all", "[replace_all]")
   test = replace_all(test, "私私", "");
   REQUIRE(test == "私　家　出ようとomouんだ。");
 }
+
+TEST_CASE("MeCab headword spans", "[mecab]")
+{
+  // Tokens of "食べてから食べた", as MeCab would split it.
+  std::string_view const sentence{ "食べてから食べた" };
+  Utf8Index const index{ sentence };
+  auto const token = [sentence](std::size_t const begin, std::size_t const end) {
+    return MecabToken{ .surface = sentence.substr(begin, end - begin), .begin = begin, .end = end };
+  };
+  auto const tokens = std::vector{ token(0, 6), token(6, 9), token(9, 15), token(15, 21), token(21, 24) };
+  auto const render = [&tokens](std::span<ByteSpan const> const spans) {
+    std::string html{};
+    for (auto const& t: tokens) { append_highlighted(html.append("|"), t, spans); }
+    return html;
+  };
+
+  SECTION("Word spanning several tokens")
+  {
+    auto const spans = find_headword_spans(index, "べてか");
+    REQUIRE(spans.size() == 1);
+    REQUIRE(render(spans) == "|食<b>べ</b>|<b>て</b>|<b>か</b>ら|食べ|た");
+  }
+  SECTION("Every occurrence")
+  {
+    auto const spans = find_headword_spans(index, "食べ");
+    REQUIRE(spans.size() == 2);
+    REQUIRE(render(spans) == "|<b>食べ</b>|て|から|<b>食べ</b>|た");
+  }
+  SECTION("No word")
+  {
+    REQUIRE(find_headword_spans(index, "").empty());
+    REQUIRE(render({}) == "|食べ|て|から|食べ|た");
+  }
+  SECTION("Whole characters only")
+  {
+    Utf8Index const marked{ "か\u309Aきか" };
+    auto const spans = find_headword_spans(marked, "か");
+    REQUIRE(spans.size() == 1);
+    REQUIRE(spans.front().begin == 9);
+  }
+}
+
+TEST_CASE("Kana-folded dictionary", "[marisa_build]")
+{
+  auto const words = std::vector<std::string>{ "きさま", "キサマ", "貴様", "ドキドキ", "どきどき", "する", "ドキドキする" };
+  auto const plain_path = make_plain_dic(words, temp_dic_path("plain"));
+  auto const folded_path = temp_dic_path("folded");
+
+  std::istringstream word_list{ join_with(words, "\n") };
+  REQUIRE(write_folded_dic(word_list, folded_path) == words.size());
+
+  MarisaDict const plain{ plain_path, TrieLoadMode::read };
+  MarisaDict const folded{ folded_path, TrieLoadMode::read };
+  REQUIRE_FALSE(plain.is_folded());
+  REQUIRE(folded.is_folded());
+
+  auto const terms = SVec{ "きさまだ", "キサマだ", "どきどきする", "ドキドキする", "貴様" };
+  marisa::Agent agent;
+  auto const expected = plain.common_prefix_search(agent, terms);
+  REQUIRE(std::ranges::equal(folded.common_prefix_search(agent, terms), expected));
+  REQUIRE(std::ranges::equal(expected, SVec{ "きさま", "キサマ", "どきどき", "ドキドキ", "ドキドキする", "貴様" }));
+
+  std::filesystem::remove(plain_path);
+  std::filesystem::remove(folded_path);
+  std::filesystem::remove(std::filesystem::path{ folded_path } += surfaces_file_ext);
+}
+
+TEST_CASE("Sentence lattice", "[build_lattice]")
+{
+  auto const words = std::vector<std::string>{ "私", "食べる", "食べ物", "物" };
+  auto const path = make_plain_dic(words, temp_dic_path("lattice"));
+  MarisaDict const dict{ path, TrieLoadMode::read };
+  marisa::Agent agent;
+
+  auto const lattice = build_lattice(agent, dict, "私は食べ物を食べた");
+  auto const& nodes = lattice.nodes;
+  REQUIRE(nodes.size() == 9);
+  REQUIRE(nodes[0].uni_char == "私");
+  REQUIRE(nodes[0].words.size() == 1);
+  REQUIRE(nodes[1].words.empty());
+  REQUIRE(nodes[2].words.contains("食べ物"));
+  REQUIRE(nodes[4].words.contains("物"));
+  REQUIRE(nodes[6].words.contains("食べる"));
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Conjugate", "[conjugate]")
+{
+  auto const has_form = [](std::string_view const word, std::string_view const form, std::string_view const rules) {
+    return std::ranges::any_of(conjugate(word), [&](Conjugation const& c) {
+      return c.form == form and c.rules == rules;
+    });
+  };
+  REQUIRE(has_form("食べる", "食べました", "polite past"));
+  REQUIRE(has_form("書く", "書いて", "-te"));
+  REQUIRE(has_form("書く", "書かなかった", "negative, past"));
+  REQUIRE(has_form("行く", "行った", "past"));
+  REQUIRE(has_form("来る", "来ない", "negative"));
+  REQUIRE(has_form("勉強する", "勉強している", "-te, -iru"));
+  REQUIRE(has_form("高い", "高くなかった", "negative, past"));
+  REQUIRE(conjugate("猫").empty());
+}
+
+TEST_CASE("Conjugated forms index", "[FormsIndex]")
+{
+  auto const words = std::vector<std::string>{ "私", "食べる", "食べ物", "物" };
+  auto const path = temp_dic_path("forms");
+  std::istringstream word_list{ join_with(words, "\n") };
+  write_folded_dic(word_list, path);
+  REQUIRE(write_forms_index(words, forms_path(path)) > 0);
+
+  MarisaDict const dict{ path, TrieLoadMode::read };
+  REQUIRE(dict.forms() != nullptr);
+  marisa::Agent agent;
+  auto const hits = dict.forms()->common_prefix_search(agent, "食べさせられなかったか");
+  REQUIRE(std::ranges::any_of(hits, [](InflectedForm const& form) {
+    return form.surface == "食べさせられなかった" and form.dictionary_form == "食べる" and not form.rules.empty();
+  }));
+
+  for (auto const mode: { DeinflectMode::index, DeinflectMode::runtime }) {
+    auto const lattice = build_lattice(agent, dict, "私は食べ物を食べた", { .deinflect = mode });
+    REQUIRE(lattice.nodes[0].words.contains("私"));
+    REQUIRE(lattice.nodes[2].words.contains("食べ物"));
+    REQUIRE(lattice.nodes[6].words.contains("食べる"));
+  }
+
+  for (auto const ext: { ""sv, surfaces_file_ext, forms_file_ext }) {
+    std::filesystem::remove(std::filesystem::path{ path } += ext);
+  }
+  std::filesystem::remove(forms_path(path) += entries_file_ext);
+}
+
+TEST_CASE("Index and runtime deinflection agree", "[FormsIndex]")
+{
+  auto const words = std::vector<std::string>{ "食べる", "書く", "読む", "見る", "勉強する", "高い" };
+  auto const path = temp_dic_path("forms-agree");
+  std::istringstream word_list{ join_with(words, "\n") };
+  write_folded_dic(word_list, path);
+  write_forms_index(words, forms_path(path));
+  MarisaDict const dict{ path, TrieLoadMode::read };
+  marisa::Agent agent;
+
+  auto const runtime_chain = [](std::string_view const form, std::string_view const word) {
+    for (auto const& deinflection: ajt::rdricpp::deinflect(form)) {
+      if (deinflection.term == word) {
+        return join_with(deinflection.reasons, ", ");
+      }
+    }
+    return std::string{};
+  };
+
+  // Each sentence has a conjugation of two or three steps.
+  auto const sentences = std::vector<std::pair<std::string_view, std::string_view>>{
+    { "野菜を食べさせられなかった", "食べる" },
+    { "手紙を書かせられた", "書く" },
+    { "本を読みたくなかった", "読む" },
+    { "ずっと勉強していなかった", "勉強する" },
+    { "映画を見られていた", "見る" },
+    { "高くなかった", "高い" },
+  };
+  for (auto const& [sentence, conjugated]: sentences) {
+    auto const index = build_lattice(agent, dict, sentence, { .deinflect = DeinflectMode::index });
+    auto const runtime = build_lattice(agent, dict, sentence, { .deinflect = DeinflectMode::runtime });
+    REQUIRE(index.deinflections.empty());
+    REQUIRE(std::ranges::any_of(index.nodes, [&](LatticeNode const& node) { return node.headword == conjugated; }));
+    REQUIRE(index.nodes.size() == runtime.nodes.size());
+    for (auto const& [by_index, by_runtime]: std::views::zip(index.nodes, runtime.nodes)) {
+      REQUIRE(by_index.words == by_runtime.words);
+      REQUIRE(by_index.headword == by_runtime.headword);
+    }
+    // The rule chains stored in the index are the ones the deinflector gives.
+    REQUIRE_FALSE(index.forms.empty());
+    for (auto const& form: index.forms) { REQUIRE(form.rules == runtime_chain(form.surface, form.dictionary_form)); }
+  }
+
+  for (auto const ext: { ""sv, surfaces_file_ext, forms_file_ext }) {
+    std::filesystem::remove(std::filesystem::path{ path } += ext);
+  }
+  std::filesystem::remove(forms_path(path) += entries_file_ext);
+}
+
+TEST_CASE("Frequency ranks", "[RankTable]")
+{
+  auto const words = std::vector<std::string>{ "かう", "カウ", "買う", "かうんと", "カウンター" };
+  auto const path = temp_dic_path("ranks");
+  std::istringstream word_list{ join_with(words, "\n") };
+  write_folded_dic(word_list, path);
+  std::istringstream freq_list{ "買う\t12345\nかう\nカウンター\n" };
+  // かう and カウ share a key.
+  REQUIRE(write_rank_table(path, freq_list) == 3);
+
+  MarisaDict const dict{ path, TrieLoadMode::read };
+  REQUIRE(dict.has_ranks());
+  marisa::Agent agent;
+  REQUIRE(dict.rank(agent, "買う") == 0);
+  REQUIRE(dict.rank(agent, "カウ") == 1);
+  REQUIRE(dict.rank(agent, "カウンター") == 2);
+  REQUIRE(dict.rank(agent, "かうんと") == unranked);
+  REQUIRE(dict.rank(agent, "犬") == unranked);
+
+  auto const ranked = std::vector<RankedWord>{ { "a", unranked }, { "bb", 3 }, { "c", 0 }, { "ddd", unranked } };
+  auto top = keep_top_k(ranked, 3);
+  std::ranges::sort(top, {}, &RankedWord::rank);
+  REQUIRE(std::ranges::equal(top | std::views::transform(&RankedWord::word), SVec{ "c", "bb", "ddd" }));
+  REQUIRE(keep_top_k(ranked, 0).empty());
+  // A frequent word beats a slightly longer rare one.
+  REQUIRE(headword_score({ "買う", 0 }) > headword_score({ "買うか", unranked }));
+  REQUIRE(headword_score({ "買う", 50'000 }) < headword_score({ "買うか", unranked }));
+
+  auto const lattice = build_lattice(agent, dict, "かうんたー", { .top_k = 1 });
+  REQUIRE(lattice.nodes[0].words.size() == 1);
+  REQUIRE(lattice.nodes[0].words.contains("かう"));
+
+  for (auto const ext: { ""sv, surfaces_file_ext, ranks_file_ext }) {
+    std::filesystem::remove(std::filesystem::path{ path } += ext);
+  }
+}
+
+TEST_CASE("Several dictionaries", "[build_lattice]")
+{
+  auto const main_path = make_plain_dic(std::vector<std::string>{ "私", "食べる" }, temp_dic_path("main"));
+  auto const extra_path = make_plain_dic(std::vector<std::string>{ "私", "食べ物" }, temp_dic_path("extra"));
+  MarisaDict const main_dic{ main_path, TrieLoadMode::mmap };
+  MarisaDict const extra_dic{ extra_path, TrieLoadMode::mmap };
+  auto const dicts = std::array{ &main_dic, &extra_dic };
+  marisa::Agent agent;
+
+  auto const lattice = build_lattice(agent, dicts, "私は食べ物を食べた");
+  auto const source_of = [&lattice](std::size_t const node_idx, std::string_view const word) {
+    auto const& node = lattice.nodes.at(node_idx);
+    auto const found = std::ranges::find(node.words, word);
+    REQUIRE(found != node.words.end());
+    return node.sources.at(static_cast<std::size_t>(std::ranges::distance(node.words.begin(), found)));
+  };
+  // A word found in both dictionaries is attributed to the first one.
+  REQUIRE(lattice.nodes[0].words.size() == 1);
+  REQUIRE(source_of(0, "私") == 0);
+  REQUIRE(source_of(2, "食べ物") == 1);
+  REQUIRE(source_of(6, "食べる") == 0);
+
+  std::filesystem::remove(main_path);
+  std::filesystem::remove(extra_path);
+}
+
+TEST_CASE("Batch requests", "[batch]")
+{
+  std::istringstream requests{
+    "{\"id\": 1, \"cmd\": \"echo\", \"word\": \"書\", \"font_size\": \"5rem\"}\n"
+    "\n"
+    "{\"cmd\": \"no-such-command\"}\n"
+    "not json\n"
+  };
+  std::ostringstream responses{};
+  REQUIRE(run_batch(requests, responses) == 3);
+
+  std::istringstream lines{ responses.str() };
+  std::string line{};
+  std::getline(lines, line);
+  auto const echo = nlohmann::json::parse(line);
+  REQUIRE(echo["id"] == 1);
+  REQUIRE(echo["output"].get<std::string>().contains("書"));
+  REQUIRE(echo["output"].get<std::string>().contains("font-size: 5rem"));
+  std::getline(lines, line);
+  REQUIRE(nlohmann::json::parse(line)["error"].get<std::string>().contains("no-such-command"));
+  std::getline(lines, line);
+  REQUIRE(nlohmann::json::parse(line).contains("error"));
+}
+
+TEST_CASE("Subtitle files", "[marisa_annotate]")
+{
+  std::istringstream srt{ "1\n00:00:01,000 --> 00:00:02,500\n<i>私は</i>\n食べた\n\n2\n00:00:03,000 --> 00:00:04,000\n物\n" };
+  auto const srt_lines = parse_srt(srt);
+  REQUIRE(srt_lines.size() == 2);
+  REQUIRE(srt_lines[0].start == "00:00:01,000");
+  REQUIRE(srt_lines[0].end == "00:00:02,500");
+  REQUIRE(srt_lines[0].text == "私は食べた");
+  REQUIRE(srt_lines[1].number == 2);
+  // Numbers come from the file, even when cues in between are empty.
+  std::istringstream gaps{ "\xEF\xBB\xBF" "7\n00:00:01,000 --> 00:00:02,000\n\n\n8\n00:00:03,000 --> 00:00:04,000\n"
+                           "<i></i>\n\n9\n00:00:05,000 --> 00:00:06,000\n物\n" };
+  auto const gap_lines = parse_srt(gaps);
+  REQUIRE(gap_lines.size() == 1);
+  REQUIRE(gap_lines[0].number == 9);
+
+  std::istringstream ass{
+    "[Events]\n"
+    "Format: Layer, Start, End, Style, Name, MarginL, MarginR, MarginV, Effect, Text\n"
+    "Dialogue: 0,0:00:00.00\n"
+    "Dialogue: 0,0:00:01.00,0:00:02.50,Default,,0,0,0,,{\\an8}私は、\\N食べ物を食べた\n"
+  };
+  auto const ass_lines = parse_ass(ass);
+  REQUIRE(ass_lines.size() == 1);
+  REQUIRE(ass_lines[0].number == 2);
+  REQUIRE(ass_lines[0].start == "0:00:01.00");
+  REQUIRE(ass_lines[0].text == "私は、食べ物を食べた");
+
+  auto const path = make_plain_dic(std::vector<std::string>{ "私", "食べる", "食べ物", "物" }, temp_dic_path("annotate"));
+  MarisaDict const dict{ path, TrieLoadMode::mmap };
+  auto const dicts = std::array{ &dict };
+  std::vector<SubtitleLine> lines{};
+  for (std::size_t idx = 0; idx < 50; ++idx) { lines.push_back(idx % 2 == 0 ? srt_lines[0] : ass_lines[0]); }
+
+  // Output keeps the order of the lines, no matter how many workers there are.
+  auto const single = annotate_lines(lines, dicts, {}, 1);
+  REQUIRE(annotate_lines(lines, dicts, {}, 4) == single);
+  auto const first = nlohmann::json::parse(single.front());
+  REQUIRE(first["text"] == "私は食べた");
+  REQUIRE(first["words"].front() == "私");
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Resource resolver", "[resources]")
+{
+  namespace fs = std::filesystem;
+  auto const root = fs::temp_directory_path() / std::format("gd-tools-test-resources-{}", this_pid);
+  fs::remove_all(root);
+  fs::create_directories(root / "cache");
+  fs::create_directories(root / "first");
+  fs::create_directories(root / "second" / "addon" / "dic");
+  std::ofstream{ root / "second" / "addon" / "dic" / "dicrc" } << "";
+  ScopedEnv const cache_home{ "XDG_CACHE_HOME", (root / "cache").string() };
+  REQUIRE(resource_index_path() == root / "cache" / "gd-tools" / "resources.json");
+
+  ResourceQuery const query{ .file_name = "dicrc", .dirs = { root / "first", root / "second" } };
+  auto const before = resolver_stats();
+  REQUIRE(resolve_resource(query) == root / "second" / "addon" / "dic" / "dicrc");
+  REQUIRE(resolver_stats().walks == before.walks + 1);
+  REQUIRE(fs::is_regular_file(resource_index_path()));
+
+  // Nothing changed, so the index answers.
+  REQUIRE(resolve_resource(query) == root / "second" / "addon" / "dic" / "dicrc");
+  REQUIRE(resolver_stats().index_hits == before.index_hits + 1);
+  REQUIRE(resolver_stats().walks == before.walks + 1);
+
+  // A new file in an earlier root changes that root's mtime and wins.
+  std::ofstream{ root / "first" / "dicrc" } << "";
+  fs::last_write_time(root / "first", fs::last_write_time(root / "first") + std::chrono::seconds{ 5 });
+  REQUIRE(resolve_resource(query) == root / "first" / "dicrc");
+  REQUIRE(resolver_stats().walks == before.walks + 2);
+
+  // Missing files are remembered for a short while.
+  ResourceQuery const missing{ .file_name = "no-such-file", .dirs = { root / "first" }, .recursive = false };
+  REQUIRE(resolve_resource(missing).empty());
+  REQUIRE(resolve_resource(missing).empty());
+  REQUIRE(resolver_stats().walks == before.walks + 3);
+  REQUIRE(resolver_stats().index_hits == before.index_hits + 2);
+
+  fs::remove_all(root);
+}
+
+TEST_CASE("Segment cache", "[segment_cache]")
+{
+  auto const path = std::filesystem::temp_directory_path() / std::format("gd-tools-test-{}.cache", this_pid);
+  std::filesystem::remove(path);
+  std::string value{};
+  {
+    SegmentCache cache{ path };
+    REQUIRE_FALSE(cache.find("私は食べた", value));
+    cache.insert("私は食べた", "tokens");
+    REQUIRE(cache.find("私は食べた", value));
+    REQUIRE(value == "tokens");
+    cache.insert("私は食べた", "other tokens");
+    REQUIRE(cache.find("私は食べた", value));
+    REQUIRE(value == "other tokens");
+
+    // Values that don't fit in a slot are skipped.
+    cache.insert("long", std::string(SegmentCache::slot_size, 'x'));
+    REQUIRE_FALSE(cache.find("long", value));
+
+    // An entry that is used before every insert is never the least recently used one.
+    auto const capacity = SegmentCache::n_sets * SegmentCache::n_ways;
+    auto const n_inserts = capacity * 4;
+    for (std::size_t idx = 0; idx < n_inserts; ++idx) {
+      REQUIRE(cache.find("私は食べた", value));
+      cache.insert(std::format("sentence {}", idx), std::to_string(idx));
+    }
+    REQUIRE(cache.find(std::format("sentence {}", n_inserts - 1), value));
+    REQUIRE(value == std::to_string(n_inserts - 1));
+
+    auto const stats = cache.stats();
+    REQUIRE(stats.capacity == capacity);
+    REQUIRE(stats.entries == capacity);
+    REQUIRE(stats.evictions == n_inserts - (capacity - 1));
+    REQUIRE(stats.misses == 2);
+  }
+  {
+    // Another process sees the same entries and counters.
+    SegmentCache cache{ path };
+    REQUIRE(cache.find("私は食べた", value));
+    REQUIRE(cache.stats().misses == 2);
+    cache.clear();
+    REQUIRE_FALSE(cache.find("私は食べた", value));
+    REQUIRE(cache.stats().entries == 0);
+    REQUIRE(cache.stats().hits == 0);
+  }
+  {
+    SegmentCache cache{ path };
+    cache.insert("私は食べた", "tokens");
+    // Another process wrote a value size that doesn't fit in the slot into every slot.
+    // Slots start after the 4096-byte header, and the value size follows two u64 and the key size.
+    {
+      std::fstream file{ path, std::ios::binary | std::ios::in | std::ios::out };
+      uint32_t const value_size{ 0xFFFFFF00 };
+      for (std::size_t idx = 0; idx < SegmentCache::n_sets * SegmentCache::n_ways; ++idx) {
+        file.seekp(static_cast<std::streamoff>(4096 + idx * SegmentCache::slot_size + 20));
+        file.write(reinterpret_cast<char const*>(&value_size), sizeof(value_size));
+      }
+    }
+    REQUIRE_FALSE(cache.find("私は食べた", value));
+    REQUIRE(cache.stats().entries == 0);
+    cache.insert("私は食べた", "tokens");
+    REQUIRE(cache.find("私は食べた", value));
+    REQUIRE(value == "tokens");
+  }
+  std::filesystem::remove(path);
+
+  // A symlink in place of the file is refused.
+  auto const target = std::filesystem::path{ path }.concat(".target");
+  std::ofstream{ target } << "";
+  std::filesystem::create_symlink(target, path);
+  REQUIRE_THROWS_AS(SegmentCache{ path }, gd::runtime_error);
+  std::filesystem::remove(path);
+  std::filesystem::remove(target);
+
+  std::string bytes{};
+  append_u32(bytes, 42);
+  append_str(bytes, "食べる");
+  append_str(bytes, "");
+  ByteReader reader{ bytes };
+  REQUIRE(reader.u32() == 42);
+  REQUIRE(reader.str() == "食べる");
+  REQUIRE(reader.str().empty());
+  REQUIRE_THROWS_AS(reader.u32(), gd::corrupted_cache_entry);
+
+  // A count can't be more than the bytes left can hold.
+  std::string counted{};
+  append_u32(counted, 2);
+  append_str(counted, "a");
+  append_str(counted, "b");
+  REQUIRE(ByteReader{ counted }.count(sizeof(uint32_t)) == 2);
+  REQUIRE_THROWS_AS(ByteReader{ counted }.count(8), gd::corrupted_cache_entry);
+  std::string huge{};
+  append_u32(huge, 0xFFFF'FFFF);
+  REQUIRE_THROWS_AS(ByteReader{ huge }.count(1), gd::corrupted_cache_entry);
+}
+
+TEST_CASE("Private directory", "[util]")
+{
+  namespace fs = std::filesystem;
+  auto const root = fs::temp_directory_path() / std::format("gd-tools-test-private-{}", this_pid);
+  fs::remove_all(root);
+  make_private_dir(root / "gd-tools");
+  REQUIRE((fs::status(root / "gd-tools").permissions() & fs::perms::all) == fs::perms::owner_all);
+  // Existing directories are checked too.
+  make_private_dir(root / "gd-tools");
+
+  fs::create_directories(root / "shared");
+  fs::permissions(root / "shared", fs::perms::owner_all | fs::perms::group_read | fs::perms::group_exec);
+  REQUIRE_THROWS_AS(make_private_dir(root / "shared"), gd::runtime_error);
+  fs::create_directory_symlink(root / "gd-tools", root / "link");
+  REQUIRE_THROWS_AS(make_private_dir(root / "link"), gd::runtime_error);
+  fs::remove_all(root);
+}
+
+TEST_CASE("Action server", "[serve]")
+{
+  auto const root = std::filesystem::temp_directory_path() / std::format("gd-tools-test-serve-{}", this_pid);
+  auto const path = root / "serve.sock";
+  auto const args = SVec{ "--word", "書", "--max-len", "10" };
+  std::ostringstream expected{};
+  REQUIRE(run_action("echo", args, expected));
+
+  // Nothing listens yet.
+  std::ostringstream unanswered{};
+  REQUIRE_FALSE(forward_to_server(path, "echo", args, unanswered));
+  REQUIRE(unanswered.view().empty());
+
+  ActionServer server{ path, 4 };
+  REQUIRE_THROWS_AS(ActionServer(path, 1), gd::runtime_error);
+  std::jthread listener{ [&server] { server.run(); } };
+
+  // Answers arrive whole and unchanged, also when requests come at once.
+  std::vector<std::string> outputs(16);
+  {
+    std::vector<std::jthread> clients{};
+    for (auto& output: outputs) {
+      clients.emplace_back([&] {
+        std::ostringstream out{};
+        if (forward_to_server(path, "echo", args, out)) {
+          output = std::move(out).str();
+        }
+      });
+    }
+  }
+  for (auto const& output: outputs) { REQUIRE(output == expected.view()); }
+
+  // What an action prints to stderr comes back separately, for the client's stderr.
+  {
+    AnkiConnectStandIn const anki{ 2 };
+    auto const address = anki.address();
+    auto const stats_args = SVec{ "--word", "食べる", "--ankiconnect", address, "--cache", "no", "--stats", "yes" };
+    std::ostringstream table{};
+    std::ostringstream stats{};
+    REQUIRE(forward_to_server(path, "ankisearch", stats_args, table, stats));
+    REQUIRE(table.view().contains("gd-ankisearch-table"));
+    REQUIRE(stats.view().contains("AnkiConnect findCards: "));
+  }
+
+  // An unknown action is left to the caller.
+  std::ostringstream unknown{};
+  REQUIRE_FALSE(forward_to_server(path, "no-such-action", args, unknown));
+
+  // So are lookups from another environment or working directory, whose paths would mean something else.
+  {
+    ScopedEnv const cache_home{ "XDG_CACHE_HOME", (root / "cache").string() };
+    std::ostringstream other_env{};
+    CHECK_FALSE(forward_to_server(path, "echo", args, other_env));
+    CHECK(other_env.view().empty());
+  }
+  auto const cwd = std::filesystem::current_path();
+  std::filesystem::current_path(root);
+  std::ostringstream other_cwd{};
+  CHECK_FALSE(forward_to_server(path, "echo", args, other_cwd));
+  std::filesystem::current_path(cwd);
+
+  server.stop();
+  listener.join();
+
+  // A server that doesn't take the request is given up on long before the response timeout.
+  std::filesystem::remove(path);
+  {
+    int const hung = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::ranges::copy(path.native(), address.sun_path);
+    REQUIRE(::bind(hung, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) == 0);
+    REQUIRE(::listen(hung, 1) == 0);
+    auto const start = std::chrono::steady_clock::now();
+    std::ostringstream never_answered{};
+    CHECK_FALSE(forward_to_server(path, "echo", args, never_answered));
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds{ 5 });
+    ::close(hung);
+  }
+  std::filesystem::remove_all(root);
+
+  // A directory that other users can write to is refused.
+  std::filesystem::create_directories(root);
+  std::filesystem::permissions(root, std::filesystem::perms::all);
+  REQUIRE_THROWS_AS(ActionServer(path, 1), gd::runtime_error);
+  std::filesystem::remove_all(root);
+}
+
+TEST_CASE("Prefetched results", "[prefetch]")
+{
+  namespace fs = std::filesystem;
+  auto const root = fs::temp_directory_path() / std::format("gd-tools-test-prefetch-{}", this_pid);
+  fs::remove_all(root);
+  ScopedEnv const runtime_dir{ "XDG_RUNTIME_DIR", root.string() };
+
+  auto const stored = SVec{ "--max-time", "5", "--word", "食べる" };
+  auto const reordered = SVec{ "--word", "食べる", "--max-time", "5" };
+  auto const specs = std::vector<std::string>{ "images", "massif" };
+  auto const session = prefetch_session_id(specs, "sentence");
+  REQUIRE(prefetch_session_id(std::vector<std::string>{ "massif", "images" }, "sentence") == session);
+  begin_prefetch_session(session);
+  REQUIRE_FALSE(find_prefetched("images", stored).has_value());
+  store_prefetched(session, "images", stored, "<div>images</div>");
+  REQUIRE(find_prefetched("images", reordered) == "<div>images</div>");
+  REQUIRE_FALSE(find_prefetched("images", SVec{ "--word", "食べる" }).has_value());
+  REQUIRE_FALSE(find_prefetched("massif", stored).has_value());
+
+  // Clicks are answered from the stored output without a request.
+  std::ostringstream out{};
+  REQUIRE(run_action("images", reordered, out));
+  REQUIRE(out.view() == "<div>images</div>");
+
+  // Anki changes while reading, so prefetching its cards only fills the card cache.
+  REQUIRE(is_prefetchable("ankisearch"));
+  store_prefetched(session, "ankisearch", stored, "<div>cards</div>");
+  REQUIRE_FALSE(find_prefetched("ankisearch", stored).has_value());
+
+  // Errors aren't kept.
+  store_prefetched(session, "massif", SVec{ "--word", "ケーキ" }, "Couldn't connect.\n");
+  REQUIRE_FALSE(find_prefetched("massif", SVec{ "--word", "ケーキ" }).has_value());
+
+  // Output fetched for another sentence isn't used until the reader gets there.
+  auto const next_session = prefetch_session_id(specs, "other sentence");
+  store_prefetched(next_session, "massif", SVec{ "--word", "ケーキ" }, "<div>sentences</div>");
+  REQUIRE_FALSE(find_prefetched("massif", SVec{ "--word", "ケーキ" }).has_value());
+  begin_prefetch_session(next_session);
+  REQUIRE(find_prefetched("massif", SVec{ "--word", "ケーキ" }).has_value());
+  REQUIRE_FALSE(find_prefetched("images", stored).has_value());
+
+  // Entries with other specs, e.g. gd-marisa and gd-mecab in one GoldenDict group, read sentences side by side.
+  // Each keeps using its own output while the other one moves on.
+  begin_prefetch_session(prefetch_session_id(std::vector<std::string>{ "images --max-time 5" }, "third sentence"));
+  REQUIRE(find_prefetched("massif", SVec{ "--word", "ケーキ" }).has_value());
+  {
+    auto const program_specs = std::to_array<std::vector<std::string>>({ { "massif" }, { "images --max-time 5" } });
+    std::atomic_size_t n_missed{ 0 };
+    std::vector<std::jthread> programs{};
+    for (std::size_t program = 0; program < program_specs.size(); ++program) {
+      programs.emplace_back([&, program] {
+        auto const action = (program == 0 ? "massif" : "images");
+        for (std::size_t idx = 0; idx < 50; ++idx) {
+          auto const sentence = std::format("sentence {}", idx);
+          auto const program_session = prefetch_session_id(program_specs[program], sentence);
+          auto const args = SVec{ "--word", sentence };
+          begin_prefetch_session(program_session);
+          store_prefetched(program_session, action, args, "<div>result</div>");
+          if (not find_prefetched(action, args).has_value()) {
+            ++n_missed;
+          }
+        }
+      });
+    }
+    programs.clear();
+    REQUIRE(n_missed == 0);
+  }
+
+  // A prefetched ankisearch lookup leaves the cards in the card cache, so the click only checks them.
+  {
+    ScopedEnv const cache_home{ "XDG_CACHE_HOME", (root / "cache").string() };
+    AnkiConnectStandIn const anki{ 4 };
+    auto const address = anki.address();
+    auto const spec = std::format("ankisearch --ankiconnect {}", address);
+    prefetch(SVec{ "--action", spec, "--word", "食べる" });
+    REQUIRE(anki.n_requests("cardsInfo") == 1);
+    std::ostringstream clicked{};
+    REQUIRE(run_action("ankisearch", SVec{ "--word", "食べる", "--ankiconnect", address, "--cache", "yes" }, clicked));
+    REQUIRE(clicked.view().contains("ankisearch:cid:1700000000003"));
+    REQUIRE(anki.n_requests("cardsInfo") == 1);
+    REQUIRE(anki.n_requests("multi") == 1);
+  }
+
+  // Words after the clicked one come first, without duplicates, the clicked word or empty headwords.
+  auto const words = SVec{ "ケーキ", "", "を", "食べる", "ケーキ", "-x", "美味しい" };
+  REQUIRE(prefetch_order(words, "食べる") == SVec{ "ケーキ", "美味しい", "を" });
+  REQUIRE(prefetch_order(words, "不在") == SVec{ "ケーキ", "を", "食べる", "美味しい" });
+
+  fs::remove_all(root);
+}
+
+TEST_CASE("AnkiConnect requests", "[ankisearch]")
+{
+  // Ten cards of five notes.
+  AnkiConnectStandIn const anki{ 10 };
+  auto const address = anki.address();
+  std::ostringstream out{};
+  search_anki_cards(
+    SVec{ "--word", "食べる", "--show-fields", "VocabKanji", "--ankiconnect", address, "--cache", "no" },
+    out
+  );
+  REQUIRE(out.view().contains(R"(<a href="ankisearch:cid:1700000000009">1700000000009</a>)"));
+  REQUIRE(out.view().contains(R"(<a class="gd-tag-link" href="ankisearch:tag:tag4">tag4</a>)"));
+
+  // Tags of all notes arrive in one request, whatever the number of cards.
+  REQUIRE(anki.n_requests("findCards") == 1);
+  REQUIRE(anki.n_requests("getMediaDirPath") == 1);
+  REQUIRE(anki.n_requests("cardsInfo") == 1);
+  REQUIRE(anki.n_requests("notesInfo") == 1);
+  REQUIRE(anki.n_requests("getNoteTags") == 0);
+
+  // Chunks in flight at once give the same table, and the notes of all chunks still arrive in one request.
+  std::ostringstream chunked{};
+  auto const chunked_args = SVec{ "--word",        "食べる", "--show-fields",  "VocabKanji", "--ankiconnect",
+                                  address,         "--cache", "no",             "--chunk-size", "3",
+                                  "--max-requests", "3" };
+  search_anki_cards(chunked_args, chunked);
+  REQUIRE(chunked.view() == out.view());
+  REQUIRE(anki.n_requests("cardsInfo") == 1 + 4);
+  REQUIRE(anki.n_requests("notesInfo") == 1 + 1);
+}
+
+TEST_CASE("Card cache", "[ankisearch]")
+{
+  namespace fs = std::filesystem;
+  auto const root = fs::temp_directory_path() / std::format("gd-tools-test-cards-{}", this_pid);
+  fs::remove_all(root);
+  ScopedEnv const cache_home{ "XDG_CACHE_HOME", root.string() };
+
+  SECTION("Entries outlive the process")
+  {
+    {
+      CardCache cache{ card_cache_path() };
+      cache.store_card({ .id = 1, .queue = 2, .type = 2, .deck_name = "Mining", .nid = 10 }, 100, 500);
+      cache.store_note(10, { .tags = { "tag" }, .fields = { { "VocabKanji", "食べる" } } }, 200, 300);
+      cache.save();
+    }
+    CardCache cache{ card_cache_path() };
+    REQUIRE(cache.note_of(1) == 10);
+    REQUIRE_FALSE(cache.note_of(2).has_value());
+    auto const card = cache.find(1, 100, 200);
+    REQUIRE(card.has_value());
+    // Asked from AnkiConnect on every lookup instead.
+    REQUIRE(card->deck_name.empty());
+    REQUIRE(card->fields.at("VocabKanji") == "食べる");
+    // The note was edited.
+    REQUIRE_FALSE(cache.find(1, 100, 201).has_value());
+    REQUIRE(cache.find_note(10, 200)->tags == std::vector<std::string>{ "tag" });
+    auto const stats = cache.stats();
+    REQUIRE(stats.card_hits == 1);
+    REQUIRE(stats.card_misses == 1);
+    REQUIRE(stats.bytes_saved == 500 + 300);
+
+    // A damaged file is an empty cache.
+    std::ofstream{ card_cache_path(), std::ios::binary | std::ios::app } << "garbage";
+    REQUIRE_FALSE(CardCache{ card_cache_path() }.note_of(1).has_value());
+  }
+
+  SECTION("Lookups ask AnkiConnect for modified cards only")
+  {
+    AnkiConnectStandIn anki{ 10 };
+    auto const address = anki.address();
+
+    // The cache is opt-in.
+    std::ostringstream uncached{};
+    search_anki_cards(SVec{ "--word", "食べる", "--show-fields", "VocabKanji", "--ankiconnect", address }, uncached);
+    REQUIRE_FALSE(fs::exists(card_cache_path()));
+
+    auto const args = SVec{ "--word",        "食べる", "--show-fields", "VocabKanji", "--ankiconnect", address,
+                            "--chunk-size", "4",      "--cache",       "yes" };
+    std::ostringstream first{};
+    search_anki_cards(args, first);
+    REQUIRE(first.view() == uncached.view());
+    REQUIRE(anki.n_requests("cardsInfo") == 1 + 3);
+    REQUIRE(anki.n_requests("notesInfo") == 1 + 1);
+    // Nothing was cached yet, so there was nothing to check.
+    REQUIRE(anki.n_requests("multi") == 0);
+
+    // Everything is in the cache, and the table is the same.
+    // Modification times and decks are checked in one request, the media folder is asked for every time.
+    std::ostringstream second{};
+    search_anki_cards(args, second);
+    REQUIRE(second.view() == first.view());
+    REQUIRE(anki.n_requests("cardsInfo") == 1 + 3);
+    REQUIRE(anki.n_requests("notesInfo") == 1 + 1);
+    REQUIRE(anki.n_requests("getMediaDirPath") == 3);
+    REQUIRE(anki.n_requests("multi") == 1);
+    REQUIRE(anki.n_requests("cardsModTime") == 1);
+    REQUIRE(anki.n_requests("notesModTime") == 1);
+    REQUIRE(anki.n_requests("getDecks") == 1);
+
+    // Only the two cards of the edited note are fetched again.
+    anki.edit_note(1'600'000'000'002);
+    std::ostringstream third{};
+    search_anki_cards(args, third);
+    REQUIRE(third.view() == first.view());
+    REQUIRE(anki.n_requests("cardsInfo") == 1 + 4);
+    REQUIRE(anki.n_requests("notesInfo") == 1 + 2);
+
+    // A renamed deck shows even though no card was modified.
+    anki.rename_deck("Sentences");
+    std::ostringstream fourth{};
+    search_anki_cards(args, fourth);
+    REQUIRE(fourth.view().contains("<td>Sentences</td>"));
+    REQUIRE_FALSE(fourth.view().contains("<td>Mining</td>"));
+    REQUIRE(anki.n_requests("cardsInfo") == 1 + 4);
+  }
+
+  fs::remove_all(root);
+}
+
+TEST_CASE("Anki collection", "[ankisearch]")
+{
+  namespace fs = std::filesystem;
+  auto const root = fs::temp_directory_path() / std::format("gd-tools-test-collection-{}", this_pid);
+  fs::remove_all(root);
+  fs::create_directories(root);
+  auto const collection = (root / "collection.anki2").string();
+  write_standin_collection(collection, 10);
+  AnkiConnectStandIn const anki{ 10 };
+  auto const address = anki.address();
+
+  // The same table as AnkiConnect gives, without asking it anything.
+  std::ostringstream expected{};
+  search_anki_cards(
+    SVec{ "--word", "食べる", "--show-fields", "VocabKanji", "--ankiconnect", address, "--cache", "no" },
+    expected
+  );
+  auto const direct_args =
+    SVec{ "--word", "食べる", "--show-fields", "VocabKanji", "--ankiconnect", address, "--collection", collection };
+  std::ostringstream direct{};
+  search_anki_cards(direct_args, direct);
+  REQUIRE(direct.view() == expected.view());
+  REQUIRE(anki.n_requests("findCards") == 1);
+
+  // Images are in the media folder next to the collection.
+  std::ostringstream images{};
+  search_anki_cards(SVec{ "--word", "食べる3", "--show-fields", "SentKanji", "--collection", collection }, images);
+  REQUIRE(images.view().contains(std::format(R"(src="file://{}/3.webp")", (root / "collection.media").string())));
+
+  // Field and deck names are case-insensitive, and the word has to be in the named field.
+  std::ostringstream narrowed{};
+  search_anki_cards(
+    SVec{ "--word", "食べる3", "--field-name", "vocabkanji", "--deck-name", "mining", "--collection", collection },
+    narrowed
+  );
+  REQUIRE(narrowed.view().contains("ankisearch:cid:1700000000006"));
+  REQUIRE(narrowed.view().contains("ankisearch:cid:1700000000007"));
+  REQUIRE_FALSE(narrowed.view().contains("ankisearch:cid:1700000000005"));
+  std::ostringstream other_field{};
+  search_anki_cards(SVec{ "--word", "食べる3", "--field-name", "SentKanji", "--collection", collection }, other_field);
+  REQUIRE(other_field.view().contains("No cards found."));
+  std::ostringstream other_deck{};
+  search_anki_cards(SVec{ "--word", "食べる", "--deck-name", "Default", "--collection", collection }, other_deck);
+  REQUIRE(other_deck.view().contains("No cards found."));
+
+  // Anki's search syntax is left to AnkiConnect, which reads `*` and `_` as wildcards, for example.
+  std::ostringstream wildcard{};
+  search_anki_cards(SVec{ "--word", "食べ*", "--ankiconnect", address, "--collection", collection }, wildcard);
+  REQUIRE(wildcard.view().contains("gd-ankisearch-table"));
+  REQUIRE(anki.n_requests("findCards") == 2);
+  REQUIRE(is_plain_search({ .word = "食べる ケーキ", .field_name = "", .deck_name = "Mining" }));
+  REQUIRE(is_plain_search({ .word = "-食べる", .field_name = "VocabKanji", .deck_name = "" }));
+  for (auto const word: { "食べ_", "tag:verb", "-食べる", "食べる or ケーキ", "\"食べる\"", "食べる　ケーキ" }) {
+    REQUIRE_FALSE(is_plain_search({ .word = word, .field_name = "", .deck_name = "" }));
+  }
+  REQUIRE_FALSE(is_plain_search({ .word = "食べる", .field_name = "", .deck_name = "Mining*" }));
+
+  // Anki keeps the collection of an open profile to itself. Then AnkiConnect answers.
+  sqlite3* anki_db{ nullptr };
+  REQUIRE(sqlite3_open(collection.c_str(), &anki_db) == SQLITE_OK);
+  auto const lock_sql = "PRAGMA locking_mode = EXCLUSIVE; BEGIN IMMEDIATE; UPDATE col SET mod = 1; COMMIT;";
+  REQUIRE(sqlite3_exec(anki_db, lock_sql, nullptr, nullptr, nullptr) == SQLITE_OK);
+  std::ostringstream locked{};
+  search_anki_cards(direct_args, locked);
+  REQUIRE(locked.view() == expected.view());
+  REQUIRE(anki.n_requests("findCards") == 3);
+  sqlite3_close(anki_db);
+
+  // A collection that doesn't exist is an error, not a fallback.
+  std::ostringstream missing{};
+  search_anki_cards(SVec{ "--word", "食べる", "--collection", (root / "missing.anki2").string() }, missing);
+  REQUIRE(missing.view().starts_with("Can't open the Anki collection"));
+  fs::remove_all(root);
+}
+
+TEST_CASE("AnkiConnect sessions", "[ankisearch]")
+{
+  using namespace std::chrono_literals;
+  AnkiConnectStandIn const anki{ 4 };
+  auto const address = anki.address();
+  auto const request = R"({"action": "getMediaDirPath", "version": 6})";
+  AnkiConnectLog log{};
+  AnkiConnectOptions const options{ .address = address, .log = &log };
+  for (int idx = 0; idx < 5; ++idx) {
+    REQUIRE(ankiconnect_call(options, "getMediaDirPath", request) == "/tmp/collection.media");
+  }
+
+  // Requests one after another share a connection.
+  REQUIRE(anki.n_connections() == 1);
+  auto const entries = log.entries();
+  REQUIRE(entries.size() == 5);
+  REQUIRE(std::ranges::count(entries, true, &AnkiConnectRequest::new_connection) == 1);
+  REQUIRE(entries.front().new_connection);
+
+  // Nothing listens on port 1.
+  AnkiConnectOptions const unreachable{ .address = "127.0.0.1:1", .connect_timeout = 200ms, .log = &log };
+  REQUIRE_THROWS_AS(ankiconnect_call(unreachable, "getMediaDirPath", request), gd::runtime_error);
+  REQUIRE(log.entries().size() == 6);
+}
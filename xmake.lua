@@ -15,7 +15,7 @@ add_rules("plugin.compile_commands.autoupdate", {outputdir = "build"})
 
 add_requires("cpr >= 1.11", {configs = {ssl = true}})
 add_requires("cpp-subprocess")
-add_requires("nlohmann_json", "marisa", "rdricpp", "mecab")
+add_requires("nlohmann_json", "marisa", "rdricpp", "mecab", "sqlite3")
 
 if is_mode("debug") then
     add_defines("DEBUG")
@@ -62,7 +62,7 @@ end
 -- Main target
 target(main_bin_name)
     set_kind("binary")
-    add_packages("cpr","nlohmann_json", "marisa", "rdricpp", "mecab", "cpp-subprocess")
+    add_packages("cpr","nlohmann_json", "marisa", "rdricpp", "mecab", "cpp-subprocess", "sqlite3")
     add_files("src/*.cpp")
     add_cxflags("-D_GLIBCXX_ASSERTIONS")
     set_pcxxheader("src/precompiled.h")
@@ -79,7 +79,7 @@ target(main_bin_name)
         end
 
         local bin_dir = path.join(target:installdir(), "/bin/")
-        local variants = { "gd-ankisearch", "gd-echo", "gd-massif", "gd-images", "gd-marisa", "gd-mecab", }
+        local variants = { "gd-ankisearch", "gd-echo", "gd-massif", "gd-images", "gd-marisa", "gd-mecab", "gd-mandarin", }
 
         -- Link alternative names
         -- to enable calling `gd-ankisearch` instead of more verbose `gd-tools ankisearch`, etc.
@@ -101,6 +101,7 @@ target(main_bin_name)
         local share_dir = path.join(target:installdir(), "/share/", main_bin_name)
         if not os.isdir(share_dir) then os.mkdir(share_dir) end
         os.cp("res/*.dic", share_dir)
+        os.cp("res/mandarin_dict", share_dir)
         print("Installed dictionary files.")
 
         -- Copy sh files
@@ -131,7 +132,7 @@ if has_config("tests") then
     -- Tests target
     target("tests")
         set_kind("binary")
-        add_packages("cpr", "nlohmann_json", "marisa", "catch2", "rdricpp", "mecab", "cpp-subprocess")
+        add_packages("cpr", "nlohmann_json", "marisa", "catch2", "rdricpp", "mecab", "cpp-subprocess", "sqlite3")
         add_files("src/*.cpp", "tests/*.cpp")
         remove_files("src/main.cpp")
         set_pcxxheader("src/precompiled.h")